@@ -0,0 +1,6 @@
+# config.h for CreateRemdDirs
+# configured using: ./configure -nonetcdf -openmp gnu
+
+CXX=g++
+CXXFLAGS= -O3 -Wall -fopenmp  -DHAS_ZLIB -D_LARGEFILE_SOURCE -D_FILE_OFFSET_BITS=64 
+LDFLAGS=-fopenmp  -lz
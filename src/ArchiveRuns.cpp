@@ -0,0 +1,150 @@
+#include <cerrno>
+#include <cstring>   // strerror
+#include <algorithm> // std::sort
+#include <dirent.h>
+#include <fcntl.h>   // openat
+#include <unistd.h>  // close
+#include <sys/stat.h>
+#ifdef _OPENMP
+# include <omp.h>
+#endif
+#include "ArchiveRuns.h"
+#include "TarGz.h"
+#include "Messages.h"
+
+/** Add names of all files (not directories) under dname relative to dir,
+  * recursively, to files.
+  */
+static int ListFiles(DirHandle const& dir, std::string const& dname, StrArray& files) {
+  int fd = openat(dir.Fd(), dname.c_str(), O_RDONLY | O_DIRECTORY);
+  DIR* dp = (fd < 0) ? 0 : fdopendir(fd);
+  if (dp == 0) {
+    ErrorMsg("Opening dir '%s': %s\n", dname.c_str(), strerror( errno ));
+    if (fd > -1) close( fd );
+    return 1;
+  }
+  StrArray subdirs;
+  struct dirent* ent;
+  while ( (ent = readdir(dp)) != 0 ) {
+    std::string name( ent->d_name );
+    if (name == "." || name == "..") continue;
+    std::string fname( dname + "/" + name );
+    struct stat fstat;
+    if (fstatat(dir.Fd(), fname.c_str(), &fstat, AT_SYMLINK_NOFOLLOW) != 0) continue;
+    if (S_ISDIR(fstat.st_mode))
+      subdirs.push_back( fname );
+    else
+      files.push_back( fname );
+  }
+  closedir( dp );
+  for (StrArray::const_iterator sub = subdirs.begin(); sub != subdirs.end(); ++sub)
+    if (ListFiles(dir, *sub, files)) return 1;
+  return 0;
+}
+
+/// \return true if file is a trajectory, i.e. in a TRAJ dir or an MD trajectory.
+static inline bool IsTraj(std::string const& fname) {
+  if (fname.find("/TRAJ/") != std::string::npos) return true;
+  size_t slash = fname.rfind('/');
+  return (fname.compare(slash + 1, 5, "md.nc") == 0);
+}
+
+/// \return true if file is archived trajectory output from cpptraj.
+static inline bool IsArchivedTraj(std::string const& fname, std::string const& rdir) {
+  std::string trajDir( rdir + "/TRAJ/" );
+  if (fname.compare(0, trajDir.size(), trajDir) != 0) return false;
+  return (fname.compare(trajDir.size(), 7, "wat.nc.") == 0 ||
+          fname.compare(trajDir.size(), 9, "nowat.nc.") == 0);
+}
+
+/** Write the run (everything but trajectories) and trajectory archives of
+  * the given archives together, compressing blocks of both in parallel.
+  */
+static int WriteArchives(TarGz& runTar, TarGz& trajTar) {
+  int nthreads = 1;
+# ifdef _OPENMP
+  nthreads = omp_get_max_threads();
+# endif
+  TarGz* tars[2] = { &runTar, &trajTar };
+  while (!runTar.Done() || !trajTar.Done()) {
+    // Read input for both archives at the same time.
+    int err = 0;
+#   ifdef _OPENMP
+#   pragma omp parallel for num_threads(2) reduction(+: err)
+#   endif
+    for (int it = 0; it < 2; it++)
+      err += tars[it]->Fill( nthreads );
+    if (err != 0) return 1;
+    int nblocks = (int)(runTar.Nblocks() + trajTar.Nblocks());
+    int blk;
+#   ifdef _OPENMP
+#   pragma omp parallel for schedule(dynamic) reduction(+: err)
+#   endif
+    for (blk = 0; blk < nblocks; blk++) {
+      if ((unsigned int)blk < runTar.Nblocks())
+        err += runTar.Compress( blk );
+      else
+        err += trajTar.Compress( blk - runTar.Nblocks() );
+    }
+    if (err != 0) {
+      ErrorMsg("Compressing archive data failed.\n");
+      return 1;
+    }
+    if (runTar.Write()) return 1;
+    if (trajTar.Write()) return 1;
+  }
+  if (runTar.Close()) return 1;
+  if (trajTar.Close()) return 1;
+  return 0;
+}
+
+// ArchiveRuns()
+/** Create the archives that the archive script would create with tar for
+  * each run: '<run>.tgz' with everything but trajectories, and
+  * '<ardir>/traj.<run>.tgz' with the sorted solvated (wat.nc.*) and
+  * stripped (nowat.nc.*) trajectories written by cpptraj. Each run
+  * directory is read once; the two archives are written concurrently.
+  */
+int ArchiveRuns(std::string const& TopDir, StrArray const& RunDirs, std::string const& ardir,
+                bool overwrite)
+{
+  DirHandle topDir;
+  if (topDir.Open(TopDir)) return 1;
+  if (CheckExists(topDir, "Archive directory", ardir)) return 1;
+  for (StrArray::const_iterator rdir = RunDirs.begin(); rdir != RunDirs.end(); ++rdir)
+  {
+    std::string runArchive( *rdir + ".tgz" );
+    std::string trajArchive( ardir + "/traj." + *rdir + ".tgz" );
+    if (!overwrite) {
+      if (fileExists(topDir, runArchive)) {
+        ErrorMsg("Run archive %s already exists.\n", runArchive.c_str());
+        return 1;
+      }
+      if (fileExists(topDir, trajArchive)) {
+        ErrorMsg("Trajectory archive %s already exists.\n", trajArchive.c_str());
+        return 1;
+      }
+    }
+    StrArray files;
+    if (ListFiles(topDir, *rdir, files)) return 1;
+    std::sort( files.begin(), files.end() );
+    TarGz runTar, trajTar;
+    if (runTar.Open(topDir, runArchive, topDir)) return 1;
+    if (trajTar.Open(topDir, trajArchive, topDir)) return 1;
+    for (StrArray::const_iterator fname = files.begin(); fname != files.end(); ++fname)
+    {
+      if (!IsTraj(*fname))
+        runTar.AddFile( *fname );
+      else if (IsArchivedTraj(*fname, *rdir))
+        trajTar.AddFile( *fname );
+    }
+    if (trajTar.Nfiles() == 0) {
+      ErrorMsg("No archived trajectories (TRAJ/nowat.nc.*) found for %s\n", rdir->c_str());
+      return 1;
+    }
+    if (WriteArchives(runTar, trajTar)) return 1;
+    Msg("  %s: %u files in %s, %u files in %s\n", rdir->c_str(),
+        runTar.Nfiles(), runArchive.c_str(), trajTar.Nfiles(), trajArchive.c_str());
+  }
+  return 0;
+}
@@ -0,0 +1,5 @@
+#ifndef INC_ARCHIVERUNS_H
+#define INC_ARCHIVERUNS_H
+#include "FileRoutines.h"
+int ArchiveRuns(std::string const&, StrArray const&, std::string const&, bool);
+#endif
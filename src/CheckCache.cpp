@@ -0,0 +1,101 @@
+#include <cstdio>  // rename
+#include <cstdlib> // atoi, atol
+#include "CheckCache.h"
+#include "Messages.h"
+#include "TextFile.h"
+
+const char* CheckCache::indexName_ = ".checkruns.index";
+
+/** Index file format, one line per trajectory:
+  *   <traj> <traj size> <traj mtime> <output> <output size> <output mtime>
+  *   <expected frames> <actual frames> <status>
+  */
+int CheckCache::Load(std::string const& TopDir) {
+  entries_.clear();
+  modified_ = false;
+  top_ = TopDir + "/";
+  fname_ = top_ + indexName_;
+  off_t isize;
+  time_t imtime;
+  if (GetFileStat(fname_, isize, imtime)) return 0; // No index yet.
+  TextFile infile;
+  if (infile.OpenRead( fname_ )) return 1;
+  const char* SEP = " \t\n";
+  int ncols = infile.GetColumns( SEP );
+  while (ncols > -1) {
+    if (ncols > 0 && infile.Token(0)[0] != '#') {
+      if (ncols != 9) {
+        Msg("Warning: Malformed line in check index '%s'; ignoring index.\n", fname_.c_str());
+        entries_.clear();
+        modified_ = true;
+        break;
+      }
+      Entry entry;
+      entry.TrajSize  = (off_t)atol( infile.Token(1).c_str() );
+      entry.TrajMtime = (time_t)atol( infile.Token(2).c_str() );
+      entry.Output    = infile.Token(3);
+      entry.OutSize   = (off_t)atol( infile.Token(4).c_str() );
+      entry.OutMtime  = (time_t)atol( infile.Token(5).c_str() );
+      entry.Expected  = atoi( infile.Token(6).c_str() );
+      entry.Actual    = atoi( infile.Token(7).c_str() );
+      entries_[infile.Token(0)] = entry;
+    }
+    ncols = infile.GetColumns( SEP );
+  }
+  infile.Close();
+  return 0;
+}
+
+/** Write to a temporary file first and then rename so that the index is
+  * never left partially written.
+  */
+int CheckCache::Write() const {
+  if (!modified_ || fname_.empty()) return 0;
+  std::string tmpName( fname_ + ".tmp" );
+  TextFile outfile;
+  if (outfile.OpenWrite( tmpName )) return 1;
+  outfile.Printf("# CreateRemdDirs check index: <traj> <size> <mtime> <output> <size> <mtime>"
+                 " <expected> <actual> <status>\n");
+  for (EntryMap::const_iterator it = entries_.begin(); it != entries_.end(); ++it)
+  {
+    Entry const& entry = it->second;
+    outfile.Printf("%s %li %li %s %li %li %i %i %s\n", it->first.c_str(),
+                   (long int)entry.TrajSize, (long int)entry.TrajMtime,
+                   entry.Output.c_str(),
+                   (long int)entry.OutSize, (long int)entry.OutMtime,
+                   entry.Expected, entry.Actual,
+                   (entry.Expected == entry.Actual) ? "OK" : "BAD");
+  }
+  if (outfile.Close()) return 1;
+  if (rename(tmpName.c_str(), fname_.c_str()) != 0) {
+    ErrorMsg("Could not write check index '%s'\n", fname_.c_str());
+    return 1;
+  }
+  FileCacheInvalidate( fname_ );
+  return 0;
+}
+
+CheckCache::Entry const* CheckCache::Find(std::string const& traj, std::string const& output,
+                                          off_t tsize, time_t tmtime,
+                                          off_t osize, time_t omtime) const
+{
+  EntryMap::const_iterator it = entries_.find( traj );
+  if (it == entries_.end()) return 0;
+  Entry const& entry = it->second;
+  if (entry.Output    != output ||
+      entry.TrajSize  != tsize  || entry.TrajMtime != tmtime ||
+      entry.OutSize   != osize  || entry.OutMtime  != omtime)
+    return 0;
+  return &entry;
+}
+
+void CheckCache::Update(std::string const& traj, Entry const& entry) {
+  entries_[traj] = entry;
+  modified_ = true;
+}
+
+std::string CheckCache::Relative(std::string const& fname) const {
+  if (!top_.empty() && fname.compare(0, top_.size(), top_) == 0)
+    return fname.substr( top_.size() );
+  return fname;
+}
@@ -0,0 +1,44 @@
+#ifndef INC_CHECKCACHE_H
+#define INC_CHECKCACHE_H
+#include <map>
+#include "FileRoutines.h"
+/// Persistent index of previous run check results.
+/** Results are keyed on the trajectory file name (relative to the project
+  * top directory). A cached result is only considered valid if the size and
+  * modification time of both the trajectory and the output file it was
+  * checked against have not changed.
+  */
+class CheckCache {
+  public:
+    /// Hold cached check result for an output/trajectory pair.
+    struct Entry {
+      std::string Output; ///< Output file name (relative).
+      off_t TrajSize;     ///< Trajectory file size.
+      time_t TrajMtime;   ///< Trajectory modification time.
+      off_t OutSize;      ///< Output file size.
+      time_t OutMtime;    ///< Output modification time.
+      int Expected;       ///< # frames expected from output file.
+      int Actual;         ///< # frames in trajectory.
+    };
+
+    CheckCache() : modified_(false) {}
+    /// Load index from the given top directory if present.
+    int Load(std::string const&);
+    /// Write index if it has been modified.
+    int Write() const;
+    /// \return cached entry for traj/output if stat info matches, 0 otherwise.
+    Entry const* Find(std::string const&, std::string const&, off_t, time_t, off_t, time_t) const;
+    /// Add or replace entry for trajectory.
+    void Update(std::string const&, Entry const&);
+    /// \return File name relative to top directory.
+    std::string Relative(std::string const&) const;
+  private:
+    typedef std::map<std::string, Entry> EntryMap;
+    static const char* indexName_;
+
+    EntryMap entries_;   ///< Cached entries keyed on relative trajectory name.
+    std::string top_;    ///< Top directory, with trailing slash.
+    std::string fname_;  ///< Full index file name.
+    bool modified_;      ///< True if entries have been updated since Load.
+};
+#endif
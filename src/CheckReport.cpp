@@ -0,0 +1,109 @@
+#include <sys/time.h> // gettimeofday
+#include <cstdio>     // snprintf
+#include <cmath>      // fabs
+#include <cfloat>     // DBL_MAX
+#include "CheckReport.h"
+#include "Messages.h"
+#include "TextFile.h"
+
+const char* CheckReport::StatusStr[] = {
+  "OK", "SHORT", "TRUNCATED", "BAD_FRAME", "BAD_RESTART", "MISSING", "MISSING_OUTPUT",
+  "COUNT_MISMATCH", "ERROR"
+};
+
+unsigned int CheckReport::AddRecord(Record const& rec) {
+  records_.push_back( rec );
+  return (unsigned int)records_.size() - 1;
+}
+
+double CheckReport::WallTime() {
+  struct timeval tv;
+  gettimeofday( &tv, 0 );
+  return (double)tv.tv_sec + ((double)tv.tv_usec / 1000000.0);
+}
+
+/** \return String with JSON special and control characters escaped. */
+static std::string JsonStr(std::string const& str) {
+  std::string out("\"");
+  for (std::string::const_iterator c = str.begin(); c != str.end(); ++c) {
+    if (*c == '"' || *c == '\\') {
+      out += '\\';
+      out += *c;
+    } else if ((unsigned char)*c < 0x20) {
+      char buf[8];
+      snprintf(buf, sizeof(buf), "\\u%04x", (unsigned int)(unsigned char)*c);
+      out += buf;
+    } else
+      out += *c;
+  }
+  out += '"';
+  return out;
+}
+
+/** \return Number as JSON; NaN/Inf are not valid JSON and become null. */
+static std::string JsonNum(double val) {
+  if (!(fabs(val) <= DBL_MAX)) return std::string("null");
+  char buf[32];
+  snprintf(buf, sizeof(buf), "%g", val);
+  return std::string(buf);
+}
+
+/** \return String quoted for CSV if needed. */
+static std::string CsvStr(std::string const& str) {
+  if (str.find_first_of(",\"") == std::string::npos) return str;
+  std::string out("\"");
+  for (std::string::const_iterator c = str.begin(); c != str.end(); ++c) {
+    if (*c == '"') out += '"';
+    out += *c;
+  }
+  out += '"';
+  return out;
+}
+
+int CheckReport::WriteJson(std::string const& fname) const {
+  TextFile outfile;
+  if (outfile.OpenWrite( fname )) return 1;
+  outfile.Printf("[\n");
+  for (std::vector<Record>::const_iterator rec = records_.begin(); rec != records_.end(); ++rec)
+  {
+    outfile.Printf("  {\"run\": %s, \"replica\": %i, \"output\": %s, \"traj\": %s,"
+                   " \"expected\": %i, \"actual\": %i, \"restart_time\": %s,"
+                   " \"status\": \"%s\", \"cached\": %s, \"check_time\": %.6f,"
+                   " \"restart_check_time\": %.6f}%s\n",
+                   JsonStr(rec->Run).c_str(), rec->Replica, JsonStr(rec->Output).c_str(),
+                   JsonStr(rec->Traj).c_str(), rec->Expected, rec->Actual,
+                   JsonNum(rec->RstTime).c_str(),
+                   StatusStr[rec->Status], (rec->Cached ? "true" : "false"),
+                   rec->CheckTime, rec->RstCheckTime,
+                   (rec + 1 == records_.end()) ? "" : ",");
+  }
+  outfile.Printf("]\n");
+  if (outfile.Close()) return 1;
+  return 0;
+}
+
+int CheckReport::WriteCsv(std::string const& fname) const {
+  TextFile outfile;
+  if (outfile.OpenWrite( fname )) return 1;
+  outfile.Printf("run,replica,output,traj,expected,actual,restart_time,status,cached,"
+                 "check_time,restart_check_time\n");
+  for (std::vector<Record>::const_iterator rec = records_.begin(); rec != records_.end(); ++rec)
+    outfile.Printf("%s,%i,%s,%s,%i,%i,%g,%s,%i,%.6f,%.6f\n",
+                   CsvStr(rec->Run).c_str(), rec->Replica, CsvStr(rec->Output).c_str(),
+                   CsvStr(rec->Traj).c_str(), rec->Expected, rec->Actual, rec->RstTime,
+                   StatusStr[rec->Status], (int)rec->Cached,
+                   rec->CheckTime, rec->RstCheckTime);
+  if (outfile.Close()) return 1;
+  return 0;
+}
+
+int CheckReport::Write(std::string const& fname) const {
+  int err;
+  if (fname.size() > 5 && fname.compare(fname.size() - 5, 5, ".json") == 0)
+    err = WriteJson( fname );
+  else
+    err = WriteCsv( fname );
+  if (err == 0)
+    Msg("  Check report written to '%s'\n", fname.c_str());
+  return err;
+}
@@ -0,0 +1,45 @@
+#ifndef INC_CHECKREPORT_H
+#define INC_CHECKREPORT_H
+#include <string>
+#include <vector>
+/// Machine-readable report of run check results.
+/** One record is kept per run and checked replica. The report is written
+  * as JSON if the file name ends in '.json', CSV otherwise.
+  */
+class CheckReport {
+  public:
+    enum StatusType { OK = 0, SHORT, TRUNCATED, BAD_FRAME, BAD_RESTART, MISSING, MISSING_OUTPUT,
+                      COUNT_MISMATCH, ERROR };
+    /// Hold check result for a single replica.
+    struct Record {
+      std::string Run;    ///< Run directory.
+      int Replica;        ///< Replica index (from 0), -1 if run could not be checked.
+      std::string Output; ///< Output file name (relative to top directory).
+      std::string Traj;   ///< Trajectory file name (relative to top directory).
+      int Expected;       ///< # frames expected from output file.
+      int Actual;         ///< # frames in trajectory.
+      double RstTime;     ///< Restart time, -1 if restart was not read.
+      StatusType Status;  ///< Check status.
+      bool Cached;        ///< True if output/traj result came from check index.
+      double CheckTime;   ///< Time in seconds to check output/traj pair.
+      double RstCheckTime; ///< Time in seconds to read restart.
+    };
+
+    CheckReport() {}
+    /// Add record and \return its index.
+    unsigned int AddRecord(Record const&);
+    Record& operator[](unsigned int idx) { return records_[idx]; }
+    unsigned int Size() const { return (unsigned int)records_.size(); }
+    /// Write report to given file.
+    int Write(std::string const&) const;
+    /// \return wall clock time in seconds.
+    static double WallTime();
+  private:
+    static const char* StatusStr[];
+
+    int WriteJson(std::string const&) const;
+    int WriteCsv(std::string const&) const;
+
+    std::vector<Record> records_;
+};
+#endif
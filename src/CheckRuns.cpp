@@ -1,11 +1,17 @@
 #include <cmath>
 #include <cstdlib>
+#include <cfloat> // DBL_MAX
+#include <algorithm> // std::min
 #ifdef HAS_NETCDF
 # include "netcdf.h"
 #endif
 #include "CheckRuns.h"
 #include "Messages.h"
-#include "TextFile.h"
+#include "MdoutHeader.h"
+#include "CheckCache.h"
+#include "NetcdfHeader.h"
+#include "Rst7File.h"
+#include "CheckReport.h"
 
 #ifdef HAS_NETCDF
 static inline int checkNCerr(int ncerr) {
@@ -62,204 +68,867 @@ static void CompareStrArray(StrArray const& a1, StrArray const& a2) {
     ErrorMsg("Differs at '%s'\n", a2[idx].c_str());
 }
 
-int CheckRuns(std::string const& TopDir, StrArray const& RunDirs, bool firstOnly) {
+/// Hold results of a full scan of a coordinate/velocity variable.
+struct ScanResult {
+  long int NonFinite;  ///< # values that are NaN or Inf.
+  long int Far;        ///< # values far outside the box.
+  long int ZeroBlocks; ///< # blocks of SCAN_ZERO_ATOMS atoms with all values zero.
+};
+
+/// Number of atoms read at once during full scan.
+static const unsigned int SCAN_ATOMS = 8192;
+/// Size in atoms of a zeroed block that indicates corruption.
+static const unsigned int SCAN_ZERO_ATOMS = 16;
+/// Coordinates more than this many box lengths from the origin are considered corrupt.
+static const double SCAN_FAR_BOXES = 100.0;
+
+/** Scan a block of natom XYZ values for NaN/Inf, values outside of the
+  * given limits, and zeroed blocks. If lim is not null it should contain
+  * 3 * natom limits. Loops are kept branch-free so that they can be
+  * vectorized by the compiler.
+  */
+static void ScanBlock(const double* xyz, unsigned int natom, const double* lim,
+                      ScanResult& res)
+{
+  const unsigned int nvals = natom * 3;
+  long int nbad = 0;
+  for (unsigned int i = 0; i < nvals; i++)
+    nbad += !(fabs(xyz[i]) <= DBL_MAX);
+  res.NonFinite += nbad;
+  if (lim != 0) {
+    long int nfar = 0;
+    for (unsigned int i = 0; i < nvals; i++)
+      nfar += (fabs(xyz[i]) > lim[i]);
+    res.Far += nfar;
+  }
+  for (unsigned int a0 = 0; a0 < natom; a0 += SCAN_ZERO_ATOMS) {
+    unsigned int end = std::min(a0 + SCAN_ZERO_ATOMS, natom) * 3;
+    int nonzero = 0;
+    for (unsigned int i = a0 * 3; i < end; i++)
+      nonzero |= (xyz[i] != 0.0);
+    res.ZeroBlocks += (nonzero == 0);
+  }
+}
+
+/** Set up coordinate limits for SCAN_ATOMS atoms from box lengths, none if box is null. */
+static void SetScanLimits(const double* box, std::vector<double>& lim) {
+  lim.clear();
+  if (box == 0) return;
+  lim.resize( SCAN_ATOMS * 3 );
+  for (unsigned int i = 0; i < lim.size(); i += 3)
+    for (unsigned int k = 0; k < 3; k++)
+      lim[i+k] = SCAN_FAR_BOXES * box[k];
+}
+
+/// Hold result of checking a single output/trajectory pair.
+struct RepCheck {
+  int Expected;     ///< # frames expected from output file.
+  int Actual;       ///< # frames actually in trajectory.
+  double TotalTime; ///< Total simulation time expected from output file.
+  int Err;          ///< Non-zero if an error occurred.
+  off_t OutSize;    ///< Output file size.
+  time_t OutMtime;  ///< Output file modification time.
+  off_t TrajSize;   ///< Trajectory file size.
+  time_t TrajMtime; ///< Trajectory file modification time.
+  bool Cached;      ///< True if result came from check index.
+  long int HeaderFrames; ///< # frames according to trajectory header, -1 if unknown.
+  long int SizeFrames;   ///< # complete frames according to file size, -1 if unknown.
+  off_t ExtraBytes;      ///< # bytes in trajectory past the last counted frame.
+  bool Scanned;          ///< True if coordinates of the last frame were scanned.
+  ScanResult LastFrame;  ///< Scan results for coordinates of the last frame.
+  double Time;           ///< Time in seconds taken to check.
+};
+
+/// Hold files to be checked for a single run directory.
+struct RunCheck {
+  std::string Dir;      ///< Run directory name.
+  StrArray OutputFiles; ///< Output file names (full path).
+  StrArray TrajFiles;   ///< Trajectory file names (full path).
+  bool Exists;          ///< True if run directory exists.
+  bool IsMd;            ///< True if MD run, false if REMD.
+  CheckReport::StatusType Status; ///< OK, or why run could not be checked.
+  unsigned int Begin;   ///< Index of first replica check in RepCheck array.
+  unsigned int Nchecks; ///< Number of replica checks for this run.
+};
+
+/** Determine how many frames should be written according to the given
+  * output file.
+  */
+static int ExpectedFrames(std::string const& fname, RepCheck& rep) {
+  MdoutHeader mdout;
+  if (mdout.Read( fname )) return 1;
+  if (mdout.Ntwx() < 1) {
+    ErrorMsg("Could not determine ntwx from '%s'\n", fname.c_str());
+    return 1;
+  }
+  int numexchg = mdout.Numexchg();
+  if (numexchg == 0) numexchg = 1;
+  rep.TotalTime = ((double)mdout.Nstlim() * mdout.Dt()) * (double)numexchg;
+  rep.Expected = (mdout.Nstlim() * numexchg) / mdout.Ntwx();
+  return 0;
+}
+
+/** \return Non-zero if given file is not NetCDF, or if its format (CDF5,
+  * NetCDF4/HDF5) cannot be read natively and this was compiled without the
+  * NetCDF library.
+  */
+static inline int CheckNeedsLibrary(NetcdfHeader const& nc) {
+  if (nc.Format() == NetcdfHeader::UNKNOWN_FMT) {
+    ErrorMsg("'%s' is not a recognized NetCDF file.\n", nc.Filename().c_str());
+    return 1;
+  }
+# ifndef HAS_NETCDF
+  if (nc.Format() == NetcdfHeader::CDF5) {
+    ErrorMsg("'%s' is NetCDF CDF5; compile with NetCDF to read it.\n", nc.Filename().c_str());
+    return 1;
+  }
+  if (nc.Format() == NetcdfHeader::HDF5) {
+    ErrorMsg("'%s' is NetCDF4/HDF5; compile with NetCDF to read it.\n", nc.Filename().c_str());
+    return 1;
+  }
+# endif
+  return 0;
+}
+
+#ifdef HAS_NETCDF
+/** Scan coordinates of the given frame with the NetCDF library. */
+static int ScanFrameNC(int ncid, size_t frame, ScanResult& res) {
+  int natom = 0;
+  int coordVID = -1;
+  if (GetDimInfo(ncid, "atom", natom) < 0 ||
+      checkNCerr(nc_inq_varid(ncid, "coordinates", &coordVID)))
+    return 1;
+  std::vector<double> lim;
+  int cellVID = -1;
+  if ( nc_inq_varid(ncid, "cell_lengths", &cellVID) == NC_NOERR ) {
+    size_t start[2], count[2];
+    start[0] = frame;
+    start[1] = 0;
+    count[0] = 1;
+    count[1] = 3;
+    double box[3];
+    if ( checkNCerr(nc_get_vara_double(ncid, cellVID, start, count, box)) ) return 1;
+    SetScanLimits( box, lim );
+  }
+  std::vector<double> buf( SCAN_ATOMS * 3 );
+  const double* limPtr = (lim.empty() ? 0 : &lim[0]);
+  size_t start[3], count[3];
+  start[0] = frame;
+  start[2] = 0;
+  count[0] = 1;
+  count[2] = 3;
+  for (long int a0 = 0; a0 < natom; a0 += SCAN_ATOMS) {
+    start[1] = (size_t)a0;
+    count[1] = (size_t)std::min((long int)SCAN_ATOMS, natom - a0);
+    if ( checkNCerr(nc_get_vara_double(ncid, coordVID, start, count, &buf[0])) ) return 1;
+    ScanBlock( &buf[0], (unsigned int)count[1], limPtr, res );
+  }
+  return 0;
+}
+
+/** Get actual number of frames with the NetCDF library. If deep is true,
+  * coordinates of the last frame are scanned as well.
+  */
+static int ActualFramesNC(std::string const& tname, RepCheck& rep, bool deep) {
+  int ncid = -1;
+  if ( checkNCerr(nc_open(tname.c_str(), NC_NOWRITE, &ncid)) ) return 1;
+  int dimID, unlimID;
+  size_t slength = 0;
+  int err = 0;
+  if ( checkNCerr(nc_inq_dimid(ncid, "frame", &dimID))  ||
+       checkNCerr(nc_inq_unlimdim(ncid, &unlimID))      ||
+       checkNCerr(nc_inq_dimlen(ncid, dimID, &slength)) )
+    err = 1;
+  else if (dimID != unlimID) {
+    ErrorMsg("'frame' is not the record dimension in '%s'\n", tname.c_str());
+    err = 1;
+  }
+  if (err == 0 && deep && slength > 0) {
+    err = ScanFrameNC( ncid, slength - 1, rep.LastFrame );
+    rep.Scanned = (err == 0);
+  }
+  nc_close( ncid );
+  rep.Actual = (int)slength;
+  return err;
+}
+#endif
+
+/** Scan coordinates of the given frame of a natively read trajectory. */
+static int ScanFrameNative(NetcdfHeader& nc, long int frame, ScanResult& res) {
+  long int natom = nc.DimLength("atom");
+  if (natom < 0) {
+    ErrorMsg("Getting atom dimension from '%s'\n", nc.Filename().c_str());
+    return 1;
+  }
+  std::vector<double> lim;
+  if (nc.HasVar("cell_lengths")) {
+    double box[3];
+    if (nc.GetRecordDouble("cell_lengths", frame, 0, 3, box)) return 1;
+    SetScanLimits( box, lim );
+  }
+  std::vector<double> buf( SCAN_ATOMS * 3 );
+  const double* limPtr = (lim.empty() ? 0 : &lim[0]);
+  for (long int a0 = 0; a0 < natom; a0 += SCAN_ATOMS) {
+    unsigned int nread = (unsigned int)std::min((long int)SCAN_ATOMS, natom - a0);
+    if (nc.GetRecordDouble("coordinates", frame, (unsigned int)a0 * 3, nread * 3, &buf[0]))
+      return 1;
+    ScanBlock( &buf[0], nread, limPtr, res );
+  }
+  return 0;
+}
+
+/** Get actual number of frames from NetCDF trajectory. Classic/64-bit
+  * offset files are read natively; only the header is read. The number of
+  * complete frames is also determined from the trajectory size (rep.TrajSize)
+  * so that a partially written or truncated last frame can be detected
+  * without reading any frame data. If deep is true, coordinates of the last
+  * complete frame are also scanned, since a frame that was allocated but
+  * never written (e.g. zero-filled) cannot be detected from size alone.
+  * Other NetCDF formats (CDF5, HDF5) require the NetCDF library.
+  */
+static int ActualFrames(std::string const& tname, RepCheck& rep, bool deep) {
+  NetcdfHeader nc;
+  if (nc.Open( tname )) return 1;
+  if (CheckNeedsLibrary( nc )) return 1;
+  if (nc.Format() == NetcdfHeader::CDF1 || nc.Format() == NetcdfHeader::CDF2) {
+    // Frames are records, so 'frame' must be the record dimension.
+    NetcdfHeader::Dim const* frameDim = nc.FindDim("frame");
+    if (frameDim == 0) {
+      ErrorMsg("No 'frame' dimension in '%s'\n", tname.c_str());
+      return 1;
+    }
+    if (frameDim->Length != 0) {
+      ErrorMsg("'frame' is not the record dimension in '%s'\n", tname.c_str());
+      return 1;
+    }
+    bool hasSize = (nc.RecSize() > 0 && rep.TrajSize >= nc.RecBegin());
+    if (hasSize)
+      rep.SizeFrames = (long int)((rep.TrajSize - nc.RecBegin()) / nc.RecSize());
+    long int nframes;
+    if (nc.Nrecs() < 0) {
+      // Streaming file; # records is not in the header so rely on size alone.
+      if (!hasSize) {
+        ErrorMsg("Could not determine number of frames in streaming file '%s'\n",
+                 tname.c_str());
+        return 1;
+      }
+      nframes = rep.SizeFrames;
+    } else {
+      rep.HeaderFrames = nc.Nrecs();
+      nframes = rep.HeaderFrames;
+      if (hasSize && rep.SizeFrames < nframes)
+        nframes = rep.SizeFrames;
+    }
+    if (hasSize)
+      rep.ExtraBytes = rep.TrajSize - (nc.RecBegin() + (off_t)nframes * nc.RecSize());
+    rep.Actual = (int)nframes;
+    if (deep && nframes > 0) {
+      if (ScanFrameNative( nc, nframes - 1, rep.LastFrame )) return 1;
+      rep.Scanned = true;
+    }
+    return 0;
+  }
+  nc.Close();
+  int err = 1;
+# ifdef HAS_NETCDF
+  // The NetCDF library is not thread-safe.
+# ifdef _OPENMP
+# pragma omp critical(netcdf)
+# endif
+  err = ActualFramesNC( tname, rep, deep );
+# endif
+  return err;
+}
+
+/** \return true if scan found signs of corruption. */
+static inline bool ScanBad(ScanResult const& res) {
+  return (res.NonFinite > 0 || res.Far > 0 || res.ZeroBlocks > 0);
+}
+
+/** \return true if trajectory size does not match its header. */
+static inline bool SizeMismatch(RepCheck const& rep) {
+  return ( (rep.SizeFrames > -1 && rep.SizeFrames < rep.HeaderFrames) || rep.ExtraBytes > 0 );
+}
+
+/** Check the given output/trajectory pair. If a check index is given and
+  * neither file has changed since the last check, the previous result is
+  * used unless deep is true, in which case the last frame is always scanned.
+  * Safe to call from multiple threads.
+  */
+static void CheckReplica(std::string const& fname, std::string const& tname,
+                         CheckCache const* cache, bool deep, RepCheck& rep)
+{
+  double t0 = CheckReport::WallTime();
+  rep.Expected = 0;
+  rep.Actual = -1;
+  rep.TotalTime = 0.0;
+  rep.Cached = false;
+  rep.HeaderFrames = -1;
+  rep.SizeFrames = -1;
+  rep.ExtraBytes = 0;
+  rep.Scanned = false;
+  rep.LastFrame.NonFinite = rep.LastFrame.Far = rep.LastFrame.ZeroBlocks = 0;
+  // Stat before reading so that a file changed during the check is re-read next time.
+  GetFileStat( fname, rep.OutSize, rep.OutMtime );
+  GetFileStat( tname, rep.TrajSize, rep.TrajMtime );
+  if (cache != 0 && !deep) {
+    CheckCache::Entry const* entry = cache->Find( cache->Relative(tname), cache->Relative(fname),
+                                                  rep.TrajSize, rep.TrajMtime,
+                                                  rep.OutSize, rep.OutMtime );
+    if (entry != 0) {
+      rep.Expected = entry->Expected;
+      rep.Actual = entry->Actual;
+      rep.Err = 0;
+      rep.Cached = true;
+      rep.Time = CheckReport::WallTime() - t0;
+      return;
+    }
+  }
+  rep.Err = ExpectedFrames( fname, rep );
+  if (rep.Err == 0)
+    rep.Err = ActualFrames( tname, rep, deep );
+  rep.Time = CheckReport::WallTime() - t0;
+}
+
+/// Hold data read from a restart needed for checking.
+struct RstData {
+  double Time;      ///< Restart time.
+  long int Natom;   ///< Number of atoms.
+  double Coords[6]; ///< First 2 coordinates.
+  double Box[3];    ///< Box lengths.
+  bool HasBox;      ///< True if box lengths present.
+  bool HasVel;      ///< True if velocities were scanned.
+  ScanResult Xscan; ///< Full coordinate scan results.
+  ScanResult Vscan; ///< Full velocity scan results.
+  int Err;          ///< Non-zero if an error occurred reading restart.
+  double ReadTime;  ///< Time in seconds taken to read restart.
+};
+
+/** Scan all atoms of the given variable in natively read restart file. */
+template <class T> static int ScanVarNative(T& nc, const char* vname, long int natom,
+                                            std::vector<double> const& lim, ScanResult& res)
+{
+  std::vector<double> buf( SCAN_ATOMS * 3 );
+  const double* limPtr = (lim.empty() ? 0 : &lim[0]);
+  for (long int a0 = 0; a0 < natom; a0 += SCAN_ATOMS) {
+    unsigned int nread = (unsigned int)std::min((long int)SCAN_ATOMS, natom - a0);
+    if (nc.GetVarDouble(vname, (unsigned int)a0 * 3, nread * 3, &buf[0])) return 1;
+    ScanBlock( &buf[0], nread, limPtr, res );
+  }
+  return 0;
+}
+
 #ifdef HAS_NETCDF
+/** Scan all atoms of the given variable with the NetCDF library. */
+static int ScanVarNC(int ncid, int varid, long int natom, std::vector<double> const& lim,
+                     ScanResult& res)
+{
+  std::vector<double> buf( SCAN_ATOMS * 3 );
+  const double* limPtr = (lim.empty() ? 0 : &lim[0]);
+  size_t start[2], count[2];
+  start[1] = 0;
+  count[1] = 3;
+  for (long int a0 = 0; a0 < natom; a0 += SCAN_ATOMS) {
+    start[0] = (size_t)a0;
+    count[0] = (size_t)std::min((long int)SCAN_ATOMS, natom - a0);
+    if ( checkNCerr(nc_get_vara_double(ncid, varid, start, count, &buf[0])) ) return 1;
+    ScanBlock( &buf[0], (unsigned int)count[0], limPtr, res );
+  }
+  return 0;
+}
+
+/** Read restart data with the NetCDF library. */
+static int ReadRestartNC(std::string const& rname, RstData& rst, bool deep) {
+  int ncid = -1, timeVID = -1;
+  if ( checkNCerr(nc_open(rname.c_str(), NC_NOWRITE, &ncid)) ) return 1;
+  int err = 1;
+  int natom = 0;
+  if ( !checkNCerr(nc_inq_varid(ncid, "time", &timeVID)) &&
+       !checkNCerr(nc_get_var_double(ncid, timeVID, &rst.Time)) &&
+       GetDimInfo(ncid, "atom", natom) > -1 )
+  {
+    err = 0;
+    rst.Natom = natom;
+    int coordVID = -1;
+    if ( natom > 0 && checkNCerr(nc_inq_varid(ncid, "coordinates", &coordVID)) )
+      err = 1;
+    if (err == 0 && natom > 1) {
+      size_t start[2], count[2];
+      start[0] = 0;
+      start[1] = 0;
+      count[0] = 2; // Only 2 atoms
+      count[1] = 3;
+      if ( checkNCerr(nc_get_vara_double(ncid, coordVID, start, count, rst.Coords)) )
+        err = 1;
+      // Get box info if present
+      int cellVID = -1;
+      if ( err == 0 && nc_inq_varid(ncid, "cell_lengths", &cellVID) == NC_NOERR ) {
+        rst.HasBox = true;
+        count[0] = 3;
+        count[1] = 0;
+        if ( checkNCerr(nc_get_vara_double(ncid, cellVID, start, count, rst.Box)) )
+          err = 1;
+      }
+    }
+    if (err == 0 && deep && natom > 0) {
+      std::vector<double> lim;
+      SetScanLimits( (rst.HasBox ? rst.Box : 0), lim );
+      err = ScanVarNC( ncid, coordVID, natom, lim, rst.Xscan );
+      int velVID = -1;
+      if ( err == 0 && nc_inq_varid(ncid, "velocities", &velVID) == NC_NOERR ) {
+        rst.HasVel = true;
+        err = ScanVarNC( ncid, velVID, natom, std::vector<double>(), rst.Vscan );
+      }
+    }
+  }
+  nc_close( ncid );
+  return err;
+}
+#endif
+
+/** Read time, first 2 coordinates, and box from a natively read restart.
+  * If deep is true, all coordinates and velocities are scanned as well.
+  * T is NetcdfHeader (classic/64-bit offset NetCDF) or Rst7File (ASCII).
+  */
+template <class T> static int ReadRestartNative(T& nc, RstData& rst, bool deep) {
+  if (nc.GetVarDouble("time", 0, 1, &rst.Time)) return 1;
+  rst.Natom = nc.DimLength("atom");
+  if (rst.Natom < 0) {
+    ErrorMsg("Getting atom dimension from '%s'\n", nc.Filename().c_str());
+    return 1;
+  }
+  if (rst.Natom > 1) {
+    if (nc.GetVarDouble("coordinates", 0, 6, rst.Coords)) return 1;
+    if (nc.HasVar("cell_lengths")) {
+      rst.HasBox = true;
+      if (nc.GetVarDouble("cell_lengths", 0, 3, rst.Box)) return 1;
+    }
+  }
+  if (deep && rst.Natom > 0) {
+    std::vector<double> lim;
+    SetScanLimits( (rst.HasBox ? rst.Box : 0), lim );
+    if (ScanVarNative( nc, "coordinates", rst.Natom, lim, rst.Xscan )) return 1;
+    if (nc.HasVar("velocities")) {
+      rst.HasVel = true;
+      if (ScanVarNative( nc, "velocities", rst.Natom, std::vector<double>(), rst.Vscan ))
+        return 1;
+    }
+  }
+  return 0;
+}
+
+/** Read time, first 2 coordinates, and box from restart. If deep is true,
+  * all coordinates and velocities are scanned as well. Classic/64-bit
+  * offset NetCDF and ASCII restarts are read natively. Other NetCDF formats
+  * require the NetCDF library. Safe to call from multiple threads.
+  */
+static int ReadRestart(std::string const& rname, RstData& rst, bool deep) {
+  rst.Time = -1.0;
+  rst.Natom = 0;
+  rst.HasBox = false;
+  rst.HasVel = false;
+  rst.Xscan.NonFinite = rst.Xscan.Far = rst.Xscan.ZeroBlocks = 0;
+  rst.Vscan = rst.Xscan;
+  NetcdfHeader nc;
+  if (nc.Open( rname )) return 1;
+  if (nc.Format() == NetcdfHeader::UNKNOWN_FMT) {
+    // Not NetCDF; try ASCII.
+    nc.Close();
+    Rst7File rst7;
+    if (rst7.Open( rname )) return 1;
+    return ReadRestartNative( rst7, rst, deep );
+  }
+  if (CheckNeedsLibrary( nc )) return 1;
+  if (nc.Format() == NetcdfHeader::CDF1 || nc.Format() == NetcdfHeader::CDF2)
+    return ReadRestartNative( nc, rst, deep );
+  nc.Close();
+  int err = 1;
+# ifdef HAS_NETCDF
+  // The NetCDF library is not thread-safe.
+# ifdef _OPENMP
+# pragma omp critical(netcdf)
+# endif
+  err = ReadRestartNC( rname, rst, deep );
+# endif
+  return err;
+}
+
+/** Report results of a full restart variable scan. Blocks of all-zero values
+  * are only an error if zeroIsBad is true; zero velocities are legitimate
+  * for e.g. frozen (belly) atoms. \return 1 if corruption found.
+  */
+static int CheckScan(ScanResult const& res, const char* desc, std::string const& rname,
+                     bool zeroIsBad) {
+  int err = 0;
+  if (res.NonFinite > 0) {
+    ErrorMsg("%li %s values in restart '%s' are NaN/Inf.\n", res.NonFinite, desc, rname.c_str());
+    err = 1;
+  }
+  if (res.Far > 0) {
+    ErrorMsg("%li %s values in restart '%s' are > %g box lengths from origin.\n",
+             res.Far, desc, rname.c_str(), SCAN_FAR_BOXES);
+    err = 1;
+  }
+  if (res.ZeroBlocks > 0 && zeroIsBad) {
+    ErrorMsg("%li blocks of %u atoms in restart '%s' have all %s values zero.\n",
+             res.ZeroBlocks, SCAN_ZERO_ATOMS, rname.c_str(), desc);
+    err = 1;
+  }
+  if (err != 0)
+    ErrorMsg("Probable corruption.\n");
+  return err;
+}
+
+/** Check that the first two coordinates in restart do not overlap and
+  * that their distance is not larger than the box.
+  */
+static int CheckFirstTwo(RstData const& rst, std::string const& rname) {
+  if (rst.Natom < 2) return 0;
+  // Calculate distance
+  double dx = rst.Coords[0] - rst.Coords[3];
+  double dy = rst.Coords[1] - rst.Coords[4];
+  double dz = rst.Coords[2] - rst.Coords[5];
+  double dist2 = (dx * dx) + (dy * dy) + (dz * dz);
+  if (dist2 < 0.1) {
+    ErrorMsg("First two coordinates in restart '%s' overlap. Probable corruption.\n",
+              rname.c_str());
+    return 1;
+  }
+  if (rst.HasBox) {
+    // Calc max distance allowed by box
+    double box2 = (rst.Box[0]*rst.Box[0]) + (rst.Box[1]*rst.Box[1]) + (rst.Box[2]*rst.Box[2]);
+    if (dist2 > box2) {
+      ErrorMsg("First two coordinates distance > box size in restart '%s'."
+               " Probable corruption.\n", rname.c_str());
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/** Check the given run directories. The output and trajectory files for all
+  * runs are determined first. Every output/trajectory pair across all runs
+  * is then checked independently (in parallel if OpenMP is enabled), after
+  * which results are reported for each run in order. No change of the
+  * current working directory is performed. If useCache is true, results
+  * are stored in an index in TopDir and files that have not changed since
+  * the last check are not re-read. Restarts are checked when trajectories
+  * are short; if deepRst is true, all restarts are always checked and every
+  * coordinate/velocity in them, as well as every coordinate in the last
+  * frame of each checked trajectory, is scanned for signs of corruption. A
+  * record for each checked replica is added to the report. A run that
+  * cannot be checked gets a single record with the reason, and checking
+  * continues with the next run; \return 1 if any errors were found.
+  */
+static int CheckAllRuns(std::string const& TopDir, StrArray const& RunDirs, bool firstOnly,
+                        bool useCache, bool deepRst, CheckReport& report)
+{
   if (firstOnly)
     Msg("Checking only first output/traj for all runs.\n");
   else
     Msg("Checking all output/traj for all runs.\n");
   int debug = 0;
   int Nwarnings = 0;
+  int Nerrors = 0;
+  CheckCache cache;
+  if (useCache) {
+    if (cache.Load( TopDir )) return 1;
+  }
+  // Determine which files need to be checked for each run.
+  std::vector<RunCheck> Runs;
+  Runs.reserve( RunDirs.size() );
+  unsigned int Ntotal = 0;
   for (StrArray::const_iterator rdir = RunDirs.begin(); rdir != RunDirs.end(); ++rdir) {
-    if (ChangeDir( TopDir )) return 1;
-    if (!fileExists( *rdir ))
-      Msg("Warning: '%s' does not exist.\n", rdir->c_str());
-    else {
-      Msg("  %s:", rdir->c_str());
-      ChangeDir( *rdir );
-      bool is_md = false;
-      // Determine where the output file(s) are.
-      StrArray output_files = ExpandToFilenames("OUTPUT/rem.out.*");
-      if (output_files.empty()) {
-        output_files = ExpandToFilenames("md.out.*");
-        is_md = true;
-      }
-      Msg(" %zu output files.\n", output_files.size());
-      if (output_files.empty()) {
-        ErrorMsg("Output files not found.\n");
-        return 1;
+    Runs.push_back( RunCheck() );
+    RunCheck& RC = Runs.back();
+    RC.Dir = *rdir;
+    RC.IsMd = false;
+    RC.Begin = Ntotal;
+    RC.Nchecks = 0;
+    RC.Status = CheckReport::OK;
+    std::string runPath( TopDir + "/" + *rdir );
+    RC.Exists = fileExists( runPath );
+    if (!RC.Exists) continue;
+    // Determine where the output file(s) are.
+    RC.OutputFiles = ExpandToFilenames(runPath + "/OUTPUT/rem.out.*");
+    if (RC.OutputFiles.empty()) {
+      RC.OutputFiles = ExpandToFilenames(runPath + "/md.out.*");
+      RC.IsMd = true;
+    }
+    if (RC.OutputFiles.empty()) {
+      ErrorMsg("%s: Output files not found.\n", rdir->c_str());
+      RC.Status = CheckReport::MISSING_OUTPUT;
+      continue;
+    }
+    // Determine where the trajectory files are.
+    if (!RC.IsMd)
+      RC.TrajFiles = ExpandToFilenames(runPath + "/TRAJ/rem.crd.*");
+    else
+      RC.TrajFiles = ExpandToFilenames(runPath + "/md.nc.*");
+    if (RC.TrajFiles.size() != RC.OutputFiles.size()) {
+      ErrorMsg("%s: Number of output files %zu != # of traj files %zu.\n", rdir->c_str(),
+               RC.OutputFiles.size(), RC.TrajFiles.size());
+      CompareStrArray( RC.OutputFiles, RC.TrajFiles );
+      RC.Status = CheckReport::COUNT_MISMATCH;
+      continue;
+    }
+    if (firstOnly)
+      RC.Nchecks = 1;
+    else
+      RC.Nchecks = RC.OutputFiles.size();
+    Ntotal += RC.Nchecks;
+  }
+  // Set up a flat list of all output/trajectory pairs to check.
+  std::vector<const std::string*> Onames, Tnames;
+  Onames.reserve( Ntotal );
+  Tnames.reserve( Ntotal );
+  for (std::vector<RunCheck>::const_iterator RC = Runs.begin(); RC != Runs.end(); ++RC)
+    for (unsigned int idx = 0; idx != RC->Nchecks; idx++) {
+      Onames.push_back( &(RC->OutputFiles[idx]) );
+      Tnames.push_back( &(RC->TrajFiles[idx]) );
+    }
+  // Check all output/trajectory pairs. Results are stored by index so that
+  // they can be reported in order.
+  std::vector<RepCheck> Reps( Ntotal );
+  int nchecks = (int)Ntotal;
+  int idx;
+# ifdef _OPENMP
+# pragma omp parallel for schedule(dynamic)
+# endif
+  for (idx = 0; idx < nchecks; idx++)
+    CheckReplica( *(Onames[idx]), *(Tnames[idx]), (useCache ? &cache : 0), deepRst, Reps[idx] );
+  // Update the check index with new results.
+  if (useCache) {
+    unsigned int Ncached = 0;
+    for (unsigned int ridx = 0; ridx != Ntotal; ridx++) {
+      RepCheck const& rep = Reps[ridx];
+      if (rep.Cached)
+        ++Ncached;
+      else if (rep.Err == 0 && !SizeMismatch(rep) && !(rep.Scanned && ScanBad(rep.LastFrame))) {
+        CheckCache::Entry entry;
+        entry.Output = cache.Relative( *(Onames[ridx]) );
+        entry.TrajSize = rep.TrajSize;
+        entry.TrajMtime = rep.TrajMtime;
+        entry.OutSize = rep.OutSize;
+        entry.OutMtime = rep.OutMtime;
+        entry.Expected = rep.Expected;
+        entry.Actual = rep.Actual;
+        cache.Update( cache.Relative( *(Tnames[ridx]) ), entry );
       }
-      // Determine where the trajectory files are.
-      StrArray traj_files;
-      if (!is_md)
-        traj_files = ExpandToFilenames("TRAJ/rem.crd.*");
+    }
+    if (cache.Write()) return 1;
+    Msg("  %u of %u output/traj pairs unchanged since last check.\n", Ncached, Ntotal);
+  }
+  // Report results for each run.
+  for (std::vector<RunCheck>::const_iterator RC = Runs.begin(); RC != Runs.end(); ++RC) {
+    CheckReport::Record rec;
+    rec.Run = RC->Dir;
+    rec.Replica = -1;
+    rec.Expected = 0;
+    rec.Actual = -1;
+    rec.RstTime = -1.0;
+    rec.Cached = false;
+    rec.CheckTime = 0.0;
+    rec.RstCheckTime = 0.0;
+    if (!RC->Exists) {
+      Msg("Warning: '%s' does not exist.\n", RC->Dir.c_str());
+      rec.Status = CheckReport::MISSING;
+      report.AddRecord( rec );
+      continue;
+    }
+    if (RC->Status != CheckReport::OK) {
+      ++Nerrors;
+      rec.Status = RC->Status;
+      report.AddRecord( rec );
+      continue;
+    }
+    // Add report records for all checked replicas in this run.
+    unsigned int recBegin = report.Size();
+    for (unsigned int ridx = 0; ridx != RC->Nchecks; ridx++)
+    {
+      RepCheck const& rep = Reps[RC->Begin + ridx];
+      rec.Replica = (int)ridx;
+      rec.Output = RC->OutputFiles[ridx].substr( TopDir.size() + 1 );
+      rec.Traj = RC->TrajFiles[ridx].substr( TopDir.size() + 1 );
+      rec.Expected = rep.Expected;
+      rec.Actual = rep.Actual;
+      rec.Cached = rep.Cached;
+      rec.CheckTime = rep.Time;
+      if (rep.Err != 0)
+        rec.Status = CheckReport::ERROR;
+      else if (rep.Scanned && ScanBad( rep.LastFrame ))
+        rec.Status = CheckReport::BAD_FRAME;
+      else if (SizeMismatch( rep ))
+        rec.Status = CheckReport::TRUNCATED;
+      else if (rep.Expected != rep.Actual)
+        rec.Status = CheckReport::SHORT;
       else
-        traj_files = ExpandToFilenames("md.nc.*");
-      if (traj_files.size() != output_files.size()) {
-        ErrorMsg("Number of output files %zu != # of traj files %zu.\n",
-                 output_files.size(), traj_files.size());
-        CompareStrArray( output_files, traj_files );
-        return 1;
+        rec.Status = CheckReport::OK;
+      report.AddRecord( rec );
+    }
+    Msg("  %s: %zu output files.\n", RC->Dir.c_str(), RC->OutputFiles.size());
+    int badFrameCount = -1;
+    int numBadFrameCount = 0;
+    int numScanned = 0;
+    int numBadScan = 0;
+    bool check_restarts = false;
+    for (unsigned int ridx = 0; ridx != RC->Nchecks; ridx++)
+    {
+      RepCheck const& rep = Reps[RC->Begin + ridx];
+      if (debug > 0) Msg("    '%s'\n", RC->OutputFiles[ridx].c_str());
+      if (rep.Err != 0) {
+        ErrorMsg("Checking '%s' failed.\n", RC->TrajFiles[ridx].c_str());
+        ++Nerrors;
+        continue;
       }
-      // Loop over output and trajectory files.
-      int badFrameCount = -1;
-      int numBadFrameCount = 0;
-      bool check_restarts = false;
-      StrArray::const_iterator tname = traj_files.begin();
-      for (StrArray::const_iterator fname = output_files.begin();
-                                    fname != output_files.end();
-                                  ++fname, ++tname)
-      {
-        if (debug > 0) Msg("    '%s'\n", fname->c_str());
-        // Determine how many frames should be written by the output file.
-        TextFile mdout;
-        if (mdout.OpenRead( *fname )) return 1;
-        int readInput = 0;
-        int nstlim = 0;
-        double dt = 0;
-        int numexchg = 0;
-        int ntwx = 0;
-        int expectedFrames = 0;
-        const char* SEP = " ,=";
-        int ncols = mdout.GetColumns(SEP);
-        while (ncols > -1) {
-          if (readInput == 0 && ncols > 2) {
-            if (mdout.Token(0) == "2." && mdout.Token(1) == "CONTROL")
-              readInput = 1;
-          } else if (readInput == 1 && ncols > 1) {
-            if (mdout.Token(0) == "3." && mdout.Token(1) == "ATOMIC")
-              break;
-            for (int col = 0; col != ncols - 1; col++) {
-              if (mdout.Token(col) == "nstlim")
-                nstlim = atoi( mdout.Token(col+1).c_str() );
-              else if (mdout.Token(col) == "dt")
-                dt = atof( mdout.Token(col+1).c_str() );
-              else if (mdout.Token(col) == "numexchg")
-                numexchg = atoi( mdout.Token(col+1).c_str() );
-              else if (mdout.Token(col) == "ntwx")
-                ntwx = atoi( mdout.Token(col+1).c_str() );
-            }
-          }
-          ncols = mdout.GetColumns(SEP);
-        }
-        mdout.Close();
-        //Msg("\tnstlim= %i\n", nstlim);
-        //Msg("\tdt= %g\n", dt);
-        //Msg("\tnumexchg= %i\n", numexchg);
-        //Msg("\tntwx= %i\n", ntwx);
-        if (numexchg == 0) numexchg = 1;
-        double totalTime = ((double)nstlim * dt) * (double)numexchg;
-        expectedFrames = (nstlim * numexchg) / ntwx;
-        if (debug > 0) {
-          Msg("\tTotal time: %g ps\n", totalTime);
-          Msg("\tFrames: %i\n", expectedFrames);
-        }
-        // Get actual number of frames from NetCDF file.
-        int ncid = -1;
-        if ( checkNCerr(nc_open(tname->c_str(), NC_NOWRITE, &ncid)) ) return 1;
-        int dimID;
-        size_t slength = 0;
-        if ( checkNCerr(nc_inq_dimid(ncid, "frame", &dimID))  ) return 1;
-        if ( checkNCerr(nc_inq_dimlen(ncid, dimID, &slength)) ) return 1;
-        int actualFrames = (int)slength;
-        nc_close( ncid );
-        if (debug > 0) Msg("\tActual Frames: %i\n", actualFrames);
-        // If run did not complete, check restart files if replica.
-        if (expectedFrames != actualFrames) {
-          ++numBadFrameCount;
+      // Check that the last frame was fully written.
+      if (rep.Scanned) {
+        ++numScanned;
+        ScanResult const& res = rep.LastFrame;
+        if (ScanBad( res )) {
+          ++numBadScan;
           ++Nwarnings;
-          if (badFrameCount != actualFrames) { // To avoid repeated checkall warnings
-            Msg("Warning: # actual frames %i != # expected frames %i.\n",
-                actualFrames, expectedFrames);
-            badFrameCount = actualFrames;
-          }
-          if (!is_md) check_restarts = true;
-        } else {
-          if (debug > 0) Msg("\tOK.\n");
+          Msg("Warning: Last frame of '%s' is probably corrupt: %li coordinates NaN/Inf,"
+              " %li > %g box lengths from origin, %li blocks of %u atoms all zero.\n",
+              RC->TrajFiles[ridx].c_str() + TopDir.size() + 1, res.NonFinite, res.Far,
+              SCAN_FAR_BOXES, res.ZeroBlocks, SCAN_ZERO_ATOMS);
         }
-        if (firstOnly) break;
-      } // END loop over output files for run
-      if (numBadFrameCount > 0)
-        Msg("Warning: Frame count did not match for %i replicas.\n", numBadFrameCount);
-      if (check_restarts) {
-        StrArray restart_files = ExpandToFilenames("RST/*.rst7");
-        if (restart_files.empty())
-          restart_files = ExpandToFilenames("RST/*.ncrst");
-        if (restart_files.size() != output_files.size()) {
-          ErrorMsg("Number of restart files %zu != # output files %zu\n",
-                   restart_files.size(), output_files.size());
-          CompareStrArray( restart_files, output_files );
-          return 1;
+      }
+      if (debug > 0) {
+        if (!rep.Cached) Msg("\tTotal time: %g ps\n", rep.TotalTime);
+        Msg("\tFrames: %i\n", rep.Expected);
+        Msg("\tActual Frames: %i\n", rep.Actual);
+      }
+      // Check that trajectory size is consistent with its header.
+      if (SizeMismatch( rep )) {
+        ++Nwarnings;
+        // Report name relative to TopDir
+        const char* tname = RC->TrajFiles[ridx].c_str() + TopDir.size() + 1;
+        if (rep.SizeFrames > -1 && rep.SizeFrames < rep.HeaderFrames)
+          Msg("Warning: '%s' is truncated; only %li of %li frames are complete.\n",
+              tname, rep.SizeFrames, rep.HeaderFrames);
+        if (rep.ExtraBytes > 0)
+          Msg("Warning: '%s' has %li bytes past the last frame (partial frame).\n",
+              tname, (long int)rep.ExtraBytes);
+      }
+      // If run did not complete, check restart files if replica.
+      if (rep.Expected != rep.Actual) {
+        ++numBadFrameCount;
+        ++Nwarnings;
+        if (badFrameCount != rep.Actual) { // To avoid repeated checkall warnings
+          Msg("Warning: # actual frames %i != # expected frames %i.\n",
+              rep.Actual, rep.Expected);
+          badFrameCount = rep.Actual;
         }
-        double rst_time0 = 0.0;
-        for (StrArray::const_iterator rfile = restart_files.begin();
-                                      rfile != restart_files.end(); ++rfile)
-        {
-          int ncid = -1, timeVID = -1;
-          double rsttime = -1.0;
-          if ( checkNCerr(nc_open(rfile->c_str(), NC_NOWRITE, &ncid)) ) return 1; // TODO Ascii
-          if ( checkNCerr(nc_inq_varid(ncid, "time", &timeVID)      ) ) return 1;
-          if ( checkNCerr(nc_get_var_double(ncid, timeVID, &rsttime)) ) return 1;
-          if (rfile == restart_files.begin()) {
-            rst_time0 = rsttime;
+        if (!RC->IsMd) check_restarts = true;
+      } else {
+        if (debug > 0) Msg("\tOK.\n");
+      }
+    } // END loop over output files for run
+    if (numBadFrameCount > 0)
+      Msg("Warning: Frame count did not match for %i replicas.\n", numBadFrameCount);
+    if (numScanned > 0 && numBadScan == 0)
+      Msg("\tAll atoms in last frame of %i trajectories OK.\n", numScanned);
+    if (deepRst && !RC->IsMd) check_restarts = true;
+    if (check_restarts) {
+      std::string runPath( TopDir + "/" + RC->Dir );
+      StrArray restart_files = ExpandToFilenames(runPath + "/RST/*.rst7");
+      if (restart_files.empty())
+        restart_files = ExpandToFilenames(runPath + "/RST/*.ncrst");
+      if (restart_files.size() != RC->OutputFiles.size()) {
+        ErrorMsg("Number of restart files %zu != # output files %zu\n",
+                 restart_files.size(), RC->OutputFiles.size());
+        CompareStrArray( restart_files, RC->OutputFiles );
+        ++Nerrors;
+        for (unsigned int ridx = 0; ridx != RC->Nchecks; ridx++)
+          if (report[recBegin + ridx].Status != CheckReport::ERROR)
+            report[recBegin + ridx].Status = CheckReport::BAD_RESTART;
+        continue;
+      }
+      // Read all restarts (in parallel if OpenMP is enabled), then report in order.
+      std::vector<RstData> Rsts( restart_files.size() );
+      int nrst = (int)restart_files.size();
+      int ridx;
+#     ifdef _OPENMP
+#     pragma omp parallel for schedule(dynamic)
+#     endif
+      for (ridx = 0; ridx < nrst; ridx++)
+      {
+        double t0 = CheckReport::WallTime();
+        Rsts[ridx].Err = ReadRestart( restart_files[ridx], Rsts[ridx], deepRst );
+        Rsts[ridx].ReadTime = CheckReport::WallTime() - t0;
+      }
+      for (ridx = 0; ridx < nrst && (unsigned int)ridx < RC->Nchecks; ridx++) {
+        report[recBegin + ridx].RstCheckTime = Rsts[ridx].ReadTime;
+        if (Rsts[ridx].Err == 0) report[recBegin + ridx].RstTime = Rsts[ridx].Time;
+      }
+      double rst_time0 = 0.0;
+      bool hasTime0 = false;
+      int numBadRst = 0;
+      for (ridx = 0; ridx < nrst; ridx++)
+      {
+        RstData const& rst = Rsts[ridx];
+        std::string const& rfile = restart_files[ridx];
+        int rstErr = rst.Err;
+        if (rstErr == 0) {
+          if (!hasTime0) {
+            rst_time0 = rst.Time;
+            hasTime0 = true;
             Msg("\tInitial restart time: %g\n", rst_time0);
-          } else if ( fabs(rst_time0 - rsttime) > 0.00000000000001 ) {
+          } else if ( !(fabs(rst_time0 - rst.Time) <= 0.00000000000001) ) {
             ErrorMsg("File '%s' time %g does not match initial restart time %g\n",
-                     rfile->c_str(), rsttime, rst_time0);
-            return 1;
+                     rfile.c_str(), rst.Time, rst_time0);
+            rstErr = 1;
           }
-          // Check first 2 coordinates
-          int natom;
-          int atomDID = GetDimInfo(ncid, "atom", natom);
-          if (atomDID < 0) return 1;
-          if (natom > 1) {
-            size_t start[2], count[2];
-            int coordVID = -1;
-            if ( checkNCerr(nc_inq_varid(ncid, "coordinates", &coordVID)) ) return 1;
-            start[0] = 0;
-            start[1] = 0;
-            count[0] = 2; // Only 2 atoms
-            count[1] = 3;
-            double Coords[6]; // Hold first 2 coord sets
-            if ( checkNCerr(nc_get_vara_double(ncid, coordVID, start, count, Coords)) )
-              return 1;
-            // Calculate distance
-            double dx = Coords[0] - Coords[3];
-            double dy = Coords[1] - Coords[4];
-            double dz = Coords[2] - Coords[5];
-            double dist2 = (dx * dx) + (dy * dy) + (dz * dz);
-            if (dist2 < 0.1) {
-              ErrorMsg("First two coordinates in restart '%s' overlap. Probable corruption.\n",
-                        rfile->c_str());
-              return 1;
-            }
-            // Get box info if present
-            int cellVID = -1;
-            if ( nc_inq_varid(ncid, "cell_lengths", &cellVID) == NC_NOERR ) {
-              count[0] = 3;
-              count[1] = 0;
-              if ( checkNCerr(nc_get_vara_double(ncid, cellVID, start, count, Coords)) )
-                return 1;
-              // Calc max distance allowed by box
-              double box2 = (Coords[0]*Coords[0]) + (Coords[1]*Coords[1]) + (Coords[2]*Coords[2]);
-              if (dist2 > box2) {
-                ErrorMsg("First two coordinates distance > box size in restart '%s'."
-                         " Probable corruption.\n", rfile->c_str());
-                return 1;
-              }
+        }
+        // Check first 2 coordinates
+        if (rstErr == 0) rstErr = CheckFirstTwo( rst, rfile );
+        if (rstErr == 0 && deepRst) {
+          rstErr = CheckScan( rst.Xscan, "coordinate", rfile, true );
+          if (rstErr == 0 && rst.HasVel) {
+            rstErr = CheckScan( rst.Vscan, "velocity", rfile, false );
+            if (rstErr == 0 && rst.Vscan.ZeroBlocks > 0) {
+              ++Nwarnings;
+              Msg("Warning: %li blocks of %u atoms in restart '%s' have all velocities"
+                  " zero (frozen atoms?).\n", rst.Vscan.ZeroBlocks, SCAN_ZERO_ATOMS,
+                  rfile.c_str() + TopDir.size() + 1);
             }
           }
-          nc_close( ncid );
+        }
+        if (rstErr != 0) {
+          ++numBadRst;
+          if ((unsigned int)ridx < RC->Nchecks &&
+              report[recBegin + ridx].Status != CheckReport::ERROR)
+            report[recBegin + ridx].Status = CheckReport::BAD_RESTART;
         }
       }
+      Nerrors += numBadRst;
+      if (deepRst && numBadRst == 0)
+        Msg("\tAll atoms in %i restarts OK.\n", nrst);
     }
   } // END loop over runs
+  if (Nerrors > 0) {
+    ErrorMsg("%i errors encountered during check.\n", Nerrors);
+    return 1;
+  }
   if (Nwarnings == 0)
     Msg("  All checks OK.\n");
   else
     Msg("  Runs seem OK, but some warnings were encountered.\n");
-# else
-  Msg("Warning: Compiled without NetCDF. Checking of runs is disabled.\n");
-# endif
   return 0;
 }
+
+/** Check the given run directories. If reportName is not empty, a report
+  * with results for each checked replica is written to it, even if an
+  * error was encountered.
+  */
+int CheckRuns(std::string const& TopDir, StrArray const& RunDirs, bool firstOnly, bool useCache,
+              bool deepRst, std::string const& reportName)
+{
+  CheckReport report;
+  int err = CheckAllRuns( TopDir, RunDirs, firstOnly, useCache, deepRst, report );
+  if (!reportName.empty()) {
+    if (report.Write( reportName )) err = 1;
+  }
+  return err;
+}
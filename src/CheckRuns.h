@@ -1,5 +1,5 @@
 #ifndef INC_CHECKRUNS_H
 #define INC_CHECKRUNS_H
 #include "FileRoutines.h"
-int CheckRuns(std::string const&, StrArray const&, bool);
+int CheckRuns(std::string const&, StrArray const&, bool, bool, bool, std::string const&);
 #endif
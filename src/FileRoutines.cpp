@@ -1,14 +1,239 @@
 #include <cstdio>    // fopen, fclose
 #include <cerrno>
 #include <cstring>
-#include <sys/stat.h> // mkdir
-#include <unistd.h> // getcwd 
+#include <map>
+#include <algorithm> // std::sort, std::lower_bound
+#include <sys/stat.h> // mkdirat, fstatat, fchmodat
+#include <unistd.h> // getcwd, close, read, write, unlinkat
+#include <fcntl.h>  // openat
+#include <dirent.h> // fdopendir, readdir
+#include <fnmatch.h>
 #ifndef __PGI
 #  include <glob.h>  // For tilde expansion
 #endif
 #include "FileRoutines.h"
 #include "Messages.h"
 
+// ----- Directory snapshot cache ----------------------------------------------
+/** Existence checks are answered from a listing of the parent directory that
+  * is read once (a single opendir/readdir pass) instead of a glob + fopen per
+  * file. Directories are identified by device/inode so that different
+  * spellings of the same directory (e.g. relative to different working
+  * directories) share one listing. Listings of directories this process writes
+  * to are dropped via FileCacheInvalidate(); changes made by other processes
+  * after a directory has been read are not seen.
+  */
+struct DirEntry {
+  std::string Name;
+  unsigned char Type; ///< d_type from readdir.
+  bool operator<(DirEntry const& rhs) const { return (Name < rhs.Name); }
+};
+typedef std::vector<DirEntry> DirSnapshot;
+typedef std::pair<dev_t, ino_t> DirKey;
+typedef std::map<DirKey, DirSnapshot> SnapshotMap;
+typedef std::map<std::string, DirKey> DirKeyMap;
+/// Directory listings, sorted by name.
+static SnapshotMap DirCache_;
+/// Memoized stat of directories: absolute name to device/inode.
+static DirKeyMap DirKeys_;
+/// Current working directory; empty if it needs to be determined.
+static std::string CacheCwd_;
+
+enum CacheStatus { CACHE_UNKNOWN = 0, CACHE_ABSENT, CACHE_PRESENT };
+
+/** Split path into directory prefix (including trailing '/', empty for the
+  * current dir) and base name.
+  * \return false if path contains characters that need globbing/tilde
+  *         expansion or base name is empty, '.', or '..'.
+  */
+static bool SplitPath(std::string const& path, const char* special,
+                      std::string& prefix, std::string& base)
+{
+  if (path.find_first_of( special ) != std::string::npos) return false;
+  size_t pos = path.rfind('/');
+  if (pos == std::string::npos) {
+    prefix.clear();
+    base = path;
+  } else {
+    prefix = path.substr(0, pos + 1);
+    base = path.substr(pos + 1);
+  }
+  if (base.empty() || base == "." || base == "..") return false;
+  return true;
+}
+
+/** \return Absolute name of directory prefix relative to dir, empty if the
+  *         current working directory cannot be determined.
+  */
+static std::string AbsDirName(DirHandle const& dir, std::string const& prefix) {
+  if (!prefix.empty() && prefix[0] == '/') return prefix;
+  if (dir.Fd() != AT_FDCWD) return dir.Path() + "/" + prefix;
+  if (CacheCwd_.empty()) {
+    CacheCwd_ = GetWorkingDir();
+    if (CacheCwd_.empty()) return CacheCwd_;
+  }
+  return CacheCwd_ + "/" + prefix;
+}
+
+/// \return Name of directory prefix that can be passed to *at() functions.
+static inline const char* AtName(std::string const& prefix) {
+  if (prefix.empty()) return ".";
+  return prefix.c_str();
+}
+
+/** Get the memoized device/inode of directory prefix relative to dir.
+  * \return false if it is not a directory that can be stat'd.
+  */
+static bool GetDirKey(DirHandle const& dir, std::string const& prefix, DirKey& key) {
+  std::string absName = AbsDirName(dir, prefix);
+  if (absName.empty()) return false;
+  DirKeyMap::const_iterator it = DirKeys_.find( absName );
+  if (it != DirKeys_.end()) {
+    key = it->second;
+    return true;
+  }
+  struct stat dir_stat;
+  if (fstatat(dir.Fd(), AtName(prefix), &dir_stat, 0) != 0 || !S_ISDIR(dir_stat.st_mode))
+    return false;
+  key = DirKey(dir_stat.st_dev, dir_stat.st_ino);
+  DirKeys_.insert( DirKeyMap::value_type(absName, key) );
+  return true;
+}
+
+/** \return Listing of directory prefix relative to dir, read if not yet
+  *         cached; 0 if the directory cannot be read.
+  */
+static DirSnapshot const* GetDirSnapshot(DirHandle const& dir, std::string const& prefix) {
+  DirKey key;
+  if (!GetDirKey(dir, prefix, key)) return 0;
+  SnapshotMap::const_iterator it = DirCache_.find( key );
+  if (it != DirCache_.end()) return &(it->second);
+  int dfd = openat(dir.Fd(), AtName(prefix), O_RDONLY | O_DIRECTORY);
+  if (dfd < 0) return 0;
+  DIR* dirp = fdopendir( dfd );
+  if (dirp == 0) {
+    close( dfd );
+    return 0;
+  }
+  DirSnapshot& snapshot = DirCache_[key];
+  struct dirent* ent;
+  while ( (ent = readdir(dirp)) != 0 ) {
+    if (strcmp(ent->d_name, ".") == 0 || strcmp(ent->d_name, "..") == 0) continue;
+    DirEntry entry;
+    entry.Name.assign( ent->d_name );
+    entry.Type = ent->d_type;
+    snapshot.push_back( entry );
+  }
+  closedir( dirp );
+  std::sort( snapshot.begin(), snapshot.end() );
+  return &snapshot;
+}
+
+/** Check if base exists in directory prefix relative to dir. Symbolic links
+  * are reported as unknown so that they are checked by opening.
+  */
+static CacheStatus CachedExists(DirHandle const& dir, std::string const& prefix,
+                                std::string const& base)
+{
+  DirSnapshot const* snapshot = GetDirSnapshot( dir, prefix );
+  if (snapshot == 0) return CACHE_UNKNOWN;
+  DirEntry entry;
+  entry.Name = base;
+  DirSnapshot::const_iterator it = std::lower_bound(snapshot->begin(), snapshot->end(), entry);
+  if (it == snapshot->end() || it->Name != base) return CACHE_ABSENT;
+  if (it->Type == DT_LNK) return CACHE_UNKNOWN;
+  return CACHE_PRESENT;
+}
+
+/** Add names in directory prefix relative to dir matching pattern to fnames.
+  * \return false if the directory cannot be read.
+  */
+static bool CachedMatch(DirHandle const& dir, std::string const& prefix,
+                        std::string const& pattern, StrArray& fnames)
+{
+  DirSnapshot const* snapshot = GetDirSnapshot( dir, prefix );
+  if (snapshot == 0) return false;
+  for (DirSnapshot::const_iterator it = snapshot->begin(); it != snapshot->end(); ++it)
+    if (fnmatch(pattern.c_str(), it->Name.c_str(), FNM_PERIOD) == 0)
+      fnames.push_back( prefix + it->Name );
+  return true;
+}
+
+/// Drop the listing of the directory containing fname.
+static void DropSnapshot(DirHandle const& dir, std::string const& fname) {
+  if (DirCache_.empty()) return;
+  std::string path( fname );
+  while (path.size() > 1 && path[path.size()-1] == '/')
+    path.resize( path.size() - 1 );
+  size_t pos = path.rfind('/');
+  std::string prefix;
+  if (pos != std::string::npos) prefix = path.substr(0, pos + 1);
+  DirKey key;
+  if (GetDirKey(dir, prefix, key))
+    DirCache_.erase( key );
+}
+
+/// Handle for names relative to the current working directory.
+static const DirHandle CwdDir_;
+
+/** Must be called after creating/renaming fname (relative to dir) so that
+  * later checks of its directory see it.
+  */
+void FileCacheInvalidate(DirHandle const& dir, std::string const& fname) {
+# ifdef _OPENMP
+# pragma omp critical(filecache)
+# endif
+  DropSnapshot( dir, fname );
+}
+
+void FileCacheInvalidate(std::string const& fname) {
+  FileCacheInvalidate( CwdDir_, fname );
+}
+
+// ----- DirHandle -------------------------------------------------------------
+DirHandle::~DirHandle() {
+  if (fd_ != AT_FDCWD) close( fd_ );
+}
+
+int DirHandle::Open(std::string const& dname) {
+  return Open( CwdDir_, dname );
+}
+
+/** Open directory dname relative to parent. Only the directory itself needs
+  * to be looked up; names are then resolved relative to it.
+  */
+int DirHandle::Open(DirHandle const& parent, std::string const& dname) {
+  if (dname.empty()) {
+    ErrorMsg("Cannot open dir; dir name is empty.\n");
+    return 1;
+  }
+  std::string absName;
+  if (dname[0] == '/')
+    absName = dname;
+  else if (parent.fd_ != AT_FDCWD)
+    absName = parent.path_ + "/" + dname;
+  else {
+    absName = GetWorkingDir();
+    if (absName.empty()) return 1;
+    absName.append( "/" + dname );
+  }
+  int fd = openat(parent.fd_, dname.c_str(), O_RDONLY | O_DIRECTORY);
+  if (fd < 0) {
+    ErrorMsg("Opening dir '%s': %s\n", dname.c_str(), strerror( errno ));
+    return 1;
+  }
+  if (fd_ != AT_FDCWD) close( fd_ );
+  fd_ = fd;
+  path_ = absName;
+  return 0;
+}
+
+std::string DirHandle::FullName(std::string const& fname) const {
+  if (fd_ == AT_FDCWD || fname.empty() || fname[0] == '/' || fname[0] == '~')
+    return fname;
+  return path_ + "/" + fname;
+}
+
 // tildeExpansion()
 /** Use glob.h to perform tilde expansion on a filename, returning the
   * expanded filename. If the file does not exist or globbing fails return an
@@ -49,6 +274,13 @@ std::string tildeExpansion(std::string const& filenameIn) {
 
 // ExpandToFilenames()
 StrArray ExpandToFilenames(std::string const& fnameArg) {
+  return ExpandToFilenames( CwdDir_, fnameArg );
+}
+
+/** Expand wildcards in fnameArg relative to dir. Returned names are
+  * relative to dir unless fnameArg is absolute.
+  */
+StrArray ExpandToFilenames(DirHandle const& dir, std::string const& fnameArg) {
   StrArray fnames;
   if (fnameArg.empty()) return fnames;
 # ifdef __PGI
@@ -60,12 +292,31 @@ StrArray ExpandToFilenames(std::string const& fnameArg) {
     Msg("Warning: Currently wildcards in filenames not supported with PGI compilers.\n");
   fnames.push_back( fnameArg );
 # else
+  // Wildcards only in the file name can be matched against the cached listing.
+  std::string prefix, pattern;
+  if (SplitPath(fnameArg, "~\\", prefix, pattern) && pattern[0] != '.' &&
+      prefix.find_first_of("*?[]") == std::string::npos)
+  {
+    bool found;
+#   ifdef _OPENMP
+#   pragma omp critical(filecache)
+#   endif
+    found = CachedMatch(dir, prefix, pattern, fnames);
+    if (found) {
+      if (fnames.empty())
+        Msg("Warning: %s matches no files.\n", fnameArg.c_str());
+      return fnames;
+    }
+  }
+  std::string globName = dir.FullName( fnameArg );
+  // Length of the dir path to remove from matches.
+  size_t dirLen = globName.size() - fnameArg.size();
   glob_t globbuf;
-  int err = glob(fnameArg.c_str(), GLOB_TILDE, NULL, &globbuf );
+  int err = glob(globName.c_str(), GLOB_TILDE, NULL, &globbuf );
   //Msg("DEBUG: %s matches %zu files.\n", fnameArg.c_str(), (size_t)globbuf.gl_pathc);
   if ( err == 0 ) {
     for (unsigned int i = 0; i < (size_t)globbuf.gl_pathc; i++)
-      fnames.push_back( globbuf.gl_pathv[i] );
+      fnames.push_back( std::string(globbuf.gl_pathv[i] + dirLen) );
   } else if (err == GLOB_NOMATCH )
     Msg("Warning: %s matches no files.\n", fnameArg.c_str());
   else
@@ -76,10 +327,34 @@ StrArray ExpandToFilenames(std::string const& fnameArg) {
 }
 
 // fileExists()
-/** Return true if file can be opened "r".  */
 bool fileExists(std::string const& filenameIn) {
+  return fileExists( CwdDir_, filenameIn );
+}
+
+/** Return true if file (relative to dir) can be opened "r". Plain file names
+  * are looked up in the cached listing of their directory; symbolic links are
+  * checked by opening, names that need tilde/wildcard expansion by globbing.
+  */
+bool fileExists(DirHandle const& dir, std::string const& filenameIn) {
+  std::string prefix, base;
+  if (SplitPath(filenameIn, "~*?[]\\", prefix, base)) {
+    CacheStatus status;
+#   ifdef _OPENMP
+#   pragma omp critical(filecache)
+#   endif
+    status = CachedExists(dir, prefix, base);
+    if (status != CACHE_UNKNOWN) return (status == CACHE_PRESENT);
+    int fd = openat(dir.Fd(), filenameIn.c_str(), O_RDONLY);
+    if (fd < 0) {
+      if (errno != ENOENT)
+        ErrorMsg("File '%s': %s\n", filenameIn.c_str(), strerror( errno ));
+      return false;
+    }
+    close( fd );
+    return true;
+  }
   // Perform tilde expansion
-  std::string fname = tildeExpansion(filenameIn);
+  std::string fname = tildeExpansion( dir.FullName(filenameIn) );
   if (fname.empty()) return false;
   FILE *infile = fopen(fname.c_str(), "rb");
   if (infile==0) {
@@ -91,7 +366,11 @@ bool fileExists(std::string const& filenameIn) {
 }
 
 int CheckExists(const char* type, std::string const& fname) {
-  if (fname.empty() || !fileExists(fname)) {
+  return CheckExists( CwdDir_, type, fname );
+}
+
+int CheckExists(DirHandle const& dir, const char* type, std::string const& fname) {
+  if (fname.empty() || !fileExists(dir, fname)) {
     ErrorMsg("%s not found: '%s'\n", type, fname.c_str());
     return 1;
   }
@@ -99,12 +378,18 @@ int CheckExists(const char* type, std::string const& fname) {
 }
 
 int Mkdir(std::string const& dname) {
-  if (!fileExists(dname)) {
+  return Mkdir( CwdDir_, dname );
+}
+
+/** Create directory dname relative to dir if not already present. */
+int Mkdir(DirHandle const& dir, std::string const& dname) {
+  if (!fileExists(dir, dname)) {
     //Msg("Creating directory '%s'\n", dname.c_str());
-    if (mkdir( dname.c_str(), S_IRWXU ) != 0) {
+    if (mkdirat( dir.Fd(), dname.c_str(), S_IRWXU ) != 0) {
       ErrorMsg("Creating dir '%s': %s\n", dname.c_str(), strerror( errno ));
       return 1;
     }
+    FileCacheInvalidate( dir, dname );
   } else
     Msg("Dir %s already present.\n", dname.c_str());
   return 0;
@@ -128,12 +413,100 @@ int ChangeDir(std::string const& dname) {
     ErrorMsg("Changing to dir '%s': %s\n", dname.c_str(), strerror( errno ));
     return 1;
   }
+  // Relative names in the directory cache are now relative to the new dir.
+# ifdef _OPENMP
+# pragma omp critical(filecache)
+# endif
+  CacheCwd_.clear();
   return 0;
 }
 
 int ChangePermissions(std::string const& fname) {
+  return ChangePermissions( CwdDir_, fname );
+}
+
+int ChangePermissions(DirHandle const& dir, std::string const& fname) {
   // For now only 775
-  return chmod(fname.c_str(), S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH);
+  return fchmodat(dir.Fd(), fname.c_str(), S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH, 0);
+}
+
+int GetFileStat(std::string const& fname, off_t& size, time_t& mtime) {
+  return GetFileStat( CwdDir_, fname, size, mtime );
+}
+
+/** Get size and modification time of file relative to dir.
+  * \return 0 on success, 1 if file could not be stat'd.
+  */
+int GetFileStat(DirHandle const& dir, std::string const& fname, off_t& size, time_t& mtime) {
+  struct stat file_stat;
+  if (fstatat(dir.Fd(), fname.c_str(), &file_stat, 0) != 0) {
+    size = 0;
+    mtime = 0;
+    return 1;
+  }
+  size = file_stat.st_size;
+  mtime = file_stat.st_mtime;
+  return 0;
+}
+
+/** \return true if file fname relative to dir has exactly the given contents. */
+bool SameFileContents(DirHandle const& dir, std::string const& fname,
+                      std::string const& contents)
+{
+  int fd = openat(dir.Fd(), fname.c_str(), O_RDONLY);
+  if (fd < 0) return false;
+  struct stat file_stat;
+  if (fstat(fd, &file_stat) != 0 || file_stat.st_size != (off_t)contents.size()) {
+    close(fd);
+    return false;
+  }
+  std::vector<char> buffer( contents.size() + 1 );
+  size_t total = 0;
+  ssize_t nread;
+  while ( (nread = read(fd, &buffer[0] + total, buffer.size() - total)) > 0 ) {
+    total += (size_t)nread;
+    if (total == buffer.size()) break;
+  }
+  close(fd);
+  if (total != contents.size()) return false;
+  return (contents.compare(0, total, &buffer[0], total) == 0);
+}
+
+/** Replace file fname relative to dir with the given contents. Any existing
+  * file is unlinked first so that a file hard linked elsewhere (see
+  * InputStore) is never written through.
+  */
+int WriteFileContents(DirHandle const& dir, std::string const& fname,
+                      std::string const& contents)
+{
+  if (unlinkat(dir.Fd(), fname.c_str(), 0) != 0 && errno != ENOENT) {
+    ErrorMsg("Removing '%s': %s\n", fname.c_str(), strerror( errno ));
+    return 1;
+  }
+  int fd = openat(dir.Fd(), fname.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+  if (fd < 0) {
+    ErrorMsg("Opening file '%s': %s\n", fname.c_str(), strerror( errno ));
+    return 1;
+  }
+  const char* ptr = contents.c_str();
+  size_t remaining = contents.size();
+  while (remaining > 0) {
+    ssize_t nwritten = write(fd, ptr, remaining);
+    if (nwritten < 0) {
+      if (errno == EINTR) continue;
+      ErrorMsg("Writing file '%s': %s\n", fname.c_str(), strerror( errno ));
+      close(fd);
+      return 1;
+    }
+    ptr += nwritten;
+    remaining -= (size_t)nwritten;
+  }
+  if (close(fd) != 0) {
+    ErrorMsg("Closing file '%s': %s\n", fname.c_str(), strerror( errno ));
+    return 1;
+  }
+  FileCacheInvalidate( dir, fname );
+  return 0;
 }
 
 std::string UserName() {
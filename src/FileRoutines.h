@@ -2,14 +2,48 @@
 #define INC_FILEROUTINES_H
 #include <string>
 #include <vector>
+#include <sys/types.h> // off_t, time_t
+#include <fcntl.h>     // AT_FDCWD
+/// Handle to an open directory; names are resolved relative to it (openat semantics).
+class DirHandle {
+  public:
+    /// Default handle refers to the current working directory.
+    DirHandle() : fd_(AT_FDCWD) {}
+    ~DirHandle();
+    /// Open directory relative to the current working directory.
+    int Open(std::string const&);
+    /// Open directory relative to given directory.
+    int Open(DirHandle const&, std::string const&);
+    int Fd()                 const { return fd_; }
+    /// \return Absolute path of directory, empty if current working directory.
+    std::string const& Path() const { return path_; }
+    /// \return Name that can be used from the current working directory.
+    std::string FullName(std::string const&) const;
+  private:
+    DirHandle(DirHandle const&);
+    DirHandle& operator=(DirHandle const&);
+    int fd_;
+    std::string path_;
+};
 std::string tildeExpansion(std::string const&);
 typedef std::vector<std::string> StrArray;
 StrArray ExpandToFilenames(std::string const&);
+StrArray ExpandToFilenames(DirHandle const&, std::string const&);
 bool fileExists(std::string const&);
+bool fileExists(DirHandle const&, std::string const&);
+void FileCacheInvalidate(std::string const&);
+void FileCacheInvalidate(DirHandle const&, std::string const&);
 int CheckExists(const char*, std::string const&);
+int CheckExists(DirHandle const&, const char*, std::string const&);
 int Mkdir(std::string const&);
+int Mkdir(DirHandle const&, std::string const&);
 std::string GetWorkingDir();
 int ChangeDir(std::string const&);
 int ChangePermissions(std::string const&);
+int ChangePermissions(DirHandle const&, std::string const&);
+int GetFileStat(std::string const&, off_t&, time_t&);
+int GetFileStat(DirHandle const&, std::string const&, off_t&, time_t&);
+bool SameFileContents(DirHandle const&, std::string const&, std::string const&);
+int WriteFileContents(DirHandle const&, std::string const&, std::string const&);
 std::string UserName();
 #endif
@@ -1,57 +1,137 @@
+#include <algorithm> // std::sort
 #include "Groups.h"
 #include "Messages.h"
 
-int Groups::SetupGroups(unsigned int Ndims) {
-  dimGroups_.clear();
-  dimGroups_.resize( Ndims );
+int Groups::SetupGroups(Iarray const& sizes) {
+  points_.clear();
+  sparse_.clear();
+  sizes_ = sizes;
+  strides_.resize( sizes_.size() );
+  nreps_ = 1;
+  for (unsigned int dim = 0; dim != sizes_.size(); dim++) {
+    if (sizes_[dim] < 1) {
+      ErrorMsg("Dimension %u has no replicas.\n", dim);
+      sizes_.clear();
+      return 1;
+    }
+    strides_[dim] = nreps_;
+    nreps_ *= sizes_[dim];
+  }
   return 0;
 }
 
-void Groups::PrintArray(Iarray const& idxs) {
-  for (Iarray::const_iterator it = idxs.begin(); it != idxs.end(); ++it)
-    Msg("{ %u", *it);
-  Msg(" }\n");
+/** A replica with no neighbor in a dimension is left out of that dimension's
+  * groups. Members of a group must be adjacent on the grid, since exchanges
+  * are attempted between neighbors in the group.
+  */
+int Groups::SetupGroups(Iarray const& sizes, IarrayArray const& points) {
+  if (SetupGroups( sizes )) return 1;
+  points_ = points;
+  sparse_.assign( sizes_.size(), IarrayArray() );
+  for (unsigned int id = 0; id != sizes_.size(); id++) {
+    IarrayArray groups;
+    SparseGroups(id, groups);
+    for (IarrayArray::const_iterator grp = groups.begin(); grp != groups.end(); ++grp) {
+      for (unsigned int mbr = 1; mbr < grp->size(); mbr++) {
+        unsigned int r0 = (*grp)[mbr-1];
+        unsigned int r1 = (*grp)[mbr];
+        if (points_[r1-1][id] != points_[r0-1][id] + 1) {
+          ErrorMsg("Grid has a gap in dimension %u between replicas %u and %u.\n", id, r0, r1);
+          points_.clear();
+          sparse_.clear();
+          return 1;
+        }
+      }
+      if (grp->size() > 1) sparse_[id].push_back( *grp );
+    }
+    if (sparse_[id].empty()) {
+      ErrorMsg("No replicas in dimension %u have a neighbor to exchange with.\n", id);
+      points_.clear();
+      sparse_.clear();
+      return 1;
+    }
+  }
+  return 0;
 }
 
-/** It is expected that the replica number passed in starts from 1. */
-int Groups::AddReplica(Iarray const& Indices, unsigned int rep) {
-  // Put replica in its place in each dimension.
-  for (unsigned int dim = 0; dim != dimGroups_.size(); dim++)
-  {
-    Iarray idxs;
-    idxs.reserve( dimGroups_.size()-1 );
-    // Put indices not corresponding to this dimension in idxs.
-    for (unsigned int idxDim = 0; idxDim != dimGroups_.size(); idxDim++)
-      if (idxDim != dim)
-        idxs.push_back( Indices[idxDim] );
-    // Find the corresponding group
-    GroupArrayType::iterator grp = dimGroups_[dim].find( idxs );
-    if (grp == dimGroups_[dim].end()) { // New group
-      //Msg("\tNew group for dim %u: rep %u:", dim, rep);
-      //PrintArray(idxs);
-      dimGroups_[dim].insert( std::pair<Iarray,Iarray>( idxs, Iarray(1, rep) ) );
-    } else {
-      //Msg("\tAdding to group for dim %u: rep %u:", dim, rep);
-      //PrintArray(grp->first);
-      grp->second.push_back( rep );
+/// Order replicas by group in a dimension, then by index in that dimension.
+struct GroupOrder {
+  GroupOrder(Groups::IarrayArray const& points, unsigned int id) : points_(points), id_(id) {}
+  bool operator()(unsigned int r1, unsigned int r2) const {
+    Groups::Iarray const& p1 = points_[r1];
+    Groups::Iarray const& p2 = points_[r2];
+    for (unsigned int dim = 0; dim != p1.size(); dim++)
+      if (dim != id_ && p1[dim] != p2[dim]) return (p1[dim] < p2[dim]);
+    return (p1[id_] < p2[id_]);
+  }
+  Groups::IarrayArray const& points_;
+  unsigned int id_;
+};
+
+/** Groups are in the same order as for the full grid, with members that
+  * do not exist left out. Single-member groups are kept.
+  */
+void Groups::SparseGroups(unsigned int id, IarrayArray& groups) const {
+  groups.clear();
+  Iarray order( points_.size() );
+  for (unsigned int rep = 0; rep != order.size(); rep++)
+    order[rep] = rep;
+  std::sort( order.begin(), order.end(), GroupOrder(points_, id) );
+  for (Iarray::const_iterator rep = order.begin(); rep != order.end(); ++rep) {
+    bool newGroup = groups.empty();
+    if (!newGroup) {
+      Iarray const& prev = points_[groups.back().back() - 1];
+      for (unsigned int dim = 0; dim != sizes_.size(); dim++)
+        if (dim != id && prev[dim] != points_[*rep][dim]) {
+          newGroup = true;
+          break;
+        }
     }
+    if (newGroup) groups.push_back( Iarray() );
+    groups.back().push_back( *rep + 1 );
   }
-  return 0;
+}
+
+/** Groups are ordered by the indices of the other dimensions, with the
+  * lowest dimension most significant.
+  */
+bool Groups::NextGroup(unsigned int id, Iarray& idxs) const {
+  for (unsigned int dim = sizes_.size(); dim-- > 0; ) {
+    if (dim == id) continue;
+    if (++idxs[dim] < sizes_[dim]) return true;
+    idxs[dim] = 0;
+  }
+  return false;
+}
+
+unsigned int Groups::FirstMember(Iarray const& idxs) const {
+  unsigned int rep = 1;
+  for (unsigned int dim = 0; dim != sizes_.size(); dim++)
+    rep += idxs[dim] * strides_[dim];
+  return rep;
 }
 
 void Groups::PrintGroups() const {
-  for (DimGroupType::const_iterator dim = dimGroups_.begin();
-                                    dim != dimGroups_.end(); ++dim)
+  for (unsigned int id = 0; id != sizes_.size(); id++)
   {
-    Msg("  Dim %u:\n", dim - dimGroups_.begin());
-    unsigned int gidx = 0;
-    for (GroupArrayType::const_iterator grp = dim->begin();
-                                        grp != dim->end(); ++grp, ++gidx)
+    Msg("  Dim %u:\n", id);
+    if (!points_.empty()) {
+      IarrayArray const& groups = sparse_[id];
+      for (IarrayArray::const_iterator grp = groups.begin(); grp != groups.end(); ++grp) {
+        Msg("    Group %u: ", (unsigned int)(grp - groups.begin()));
+        for (Iarray::const_iterator rep = grp->begin(); rep != grp->end(); ++rep)
+          Msg(" %u", *rep);
+        Msg("\n");
+      }
+      continue;
+    }
+    Iarray idxs( sizes_.size(), 0 );
+    for (unsigned int gidx = 0; gidx != Ngroups(id); gidx++, NextGroup(id, idxs))
     {
       Msg("    Group %u: ", gidx);
-      for (Iarray::const_iterator rep = grp->second.begin();
-                                  rep != grp->second.end(); ++rep)
-        Msg(" %u", *rep);
+      unsigned int rep = FirstMember( idxs );
+      for (unsigned int member = 0; member != sizes_[id]; member++, rep += strides_[id])
+        Msg(" %u", rep);
       Msg("\n");
     }
   }
@@ -62,15 +142,24 @@ void Groups::WriteRemdDim(TextFile& REMDDIM, unsigned int id,
 {
   REMDDIM.Printf("Dimension %u\n", id); // Title
   REMDDIM.Printf("&multirem\n   exch_type = '%s',\n", exch_type);
-  unsigned int gidx = 1;
-  for (GroupArrayType::const_iterator grp = dimGroups_[id].begin();
-                                      grp != dimGroups_[id].end();
-                                    ++grp, ++gidx)
+  if (!points_.empty()) {
+    IarrayArray const& groups = sparse_[id];
+    for (IarrayArray::const_iterator grp = groups.begin(); grp != groups.end(); ++grp) {
+      REMDDIM.Printf("   group(%u,:) = ", (unsigned int)(grp - groups.begin()) + 1);
+      for (Iarray::const_iterator rep = grp->begin(); rep != grp->end(); ++rep)
+        REMDDIM.Printf("%u,", *rep);
+      REMDDIM.Printf("\n");
+    }
+    REMDDIM.Printf("   desc = '%s'\n/\n", desc);
+    return;
+  }
+  Iarray idxs( sizes_.size(), 0 );
+  for (unsigned int gidx = 1; gidx <= Ngroups(id); gidx++, NextGroup(id, idxs))
   {
     REMDDIM.Printf("   group(%u,:) = ", gidx);
-    for (Iarray::const_iterator rep = grp->second.begin();
-                                rep != grp->second.end(); ++rep)
-      REMDDIM.Printf("%u,", *rep);
+    unsigned int rep = FirstMember( idxs );
+    for (unsigned int member = 0; member != sizes_[id]; member++, rep += strides_[id])
+      REMDDIM.Printf("%u,", rep);
     REMDDIM.Printf("\n");
   }
   REMDDIM.Printf("   desc = '%s'\n/\n", desc);
@@ -1,31 +1,45 @@
 #ifndef INC_GROUPS_H
 #define INC_GROUPS_H
 #include <vector>
-#include <map>
 #include "TextFile.h"
 /// Class for setting up MREMD groups.
+/** Replicas are numbered in mixed radix order, with the index in the first
+  * dimension growing fastest. A group in a given dimension is all replicas
+  * whose indices in the other dimensions are the same, so group membership
+  * can be computed directly from the dimension sizes. For a sparse grid
+  * (only some grid points have replicas) groups contain only the replicas
+  * that exist; replicas without a neighbor in a dimension are in no group
+  * for that dimension.
+  */
 class Groups {
   public:
     typedef std::vector<unsigned int> Iarray;
-    Groups() {}
-    /// Prepare Groups for given # of dimensions.
-    int SetupGroups(unsigned int);
-    /// Add replica with given indices to its proper group in each dim.
-    int AddReplica(Iarray const&, unsigned int);
+    typedef std::vector<Iarray> IarrayArray;
+    Groups() : nreps_(0) {}
+    /// Prepare Groups for dimensions with given sizes.
+    int SetupGroups(Iarray const&);
+    /// Prepare Groups for dimensions with given sizes and grid points (indices) of each replica.
+    int SetupGroups(Iarray const&, IarrayArray const&);
     /// Print groups to screen
     void PrintGroups() const;
     /// Print groups for dimension to remd.dim file
     void WriteRemdDim(TextFile&, unsigned int, const char*, const char*) const;
     /// \return true if not yet set up
-    bool Empty() const { return dimGroups_.empty(); }
+    bool Empty() const { return sizes_.empty(); }
   private:
-    static inline void PrintArray(Iarray const&); 
-    /** Map indices to group, 1 per dim. First Iarray is Ndims-1 (all
-      * dimensions not including that dim), second is size of that dim.
-      */
-    typedef std::map<Iarray, Iarray> GroupArrayType;
-    /// Hold GroupArrayType for each dimension.
-    typedef std::vector<GroupArrayType> DimGroupType;
-    DimGroupType dimGroups_;
+    /// \return Number of groups in dimension.
+    unsigned int Ngroups(unsigned int id) const { return nreps_ / sizes_[id]; }
+    /// Advance indices of all dims except given one to the next group. \return false if done.
+    bool NextGroup(unsigned int, Iarray&) const;
+    /// \return Replica number (starting from 1) of first member of group with given indices.
+    unsigned int FirstMember(Iarray const&) const;
+    /// Get replica numbers of each group in dimension for sparse grid, including single members.
+    void SparseGroups(unsigned int, IarrayArray&) const;
+
+    Iarray sizes_;        ///< Size of each dimension.
+    Iarray strides_;      ///< Replica number stride of each dimension.
+    unsigned int nreps_;  ///< Total number of replicas.
+    IarrayArray points_;  ///< Grid point of each replica if sparse, otherwise empty.
+    std::vector<IarrayArray> sparse_; ///< Groups with more than one member in each dimension if sparse.
 };
 #endif
@@ -0,0 +1,117 @@
+#include <cstdio>    // snprintf, renameat
+#include <cerrno>
+#include <cstring>   // strerror
+#include <fcntl.h>   // openat
+#include <unistd.h>  // linkat, unlinkat
+#include "InputStore.h"
+#include "Messages.h"
+#include "StringRoutines.h" // ContentHash
+
+const char* InputStore::DIRNAME_ = ".inputstore";
+
+InputStore::InputStore() :
+  useLinks_(true),
+  nlinked_(0),
+  ncreated_(0),
+  ncopied_(0)
+{}
+
+int InputStore::Setup(DirHandle const& topDir) {
+  if (!fileExists(topDir, DIRNAME_)) {
+    if (Mkdir(topDir, DIRNAME_)) return 1;
+  }
+  if (storeDir_.Open(topDir, DIRNAME_)) return 1;
+  return 0;
+}
+
+/// \return Store object name: 64 bit FNV-1a hash and size of contents.
+static std::string ObjectName(std::string const& contents) {
+  char buffer[64];
+  snprintf(buffer, 64, "%016llx.%zu", ContentHash(contents), contents.size());
+  return std::string(buffer);
+}
+
+/** Ensure store object with given contents exists. An object left by a
+  * previous invocation is checked once against the contents.
+  * \return 0 if object can be linked to, -1 if a copy must be made, 1 on error.
+  */
+int InputStore::GetObject(std::string const& obj, std::string const& contents) {
+  if (!useLinks_ || badObjects_.find(obj) != badObjects_.end()) return -1;
+  if (objects_.find(obj) != objects_.end()) return 0;
+  if (fileExists(storeDir_, obj)) {
+    if (!SameFileContents(storeDir_, obj, contents)) {
+      Msg("Warning: Store object '%s' does not match; writing copies.\n", obj.c_str());
+      badObjects_.insert( obj );
+      return -1;
+    }
+  } else {
+    // Write under a temporary name so an interrupted write never leaves a bad object.
+    std::string tmpName( obj + ".tmp" );
+    if (WriteFileContents(storeDir_, tmpName, contents)) return 1;
+    if (renameat(storeDir_.Fd(), tmpName.c_str(), storeDir_.Fd(), obj.c_str()) != 0) {
+      ErrorMsg("Creating store object '%s': %s\n", obj.c_str(), strerror( errno ));
+      return 1;
+    }
+    FileCacheInvalidate( storeDir_, obj );
+    ncreated_++;
+  }
+  objects_.insert( obj );
+  return 0;
+}
+
+/** Hard link fname relative to dir to the store object for contents,
+  * creating the object if necessary. Safe to call from multiple threads.
+  */
+int InputStore::Write(DirHandle const& dir, std::string const& fname,
+                      std::string const& contents)
+{
+  std::string obj = ObjectName( contents );
+  int err;
+# ifdef _OPENMP
+# pragma omp critical(inputstore)
+# endif
+  err = GetObject( obj, contents );
+  if (err > 0) return 1;
+  if (err == 0) {
+    if (unlinkat(dir.Fd(), fname.c_str(), 0) != 0 && errno != ENOENT) {
+      ErrorMsg("Removing '%s': %s\n", fname.c_str(), strerror( errno ));
+      return 1;
+    }
+    if (linkat(storeDir_.Fd(), obj.c_str(), dir.Fd(), fname.c_str(), 0) == 0) {
+      FileCacheInvalidate( dir, fname );
+#     ifdef _OPENMP
+#     pragma omp atomic
+#     endif
+      nlinked_++;
+      return 0;
+    }
+    int linkErr = errno;
+    if (linkErr != EXDEV && linkErr != EPERM && linkErr != EMLINK &&
+        linkErr != ENOTSUP && linkErr != EOPNOTSUPP && linkErr != ENOSYS)
+    {
+      ErrorMsg("Linking '%s': %s\n", fname.c_str(), strerror( linkErr ));
+      return 1;
+    }
+    // Too many links to this object only affects this file.
+    if (linkErr != EMLINK) {
+#     ifdef _OPENMP
+#     pragma omp critical(inputstore)
+#     endif
+      {
+        if (useLinks_)
+          Msg("Warning: Hard links not available (%s); writing copies.\n", strerror( linkErr ));
+        useLinks_ = false;
+      }
+    }
+  }
+# ifdef _OPENMP
+# pragma omp atomic
+# endif
+  ncopied_++;
+  return WriteFileContents(dir, fname, contents);
+}
+
+void InputStore::Info() const {
+  Msg("  Input store '%s': %u files linked (%u new objects), %u copied.\n",
+      DIRNAME_, nlinked_, ncreated_, ncopied_);
+}
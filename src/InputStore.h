@@ -0,0 +1,35 @@
+#ifndef INC_INPUTSTORE_H
+#define INC_INPUTSTORE_H
+#include <set>
+#include "FileRoutines.h" // DirHandle
+/// Content-addressed store of generated input files, shared between runs via hard links.
+/** Each distinct file content is written once to the store directory in the
+  * top directory, named by a hash of the content and its size. Files in run
+  * directories are hard links to the store object. If hard links cannot be
+  * made (e.g. not supported by the file system) files are written as copies.
+  */
+class InputStore {
+  public:
+    InputStore();
+    /// Set up store in given top directory, creating the store dir if needed.
+    int Setup(DirHandle const&);
+    /// Write contents to file name relative to dir.
+    int Write(DirHandle const&, std::string const&, std::string const&);
+    /// Print # of files linked/copied.
+    void Info() const;
+
+    static const char* DirName() { return DIRNAME_; }
+  private:
+    static const char* DIRNAME_;
+
+    int GetObject(std::string const&, std::string const&);
+
+    DirHandle storeDir_;            ///< Store directory.
+    std::set<std::string> objects_; ///< Objects known to exist with correct content.
+    std::set<std::string> badObjects_; ///< Objects whose content does not match (hash collision).
+    bool useLinks_;                 ///< False once hard links are found not to work.
+    unsigned int nlinked_;          ///< # files hard linked.
+    unsigned int ncreated_;         ///< # objects created.
+    unsigned int ncopied_;          ///< # files written as copies.
+};
+#endif
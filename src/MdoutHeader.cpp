@@ -0,0 +1,120 @@
+#include <cstdio>
+#include <cstdlib> // atoi, atof
+#include <cstring> // memchr, memmove, strncmp
+#include "MdoutHeader.h"
+#include "Messages.h"
+
+MdoutHeader::MdoutHeader() :
+  state_(PRE_CONTROL),
+  nstlim_(0),
+  dt_(0.0),
+  numexchg_(0),
+  ntwx_(0),
+  ntwr_(0),
+  ntpr_(0)
+{}
+
+/// \return true if token of given length matches key.
+static inline bool TokenIs(const char* tok, size_t len, const char* key) {
+  return (strncmp(tok, key, len) == 0 && key[len] == '\0');
+}
+
+/// \return true if character separates tokens.
+static inline bool IsSep(char c) {
+  return (c == ' ' || c == ',' || c == '=' || c == '\t' || c == '\r');
+}
+
+/** Tokenize the given null-terminated line in place. Tokens are separated
+  * by spaces, commas, and equals signs. A variable of interest is set from
+  * the token immediately after its name.
+  */
+void MdoutHeader::ParseLine(const char* beg, const char* end) {
+  const char* prev = 0;
+  size_t prevLen = 0;
+  int ncols = 0;
+  const char* ptr = beg;
+  while (ptr != end) {
+    // Skip separators
+    while (ptr != end && IsSep(*ptr)) ++ptr;
+    if (ptr == end) break;
+    const char* tok = ptr;
+    while (ptr != end && !IsSep(*ptr)) ++ptr;
+    size_t len = (size_t)(ptr - tok);
+    if (ncols == 1) {
+      // Check for section headers, e.g. '2.  CONTROL  DATA'
+      if (state_ == PRE_CONTROL) {
+        if (TokenIs(prev, prevLen, "2.") && TokenIs(tok, len, "CONTROL"))
+          state_ = IN_CONTROL;
+        return;
+      } else if (TokenIs(prev, prevLen, "3.") && TokenIs(tok, len, "ATOMIC")) {
+        state_ = DONE;
+        return;
+      }
+    }
+    if (state_ == IN_CONTROL && prev != 0) {
+      // Values are followed by a separator so they can be converted in place.
+      if      (TokenIs(prev, prevLen, "nstlim"  )) nstlim_   = atoi( tok );
+      else if (TokenIs(prev, prevLen, "dt"      )) dt_       = atof( tok );
+      else if (TokenIs(prev, prevLen, "numexchg")) numexchg_ = atoi( tok );
+      else if (TokenIs(prev, prevLen, "ntwx"    )) ntwx_     = atoi( tok );
+      else if (TokenIs(prev, prevLen, "ntwr"    )) ntwr_     = atoi( tok );
+      else if (TokenIs(prev, prevLen, "ntpr"    )) ntpr_     = atoi( tok );
+    }
+    prev = tok;
+    prevLen = len;
+    ++ncols;
+  }
+}
+
+/** Read the given mdout file block by block until the control section has
+  * been parsed.
+  * \return 0 if control section found, 1 otherwise.
+  */
+int MdoutHeader::Read(std::string const& fname) {
+  state_ = PRE_CONTROL;
+  nstlim_ = 0;
+  dt_ = 0.0;
+  numexchg_ = 0;
+  ntwx_ = 0;
+  ntwr_ = 0;
+  ntpr_ = 0;
+  FILE* infile = fopen(fname.c_str(), "rb");
+  if (infile == 0) {
+    ErrorMsg("Opening file '%s'\n", fname.c_str());
+    return 1;
+  }
+  size_t nleft = 0; // Bytes of incomplete line carried over from previous block.
+  while (state_ != DONE) {
+    size_t nread = fread(buffer_ + nleft, 1, BUF_SIZE - 1 - nleft, infile);
+    size_t bufEnd = nleft + nread;
+    if (nread == 0) {
+      // Final line with no newline.
+      if (nleft > 0) {
+        buffer_[nleft] = '\0';
+        ParseLine(buffer_, buffer_ + nleft);
+      }
+      break;
+    }
+    buffer_[bufEnd] = '\0';
+    char* lineBeg = buffer_;
+    char* lineEnd;
+    while ( state_ != DONE &&
+            (lineEnd = (char*)memchr(lineBeg, '\n', (buffer_ + bufEnd) - lineBeg)) != 0 )
+    {
+      *lineEnd = '\0';
+      ParseLine(lineBeg, lineEnd);
+      lineBeg = lineEnd + 1;
+    }
+    nleft = (size_t)((buffer_ + bufEnd) - lineBeg);
+    if (nleft == BUF_SIZE - 1)
+      nleft = 0; // Line longer than buffer; not part of the control section.
+    else if (nleft > 0)
+      memmove(buffer_, lineBeg, nleft);
+  }
+  fclose(infile);
+  if (state_ == PRE_CONTROL) {
+    ErrorMsg("Control section not found in '%s'\n", fname.c_str());
+    return 1;
+  }
+  return 0;
+}
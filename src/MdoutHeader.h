@@ -0,0 +1,35 @@
+#ifndef INC_MDOUTHEADER_H
+#define INC_MDOUTHEADER_H
+#include <string>
+/// Read MD control variables from the '2. CONTROL DATA' section of Amber output.
+/** The file is read in fixed-size blocks into an internal buffer and only
+  * until the end of the control section is reached. Lines are tokenized in
+  * place so no memory is allocated while parsing.
+  */
+class MdoutHeader {
+  public:
+    MdoutHeader();
+    /// Read control section of given mdout file.
+    int Read(std::string const&);
+    int Nstlim()   const { return nstlim_;   }
+    double Dt()    const { return dt_;       }
+    int Numexchg() const { return numexchg_; }
+    int Ntwx()     const { return ntwx_;     }
+    int Ntwr()     const { return ntwr_;     }
+    int Ntpr()     const { return ntpr_;     }
+  private:
+    enum StateType { PRE_CONTROL = 0, IN_CONTROL, DONE };
+    static const unsigned int BUF_SIZE = 16384;
+
+    void ParseLine(const char*, const char*);
+
+    char buffer_[BUF_SIZE];
+    StateType state_;
+    int nstlim_;
+    double dt_;
+    int numexchg_;
+    int ntwx_;
+    int ntwr_;
+    int ntpr_;
+};
+#endif
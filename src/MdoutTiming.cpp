@@ -0,0 +1,127 @@
+#include <cstdio>
+#include <cstdlib> // atof
+#include <cstring> // memchr, strncmp, strstr
+#include <vector>
+#include <sys/stat.h> // stat
+#include "MdoutTiming.h"
+#include "Messages.h"
+
+MdoutTiming::MdoutTiming() :
+  inTimings_(false),
+  inRoutines_(false),
+  nsPerDay_(-1.0),
+  elapsed_(-1.0),
+  wallTime_(-1.0),
+  routineTotal_(-1.0),
+  commTime_(-1.0)
+{}
+
+/// \return Pointer to value following the first '=' after key, 0 if key not found.
+static inline const char* ValueAfter(const char* line, const char* key) {
+  const char* ptr = strstr(line, key);
+  if (ptr == 0) return 0;
+  ptr = strchr(ptr, '=');
+  if (ptr == 0) return 0;
+  return ptr + 1;
+}
+
+/** Parse a line of the timing section. Leading '|' and spaces are skipped.
+  * Routines that move data between tasks (DataDistrib, anything with
+  * 'Comm' in the name) are counted as communication.
+  */
+void MdoutTiming::ParseLine(const char* line) {
+  while (*line == '|' || *line == ' ' || *line == '\t') ++line;
+  if (!inTimings_) {
+    if (strncmp(line, "5.", 2) == 0 && strstr(line, "TIMINGS") != 0)
+      inTimings_ = true;
+    return;
+  }
+  if (inRoutines_) {
+    if (line[0] == '-') return;
+    char name[64];
+    double sec;
+    if (sscanf(line, "%63s %lf", name, &sec) != 2) {
+      inRoutines_ = false;
+      return;
+    }
+    if (strcmp(name, "Total") == 0) {
+      routineTotal_ = sec;
+      inRoutines_ = false;
+    } else if (strcmp(name, "DataDistrib") == 0 || strstr(name, "Comm") != 0 ||
+               strstr(name, "comm") != 0)
+    {
+      if (commTime_ < 0.0) commTime_ = 0.0;
+      commTime_ += sec;
+    }
+    return;
+  }
+  const char* val;
+  // Only the first routine table (major routines) is used.
+  if (routineTotal_ < 0.0 && strncmp(line, "Routine", 7) == 0) {
+    inRoutines_ = true;
+    if (commTime_ < 0.0) commTime_ = 0.0;
+  // 'Average timings for all steps' come after 'last N steps' so overwrite.
+  } else if ((val = ValueAfter(line, "Elapsed(s)")) != 0)
+    elapsed_ = atof( val );
+  else if ((val = ValueAfter(line, "ns/day")) != 0)
+    nsPerDay_ = atof( val );
+  else if (strncmp(line, "Master Total wall time:", 23) == 0)
+    wallTime_ = atof( line + 23 );
+}
+
+/** Read the last TAIL_SIZE bytes of the file line by line. */
+int MdoutTiming::Read(std::string const& fname) {
+  inTimings_ = false;
+  inRoutines_ = false;
+  nsPerDay_ = -1.0;
+  elapsed_ = -1.0;
+  wallTime_ = -1.0;
+  routineTotal_ = -1.0;
+  commTime_ = -1.0;
+  struct stat fileStat;
+  if (stat(fname.c_str(), &fileStat) != 0) {
+    ErrorMsg("Could not stat '%s'\n", fname.c_str());
+    return 1;
+  }
+  FILE* infile = fopen(fname.c_str(), "rb");
+  if (infile == 0) {
+    ErrorMsg("Opening file '%s'\n", fname.c_str());
+    return 1;
+  }
+  off_t offset = 0;
+  if (fileStat.st_size > (off_t)TAIL_SIZE)
+    offset = fileStat.st_size - (off_t)TAIL_SIZE;
+  if (offset > 0 && fseeko(infile, offset, SEEK_SET) != 0) {
+    ErrorMsg("Seeking in '%s'\n", fname.c_str());
+    fclose(infile);
+    return 1;
+  }
+  std::vector<char> buffer( TAIL_SIZE + 1 );
+  size_t nread = fread(&buffer[0], 1, TAIL_SIZE, infile);
+  fclose(infile);
+  buffer[nread] = '\0';
+  char* lineBeg = &buffer[0];
+  char* bufEnd = lineBeg + nread;
+  char* lineEnd;
+  // First line is partial unless at start of file.
+  if (offset > 0) {
+    lineEnd = (char*)memchr(lineBeg, '\n', bufEnd - lineBeg);
+    lineBeg = (lineEnd == 0) ? bufEnd : lineEnd + 1;
+  }
+  while (lineBeg < bufEnd) {
+    lineEnd = (char*)memchr(lineBeg, '\n', bufEnd - lineBeg);
+    if (lineEnd == 0) lineEnd = bufEnd;
+    *lineEnd = '\0';
+    ParseLine( lineBeg );
+    lineBeg = lineEnd + 1;
+  }
+  return 0;
+}
+
+void MdoutTiming::Merge(MdoutTiming const& rhs) {
+  if (nsPerDay_ < 0.0)     nsPerDay_ = rhs.nsPerDay_;
+  if (elapsed_ < 0.0)      elapsed_ = rhs.elapsed_;
+  if (wallTime_ < 0.0)     wallTime_ = rhs.wallTime_;
+  if (routineTotal_ < 0.0) routineTotal_ = rhs.routineTotal_;
+  if (commTime_ < 0.0)     commTime_ = rhs.commTime_;
+}
@@ -0,0 +1,35 @@
+#ifndef INC_MDOUTTIMING_H
+#define INC_MDOUTTIMING_H
+#include <string>
+/// Read performance info from the '5. TIMINGS' section of pmemd output.
+/** The timing section is at the end of the file, so only the last
+  * TAIL_SIZE bytes are read. The same format is used for mdout and logfile.
+  */
+class MdoutTiming {
+  public:
+    MdoutTiming();
+    /// Read timing section of given file. \return 1 if file could not be read.
+    int Read(std::string const&);
+    /// Fill in any values not found from another timing.
+    void Merge(MdoutTiming const&);
+    /// \return true if average timings were found.
+    bool Found()          const { return (elapsed_ > 0.0); }
+    double NsPerDay()     const { return nsPerDay_;     }
+    double Elapsed()      const { return elapsed_;      }
+    double WallTime()     const { return wallTime_;     }
+    double RoutineTotal() const { return routineTotal_; }
+    double CommTime()     const { return commTime_;     }
+  private:
+    static const unsigned int TAIL_SIZE = 65536;
+
+    void ParseLine(const char*);
+
+    bool inTimings_;      ///< True once the timing section is reached.
+    bool inRoutines_;     ///< True when in the table of major routines.
+    double nsPerDay_;     ///< Average ns/day for all steps.
+    double elapsed_;      ///< Average elapsed (NonSetup) time in seconds for all steps.
+    double wallTime_;     ///< Master total wall time in seconds.
+    double routineTotal_; ///< Total time of major routines in seconds.
+    double commTime_;     ///< Time of communication routines in seconds.
+};
+#endif
@@ -0,0 +1,341 @@
+#include <cstdio>
+#include <algorithm> // std::max
+#include <cstring> // memcmp, memcpy
+#include "NetcdfHeader.h"
+#include "Messages.h"
+
+// Header tags
+static const unsigned int NCTAG_DIMENSION = 0x0A;
+static const unsigned int NCTAG_VARIABLE  = 0x0B;
+static const unsigned int NCTAG_ATTRIBUTE = 0x0C;
+// External data types
+static const int NCTYPE_BYTE   = 1;
+static const int NCTYPE_CHAR   = 2;
+static const int NCTYPE_SHORT  = 3;
+static const int NCTYPE_INT    = 4;
+static const int NCTYPE_FLOAT  = 5;
+static const int NCTYPE_DOUBLE = 6;
+/// Size of each header read.
+static const size_t NC_BLOCK = 8192;
+
+/// \return true if this machine is big endian.
+static inline bool HostIsBigEndian() {
+  const unsigned int one = 1;
+  return ( *((const unsigned char*)&one) == 0 );
+}
+
+/// Convert from big endian (NetCDF external) to host byte order in place.
+static inline void FromBigEndian(unsigned char* ptr, unsigned int size) {
+  if (HostIsBigEndian()) return;
+  for (unsigned int i = 0; i < size / 2; i++) {
+    unsigned char tmp = ptr[i];
+    ptr[i] = ptr[size - 1 - i];
+    ptr[size - 1 - i] = tmp;
+  }
+}
+
+NetcdfHeader::NetcdfHeader() :
+  pos_(0),
+  file_(0),
+  format_(UNKNOWN_FMT),
+  nrecs_(0),
+  recSize_(0),
+  recBegin_(0),
+  recDim_(-1)
+{}
+
+NetcdfHeader::~NetcdfHeader() { Close(); }
+
+void NetcdfHeader::Close() {
+  if (file_ != 0) fclose((FILE*)file_);
+  file_ = 0;
+}
+
+unsigned int NetcdfHeader::TypeSize(int type) {
+  switch (type) {
+    case NCTYPE_BYTE   :
+    case NCTYPE_CHAR   : return 1;
+    case NCTYPE_SHORT  : return 2;
+    case NCTYPE_INT    :
+    case NCTYPE_FLOAT  : return 4;
+    case NCTYPE_DOUBLE : return 8;
+  }
+  return 0;
+}
+
+/** Ensure at least n bytes past the current position have been read. */
+int NetcdfHeader::Fill(size_t n) {
+  size_t needed = pos_ + n;
+  while (buf_.size() < needed) {
+    size_t oldSize = buf_.size();
+    size_t toRead = std::max(NC_BLOCK, needed - oldSize);
+    buf_.resize( oldSize + toRead );
+    size_t nread = fread(&buf_[0] + oldSize, 1, toRead, (FILE*)file_);
+    buf_.resize( oldSize + nread );
+    if (nread == 0) return 1;
+  }
+  return 0;
+}
+
+/** Read 4 byte big endian unsigned integer. */
+int NetcdfHeader::GetUint(unsigned int& val) {
+  if (Fill(4)) return 1;
+  const unsigned char* ptr = &buf_[pos_];
+  val = ((unsigned int)ptr[0] << 24) | ((unsigned int)ptr[1] << 16) |
+        ((unsigned int)ptr[2] << 8)  |  (unsigned int)ptr[3];
+  pos_ += 4;
+  return 0;
+}
+
+/** Read variable offset; 4 bytes for CDF-1, 8 bytes for CDF-2. */
+int NetcdfHeader::GetOffset(off_t& val) {
+  unsigned int hi = 0, lo = 0;
+  if (format_ == CDF2) {
+    if (GetUint(hi)) return 1;
+  }
+  if (GetUint(lo)) return 1;
+  val = (off_t)lo;
+  if (hi != 0) {
+    if (sizeof(off_t) < 8) {
+      ErrorMsg("Offset in '%s' too large; compile with large file support.\n", fname_.c_str());
+      return 1;
+    }
+    val |= ((off_t)hi << 16) << 16;
+  }
+  return 0;
+}
+
+/** Read name (length then characters padded to 4 bytes). */
+int NetcdfHeader::GetName(std::string& name) {
+  unsigned int len;
+  if (GetUint(len)) return 1;
+  size_t padded = ((size_t)len + 3) & ~((size_t)3);
+  if (Fill(padded)) return 1;
+  name.assign( (const char*)&buf_[pos_], len );
+  pos_ += padded;
+  return 0;
+}
+
+/** Skip over an attribute list. */
+int NetcdfHeader::SkipAttributes() {
+  unsigned int tag, nelems;
+  if (GetUint(tag) || GetUint(nelems)) return 1;
+  if (tag == 0) return 0; // ABSENT
+  if (tag != NCTAG_ATTRIBUTE) return 1;
+  std::string name;
+  for (unsigned int i = 0; i != nelems; i++) {
+    unsigned int type, nvals;
+    if (GetName(name) || GetUint(type) || GetUint(nvals)) return 1;
+    unsigned int tsize = TypeSize((int)type);
+    if (tsize == 0) return 1;
+    size_t padded = ((size_t)nvals * tsize + 3) & ~((size_t)3);
+    if (Fill(padded)) return 1;
+    pos_ += padded;
+  }
+  return 0;
+}
+
+/** Parse the header of a CDF-1/CDF-2 file. */
+int NetcdfHeader::ReadHeader() {
+  // Number of records
+  unsigned int numrecs;
+  if (GetUint(numrecs)) return 1;
+  if (numrecs == 0xFFFFFFFF)
+    nrecs_ = -1; // STREAMING
+  else
+    nrecs_ = (long int)numrecs;
+  // Dimensions
+  unsigned int tag, nelems;
+  if (GetUint(tag) || GetUint(nelems)) return 1;
+  if (tag != 0) {
+    if (tag != NCTAG_DIMENSION) return 1;
+    dims_.resize( nelems );
+    for (unsigned int i = 0; i != nelems; i++) {
+      if (GetName(dims_[i].Name) || GetUint(dims_[i].Length)) return 1;
+      if (dims_[i].Length == 0) recDim_ = (int)i;
+    }
+  }
+  // Global attributes
+  if (SkipAttributes()) return 1;
+  // Variables
+  if (GetUint(tag) || GetUint(nelems)) return 1;
+  if (tag != 0) {
+    if (tag != NCTAG_VARIABLE) return 1;
+    vars_.resize( nelems );
+    for (unsigned int i = 0; i != nelems; i++) {
+      Var& var = vars_[i];
+      unsigned int ndims, type, vsize;
+      if (GetName(var.Name) || GetUint(ndims)) return 1;
+      var.DimIds.resize( ndims );
+      for (unsigned int d = 0; d != ndims; d++) {
+        if (GetUint(var.DimIds[d])) return 1;
+        if (var.DimIds[d] >= dims_.size()) return 1;
+      }
+      if (SkipAttributes()) return 1;
+      if (GetUint(type) || GetUint(vsize)) return 1;
+      var.Type = (int)type;
+      var.Vsize = (off_t)vsize;
+      if (GetOffset(var.Begin)) return 1;
+      var.IsRecord = (ndims > 0 && (int)var.DimIds[0] == recDim_);
+    }
+  }
+  // Determine record size and start of record data.
+  unsigned int nRecVars = 0;
+  off_t nonRecEnd = (off_t)pos_;
+  recBegin_ = -1;
+  recSize_ = 0;
+  for (std::vector<Var>::const_iterator var = vars_.begin(); var != vars_.end(); ++var) {
+    if (var->IsRecord) {
+      ++nRecVars;
+      recSize_ += var->Vsize;
+      if (recBegin_ < 0 || var->Begin < recBegin_) recBegin_ = var->Begin;
+    } else if (var->Begin + var->Vsize > nonRecEnd)
+      nonRecEnd = var->Begin + var->Vsize;
+  }
+  if (nRecVars == 1) {
+    // Special case: single record variable is not padded.
+    for (std::vector<Var>::const_iterator var = vars_.begin(); var != vars_.end(); ++var)
+      if (var->IsRecord) {
+        off_t size = TypeSize(var->Type);
+        for (unsigned int d = 1; d < var->DimIds.size(); d++)
+          size *= (off_t)dims_[var->DimIds[d]].Length;
+        recSize_ = size;
+      }
+  }
+  if (recBegin_ < 0) recBegin_ = nonRecEnd;
+  return 0;
+}
+
+/** Open file, determine format, and read header if classic/64-bit offset. */
+int NetcdfHeader::Open(std::string const& fname) {
+  Close();
+  buf_.clear();
+  pos_ = 0;
+  format_ = UNKNOWN_FMT;
+  nrecs_ = 0;
+  recSize_ = 0;
+  recBegin_ = 0;
+  recDim_ = -1;
+  dims_.clear();
+  vars_.clear();
+  fname_ = fname;
+  FILE* infile = fopen(fname.c_str(), "rb");
+  if (infile == 0) {
+    ErrorMsg("Opening file '%s'\n", fname.c_str());
+    return 1;
+  }
+  file_ = (void*)infile;
+  // Determine format from magic number.
+  static const unsigned char HDF5_MAGIC[8] = { 0x89, 'H', 'D', 'F', '\r', '\n', 0x1a, '\n' };
+  if (Fill(4)) return 0;
+  if (buf_[0] == 'C' && buf_[1] == 'D' && buf_[2] == 'F') {
+    if      (buf_[3] == 1) format_ = CDF1;
+    else if (buf_[3] == 2) format_ = CDF2;
+    else if (buf_[3] == 5) format_ = CDF5;
+  } else if (Fill(8) == 0 && memcmp(&buf_[0], HDF5_MAGIC, 8) == 0)
+    format_ = HDF5;
+  if (format_ != CDF1 && format_ != CDF2) return 0;
+  pos_ = 4;
+  if (ReadHeader()) {
+    ErrorMsg("Could not read NetCDF header of '%s'\n", fname.c_str());
+    return 1;
+  }
+  return 0;
+}
+
+NetcdfHeader::Var const* NetcdfHeader::FindVar(const char* name) const {
+  for (std::vector<Var>::const_iterator var = vars_.begin(); var != vars_.end(); ++var)
+    if (var->Name == name) return &(*var);
+  return 0;
+}
+
+NetcdfHeader::Dim const* NetcdfHeader::FindDim(const char* name) const {
+  for (std::vector<Dim>::const_iterator dim = dims_.begin(); dim != dims_.end(); ++dim)
+    if (dim->Name == name) return &(*dim);
+  return 0;
+}
+
+long int NetcdfHeader::DimLength(const char* name) const {
+  Dim const* dim = FindDim( name );
+  if (dim == 0) return -1;
+  if ((int)(dim - &dims_[0]) == recDim_) return nrecs_;
+  return (long int)dim->Length;
+}
+
+/** Read count elements starting at element start from a non-record variable,
+  * converting to double.
+  */
+int NetcdfHeader::GetVarDouble(const char* name, unsigned int start, unsigned int count,
+                               double* out)
+{
+  return ReadDouble(name, -1, start, count, out);
+}
+
+/** Read count elements starting at element start (within the record) from
+  * record rec of a record variable, converting to double.
+  */
+int NetcdfHeader::GetRecordDouble(const char* name, long int rec, unsigned int start,
+                                  unsigned int count, double* out)
+{
+  if (rec < 0 || (nrecs_ > -1 && rec >= nrecs_)) {
+    ErrorMsg("Record %li of variable '%s' not present in '%s'\n", rec, name, fname_.c_str());
+    return 1;
+  }
+  return ReadDouble(name, rec, start, count, out);
+}
+
+/** Read count elements starting at element start from a variable, from
+  * record rec if rec > -1, converting to double.
+  */
+int NetcdfHeader::ReadDouble(const char* name, long int rec, unsigned int start,
+                             unsigned int count, double* out)
+{
+  if (file_ == 0) return 1;
+  if (count == 0) return 0;
+  Var const* var = FindVar( name );
+  if (var == 0) {
+    ErrorMsg("Variable '%s' not present in '%s'\n", name, fname_.c_str());
+    return 1;
+  }
+  if (var->IsRecord != (rec > -1)) {
+    if (var->IsRecord)
+      ErrorMsg("Variable '%s' in '%s' is a record variable.\n", name, fname_.c_str());
+    else
+      ErrorMsg("Variable '%s' in '%s' is not a record variable.\n", name, fname_.c_str());
+    return 1;
+  }
+  unsigned int tsize = TypeSize( var->Type );
+  if (var->Type != NCTYPE_FLOAT && var->Type != NCTYPE_DOUBLE) {
+    ErrorMsg("Variable '%s' in '%s' is not floating point.\n", name, fname_.c_str());
+    return 1;
+  }
+  // Elements in the variable, or in one record of it.
+  unsigned long int nelems = 1;
+  for (unsigned int d = (var->IsRecord ? 1 : 0); d < var->DimIds.size(); d++)
+    nelems *= dims_[var->DimIds[d]].Length;
+  if ((unsigned long int)start + count > nelems) {
+    ErrorMsg("Reading past end of variable '%s' in '%s'\n", name, fname_.c_str());
+    return 1;
+  }
+  off_t offset = var->Begin + (off_t)start * tsize;
+  if (rec > 0) offset += (off_t)rec * recSize_;
+  std::vector<unsigned char> data( (size_t)count * tsize );
+  if (fseeko((FILE*)file_, offset, SEEK_SET) != 0 ||
+      fread(&data[0], tsize, count, (FILE*)file_) != count)
+  {
+    ErrorMsg("Reading variable '%s' from '%s'\n", name, fname_.c_str());
+    return 1;
+  }
+  unsigned char* ptr = &data[0];
+  for (unsigned int i = 0; i != count; i++, ptr += tsize) {
+    FromBigEndian(ptr, tsize);
+    if (var->Type == NCTYPE_DOUBLE)
+      memcpy(out + i, ptr, 8);
+    else {
+      float fval;
+      memcpy(&fval, ptr, 4);
+      out[i] = (double)fval;
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,84 @@
+#ifndef INC_NETCDFHEADER_H
+#define INC_NETCDFHEADER_H
+#include <string>
+#include <vector>
+#include <sys/types.h> // off_t
+/// Native reader for NetCDF classic (CDF-1) and 64-bit offset (CDF-2) files.
+/** Only the header is parsed, which is enough to get dimension lengths,
+  * number of records, and the size/location of each variable. Values of
+  * non-record variables and of single records of record variables can
+  * also be read. NetCDF4/HDF5 files are only
+  * identified; they must be read with the NetCDF library.
+  */
+class NetcdfHeader {
+  public:
+    enum FormatType { UNKNOWN_FMT = 0, CDF1, CDF2, CDF5, HDF5 };
+    /// Hold dimension info.
+    struct Dim {
+      std::string Name;
+      unsigned int Length; ///< Dimension length; 0 indicates record dimension.
+    };
+    /// Hold variable info.
+    struct Var {
+      std::string Name;
+      std::vector<unsigned int> DimIds; ///< Dimension IDs, slowest varying first.
+      int Type;                         ///< NetCDF external data type.
+      off_t Vsize;                      ///< Size in bytes (per record if record variable).
+      off_t Begin;                      ///< File offset of data.
+      bool IsRecord;                    ///< True if first dimension is record dimension.
+    };
+
+    NetcdfHeader();
+    ~NetcdfHeader();
+    /// Open file and read header. File stays open for reading variables.
+    int Open(std::string const&);
+    /// Close file.
+    void Close();
+    /// Read the given range of elements from a non-record variable as double.
+    int GetVarDouble(const char*, unsigned int, unsigned int, double*);
+    /// Read the given range of elements of the given record of a record variable as double.
+    int GetRecordDouble(const char*, long int, unsigned int, unsigned int, double*);
+    /// \return Variable with given name, 0 if not present.
+    Var const* FindVar(const char*) const;
+    /// \return true if variable with given name is present.
+    bool HasVar(const char* name) const { return (FindVar(name) != 0); }
+    /// \return Dimension with given name, 0 if not present.
+    Dim const* FindDim(const char*) const;
+    /// \return Length of dimension with given name (# records if record dim), -1 if not present.
+    long int DimLength(const char*) const;
+
+    FormatType Format()  const { return format_;  }
+    /// \return # records, -1 if number of records is indeterminate (streaming).
+    long int Nrecs()     const { return nrecs_;   }
+    /// \return Size in bytes of one record (all record variables).
+    off_t RecSize()      const { return recSize_; }
+    /// \return Offset of first record, or end of non-record data if no record vars.
+    off_t RecBegin()     const { return recBegin_; }
+    /// \return Size in bytes of header.
+    off_t HeaderSize()   const { return (off_t)pos_; }
+    std::vector<Var> const& Vars() const { return vars_; }
+    std::string const& Filename() const { return fname_; }
+    /// \return Size in bytes of given NetCDF external type, 0 if unknown.
+    static unsigned int TypeSize(int);
+  private:
+    int ReadHeader();
+    int Fill(size_t);
+    int GetUint(unsigned int&);
+    int GetOffset(off_t&);
+    int GetName(std::string&);
+    int SkipAttributes();
+    int ReadDouble(const char*, long int, unsigned int, unsigned int, double*);
+
+    std::vector<unsigned char> buf_; ///< Header bytes read so far.
+    size_t pos_;                     ///< Current parse position in buf_.
+    void* file_;                     ///< File pointer.
+    std::string fname_;              ///< File name.
+    FormatType format_;              ///< File format.
+    long int nrecs_;                 ///< Number of records.
+    off_t recSize_;                  ///< Size of a single record.
+    off_t recBegin_;                 ///< Offset of first record.
+    int recDim_;                     ///< Index of record dimension, -1 if none.
+    std::vector<Dim> dims_;          ///< Dimensions.
+    std::vector<Var> vars_;          ///< Variables.
+};
+#endif
@@ -0,0 +1,184 @@
+#include <algorithm> // std::sort
+#include "PerfReport.h"
+#include "Messages.h"
+#include "MdoutHeader.h"
+#include "MdoutTiming.h"
+
+/// Max # of slowest replicas to list.
+static const unsigned int NSLOWEST = 5;
+
+/// Hold timing for a single replica of a run.
+struct RepTiming {
+  MdoutTiming Timing;
+  int Numexchg; ///< # exchanges (0 for MD, -1 if control section not read).
+  int Err;      ///< Non-zero if output could not be fully read.
+};
+
+/// Hold timing of a replica relative to the run mean, for ranking.
+struct SlowRep {
+  double Ratio;
+  unsigned int Rep;
+  bool operator<(SlowRep const& rhs) const {
+    if (Ratio == rhs.Ratio) return (Rep < rhs.Rep);
+    return (Ratio > rhs.Ratio);
+  }
+};
+
+/// Hold timing of a replica over all runs.
+struct RepSummary {
+  double SumRatio; ///< Sum of elapsed time / run mean elapsed time.
+  double MaxRatio; ///< Max elapsed time / run mean elapsed time.
+  int Nruns;       ///< # of runs with timing.
+};
+
+/** \return Extension of output file name, i.e. what follows the prefix. */
+static inline std::string RepExt(std::string const& name, std::string const& prefix) {
+  size_t found = name.rfind( prefix );
+  if (found == std::string::npos) return std::string("");
+  return name.substr( found + prefix.size() );
+}
+
+/** Read timings from output (and logfile, if present) of each replica in
+  * each run. Report ns/day, time per exchange, and MD/communication split
+  * for each replica, then imbalance between replicas: since every replica
+  * waits for the slowest at each exchange, time lost is estimated as
+  * 1 - mean/max of the elapsed times. Replicas that are slow in every run
+  * point to the system (e.g. topology too large for its rank count),
+  * replicas that are slow in one run point to the node they ran on.
+  * A replica whose output cannot be read uses the logfile timings if
+  * present, otherwise it is left out of the statistics.
+  */
+int PerfReport(std::string const& TopDir, StrArray const& RunDirs) {
+  Msg("Performance report:\n");
+  std::vector<RepSummary> Summary;
+  int NrunsRead = 0;
+  for (StrArray::const_iterator rdir = RunDirs.begin(); rdir != RunDirs.end(); ++rdir) {
+    std::string runPath( TopDir + "/" + *rdir );
+    if (!fileExists( runPath )) {
+      Msg("  %s: Does not exist.\n", rdir->c_str());
+      continue;
+    }
+    std::string prefix("rem.out.");
+    StrArray OutputFiles = ExpandToFilenames(runPath + "/OUTPUT/rem.out.*");
+    if (OutputFiles.empty()) {
+      prefix.assign("md.out.");
+      OutputFiles = ExpandToFilenames(runPath + "/md.out.*");
+    }
+    if (OutputFiles.empty()) {
+      Msg("  %s: Output files not found.\n", rdir->c_str());
+      continue;
+    }
+    std::vector<RepTiming> Reps( OutputFiles.size() );
+    int nfiles = (int)OutputFiles.size();
+    int idx;
+#   ifdef _OPENMP
+#   pragma omp parallel for schedule(dynamic)
+#   endif
+    for (idx = 0; idx < nfiles; idx++) {
+      RepTiming& rep = Reps[idx];
+      MdoutHeader mdout;
+      rep.Err = mdout.Read( OutputFiles[idx] );
+      rep.Numexchg = (rep.Err == 0) ? mdout.Numexchg() : -1;
+      if (rep.Timing.Read( OutputFiles[idx] )) rep.Err = 1;
+      // Fill in anything missing from the logfile, e.g. if mdout was cut off.
+      if (prefix == "rem.out.") {
+        std::string logName( runPath + "/LOG/logfile." + RepExt(OutputFiles[idx], prefix) );
+        if (fileExists( logName )) {
+          MdoutTiming logTiming;
+          if (logTiming.Read( logName ) == 0)
+            rep.Timing.Merge( logTiming );
+        }
+      }
+    }
+    // Report each replica and determine mean elapsed time.
+    Msg("  %s: %zu replicas\n", rdir->c_str(), Reps.size());
+    Msg("    %-6s %10s %12s %12s %12s %10s %7s\n", "#Rep", "ns/day", "Elapsed(s)",
+        "s/Exchange", "MD(s)", "Comm(s)", "Comm%");
+    double sumElapsed = 0.0;
+    double minElapsed = 0.0;
+    double maxElapsed = 0.0;
+    unsigned int maxRep = 0;
+    int Ntimed = 0;
+    for (unsigned int rep = 0; rep != Reps.size(); rep++) {
+      MdoutTiming const& timing = Reps[rep].Timing;
+      if (!timing.Found()) {
+        if (Reps[rep].Err != 0)
+          Msg("    %6u  Output could not be read; timing unavailable.\n", rep + 1);
+        else
+          Msg("    %6u  No timing info (run incomplete?)\n", rep + 1);
+        continue;
+      }
+      Msg("    %6u %10.2f %12.2f", rep + 1, timing.NsPerDay(), timing.Elapsed());
+      if (Reps[rep].Numexchg > 0)
+        Msg(" %12.4f", timing.Elapsed() / (double)Reps[rep].Numexchg);
+      else if (Reps[rep].Numexchg == 0)
+        Msg(" %12.4f", timing.Elapsed());
+      else
+        Msg(" %12s", "-");
+      if (timing.RoutineTotal() > 0.0) {
+        double comm = (timing.CommTime() > 0.0) ? timing.CommTime() : 0.0;
+        Msg(" %12.2f %10.2f %7.2f\n", timing.RoutineTotal() - comm, comm,
+            100.0 * comm / timing.RoutineTotal());
+      } else
+        Msg(" %12s %10s %7s\n", "-", "-", "-");
+      if (Ntimed == 0 || timing.Elapsed() < minElapsed) minElapsed = timing.Elapsed();
+      if (Ntimed == 0 || timing.Elapsed() > maxElapsed) {
+        maxElapsed = timing.Elapsed();
+        maxRep = rep;
+      }
+      sumElapsed += timing.Elapsed();
+      ++Ntimed;
+    }
+    if (Ntimed < 1) continue;
+    ++NrunsRead;
+    double meanElapsed = sumElapsed / (double)Ntimed;
+    Msg("    Elapsed: min %.2f s, mean %.2f s, max %.2f s (replica %u)\n",
+        minElapsed, meanElapsed, maxElapsed, maxRep + 1);
+    Msg("    Imbalance: max/mean %.3f, max/min %.3f, %.1f%% of time waiting on slowest.\n",
+        maxElapsed / meanElapsed, maxElapsed / minElapsed,
+        100.0 * (1.0 - meanElapsed / maxElapsed));
+    // Rank replicas by elapsed time relative to the mean.
+    if (Summary.size() < Reps.size()) {
+      RepSummary empty;
+      empty.SumRatio = 0.0;
+      empty.MaxRatio = 0.0;
+      empty.Nruns = 0;
+      Summary.resize( Reps.size(), empty );
+    }
+    std::vector<SlowRep> Slow;
+    for (unsigned int rep = 0; rep != Reps.size(); rep++) {
+      if (!Reps[rep].Timing.Found()) continue;
+      SlowRep slow;
+      slow.Ratio = Reps[rep].Timing.Elapsed() / meanElapsed;
+      slow.Rep = rep;
+      Slow.push_back( slow );
+      RepSummary& sum = Summary[rep];
+      sum.SumRatio += slow.Ratio;
+      if (slow.Ratio > sum.MaxRatio) sum.MaxRatio = slow.Ratio;
+      sum.Nruns++;
+    }
+    std::sort( Slow.begin(), Slow.end() );
+    Msg("    Slowest (elapsed/mean):");
+    for (unsigned int i = 0; i != Slow.size() && i != NSLOWEST; i++)
+      Msg(" %u (%.3f)", Slow[i].Rep + 1, Slow[i].Ratio);
+    Msg("\n");
+  }
+  if (NrunsRead < 2) return 0;
+  // Replicas slow across all runs.
+  std::vector<SlowRep> Slow;
+  for (unsigned int rep = 0; rep != Summary.size(); rep++) {
+    if (Summary[rep].Nruns < 1) continue;
+    SlowRep slow;
+    slow.Ratio = Summary[rep].SumRatio / (double)Summary[rep].Nruns;
+    slow.Rep = rep;
+    Slow.push_back( slow );
+  }
+  std::sort( Slow.begin(), Slow.end() );
+  Msg("  Slowest replicas over %i runs:\n", NrunsRead);
+  Msg("    %-6s %10s %10s %6s\n", "#Rep", "MeanRatio", "MaxRatio", "Runs");
+  for (unsigned int i = 0; i != Slow.size() && i != NSLOWEST; i++) {
+    RepSummary const& sum = Summary[Slow[i].Rep];
+    Msg("    %6u %10.3f %10.3f %6i\n", Slow[i].Rep + 1, Slow[i].Ratio, sum.MaxRatio, sum.Nruns);
+  }
+  return 0;
+}
@@ -0,0 +1,5 @@
+#ifndef INC_PERFREPORT_H
+#define INC_PERFREPORT_H
+#include "FileRoutines.h"
+int PerfReport(std::string const&, StrArray const&);
+#endif
@@ -0,0 +1,326 @@
+#include <cstdio>  // sscanf
+#include <cstdlib> // strtol, strtod
+#include <cstring> // strncmp, strstr
+#include <cmath>   // fabs
+#include <algorithm> // std::sort
+#include "RemLogStats.h"
+#include "Messages.h"
+#include "TextFile.h"
+
+RemLogStats::RemLogStats() :
+  nexch_(0),
+  lostAt_(-1),
+  nreps_(0),
+  nread_(0)
+{}
+
+/** Set up for given number of replicas. If replica values are given the
+  * position of each replica is determined from the value in the log.
+  */
+int RemLogStats::Setup(unsigned int nreps, std::vector<double> const& values) {
+  if (nreps < 2) {
+    ErrorMsg("At least 2 replicas required for exchange statistics.\n");
+    return 1;
+  }
+  if (!values.empty() && values.size() != nreps) {
+    ErrorMsg("# replica values %zu != # replicas %u\n", values.size(), nreps);
+    return 1;
+  }
+  nreps_ = nreps;
+  values_ = values;
+  nexch_ = 0;
+  lostAt_ = -1;
+  nread_ = 0;
+  lines_.resize( nreps_ );
+  pending_.clear();
+  walkerAt_.resize( nreps_ );
+  walkers_.resize( nreps_ );
+  for (unsigned int idx = 0; idx != nreps_; idx++) {
+    walkerAt_[idx] = (int)idx;
+    walkers_[idx].LastEnd = -1;
+    walkers_[idx].BottomTime = -1;
+    walkers_[idx].Ntrips = 0;
+    walkers_[idx].TripTime = 0;
+  }
+  pairs_.clear();
+  return 0;
+}
+
+/** \return Position of replica with given value, -1 if no match. */
+int RemLogStats::FindPosition(double val) const {
+  int pos = -1;
+  double minDelta = 0.0;
+  for (unsigned int idx = 0; idx != values_.size(); idx++) {
+    double delta = fabs(values_[idx] - val);
+    if (pos == -1 || delta < minDelta) {
+      pos = (int)idx;
+      minDelta = delta;
+    }
+  }
+  // Values are printed with 2 decimal places in the log.
+  if (minDelta > 0.01) return -1;
+  return pos;
+}
+
+/** Parse data line. The layout depends on the type of exchange:
+  *   T-REMD: <Rep#> <Neibr#> <Temp0> <PotE> <Temp> <VelScale> <SuccessRate> <ResStruct#>
+  *   H-REMD: <Rep#> <Neibr#> <Temp0> <PotE(x_1)> <PotE(x_2)> <left_fe> <right_fe> <T|F> ...
+  * For T-REMD Success is not set here; it is determined in EndExchange().
+  * \return 0 if line was parsed.
+  */
+int RemLogStats::ParseLine(const char* ptr, int& rep, Line& line) const {
+  char* end = 0;
+  rep = (int)strtol(ptr, &end, 10) - 1;
+  if (end == ptr) return 1;
+  ptr = end;
+  line.Neighbor = (int)strtol(ptr, &end, 10) - 1;
+  if (end == ptr) return 1;
+  ptr = end;
+  line.Success = false;
+  if (!values_.empty()) {
+    double val = strtod(ptr, &end);
+    if (end == ptr) return 1;
+    line.Position = FindPosition( val );
+    if (line.Position < 0) return 1;
+    return 0;
+  }
+  line.Position = rep;
+  // Exchange success is the first single character T or F token.
+  for (;;) {
+    while (*ptr == ' ' || *ptr == '\t') ++ptr;
+    if (*ptr == '\0' || *ptr == '\n' || *ptr == '\r') return 1;
+    const char* tok = ptr;
+    while (*ptr != '\0' && *ptr != ' ' && *ptr != '\t' && *ptr != '\n' && *ptr != '\r') ++ptr;
+    if (ptr - tok == 1 && (*tok == 'T' || *tok == 'F')) {
+      line.Success = (*tok == 'T');
+      return 0;
+    }
+  }
+  return 1;
+}
+
+/** Record that coordinate set is at given position for the current exchange. */
+void RemLogStats::VisitPosition(int widx, int pos) {
+  if (lostAt_ > -1) return;
+  Walker& walker = walkers_[widx];
+  if (pos == 0 && walker.LastEnd != 0) {
+    if (walker.LastEnd == 1 && walker.BottomTime > -1) {
+      walker.Ntrips++;
+      walker.TripTime += nexch_ - walker.BottomTime;
+    }
+    walker.BottomTime = nexch_;
+    walker.LastEnd = 0;
+  } else if (pos == (int)nreps_ - 1 && walker.LastEnd != 1)
+    walker.LastEnd = 1;
+}
+
+/** Count attempted/accepted exchanges between neighbor positions. Only
+  * pairs where both replicas name each other as neighbor are counted; each
+  * pair is counted once, from the lower position.
+  */
+void RemLogStats::AddPairs(std::vector<Line> const& lines) {
+  for (unsigned int rep = 0; rep != nreps_; rep++) {
+    Line const& line = lines[rep];
+    if (line.Neighbor < 0 || line.Neighbor >= (int)nreps_ || line.Neighbor == (int)rep)
+      continue;
+    if (lines[line.Neighbor].Neighbor != (int)rep) continue;
+    int nbrPos = lines[line.Neighbor].Position;
+    if (line.Position >= nbrPos) continue;
+    PairMap::iterator it = pairs_.find( Ipair(line.Position, nbrPos) );
+    if (it == pairs_.end()) {
+      PairStat stat;
+      stat.Attempts = 0;
+      stat.Accepted = 0;
+      it = pairs_.insert( PairMap::value_type(Ipair(line.Position, nbrPos), stat) ).first;
+    }
+    it->second.Attempts++;
+    if (line.Success) {
+      it->second.Accepted++;
+      // Coordinates move with a successful exchange.
+      if (values_.empty()) {
+        int tmp = walkerAt_[line.Position];
+        walkerAt_[line.Position] = walkerAt_[nbrPos];
+        walkerAt_[nbrPos] = tmp;
+      }
+    }
+  }
+}
+
+/** Accumulate statistics for the exchange just read. Temp0 in a T-REMD log
+  * is the value before the exchange, so the previous exchange succeeded if
+  * a replica now has the value its neighbor had. The outcome of the last
+  * exchange read is not known until the next exchange (which may be in the
+  * log of the next run) and is not counted before then.
+  */
+void RemLogStats::EndExchange() {
+  // Positions of each coordinate set before exchange.
+  if (values_.empty()) {
+    for (unsigned int pos = 0; pos != nreps_; pos++)
+      VisitPosition( walkerAt_[pos], pos );
+    AddPairs( lines_ );
+  } else {
+    if (!pending_.empty()) {
+      for (unsigned int rep = 0; rep != nreps_; rep++) {
+        Line& prev = pending_[rep];
+        prev.Success = (prev.Neighbor > -1 && prev.Neighbor < (int)nreps_ &&
+                        lines_[rep].Position == pending_[prev.Neighbor].Position);
+      }
+      AddPairs( pending_ );
+    }
+    for (unsigned int rep = 0; rep != nreps_; rep++)
+      VisitPosition( rep, lines_[rep].Position );
+    pending_ = lines_;
+  }
+  ++nexch_;
+}
+
+/** Exchanges across a gap in the logs are unknown. A T-REMD exchange waiting
+  * for its outcome is dropped and round trips in progress are restarted.
+  * Coordinate sets that move between replicas cannot be followed across a
+  * gap, so round trips are no longer counted for them.
+  */
+void RemLogStats::Break() {
+  pending_.clear();
+  if (values_.empty()) {
+    if (lostAt_ < 0) lostAt_ = nexch_;
+    return;
+  }
+  for (std::vector<Walker>::iterator walker = walkers_.begin(); walker != walkers_.end(); ++walker)
+  {
+    walker->LastEnd = -1;
+    walker->BottomTime = -1;
+  }
+}
+
+/** Stream the given rem.log. Only the exchange currently being read is
+  * stored. An incomplete final exchange (e.g. from a run that did not
+  * finish) is ignored.
+  */
+int RemLogStats::Read(std::string const& fname) {
+  TextFile infile;
+  if (infile.OpenRead( fname )) return 1;
+  bool inExchange = false;
+  bool hasNeighbor = false;
+  bool hasSuccess = false;
+  long int lineNum = 0;
+  const char* buffer;
+  while ( (buffer = infile.Gets()) != 0 ) {
+    ++lineNum;
+    if (buffer[0] == '#') {
+      if (strncmp(buffer, "# Rep#", 6) == 0) {
+        hasNeighbor = (strstr(buffer, "Neibr#") != 0);
+        // Only logs where coordinates move have a T/F success column.
+        hasSuccess = (strstr(buffer, " Success,") != 0);
+      } else if (strncmp(buffer, "# exchange", 10) == 0) {
+        if (inExchange && nread_ == nreps_) EndExchange();
+        if (!hasNeighbor) {
+          ErrorMsg("'%s': Unsupported rem.log format; expected 'Neibr#' in legend.\n",
+                   fname.c_str());
+          return 1;
+        }
+        if (values_.empty() && !hasSuccess) {
+          ErrorMsg("'%s': Expected 'Success' column in legend; not a Hamiltonian REMD log.\n",
+                   fname.c_str());
+          return 1;
+        }
+        inExchange = true;
+        nread_ = 0;
+      }
+      continue;
+    }
+    if (!inExchange) continue;
+    int rep;
+    Line line;
+    if (ParseLine( buffer, rep, line )) {
+      // Blank lines are ignored.
+      const char* ptr = buffer;
+      while (*ptr == ' ' || *ptr == '\t' || *ptr == '\n' || *ptr == '\r') ++ptr;
+      if (*ptr == '\0') continue;
+      ErrorMsg("Could not parse line %li in '%s'\n", lineNum, fname.c_str());
+      return 1;
+    }
+    if (rep < 0 || rep >= (int)nreps_) {
+      ErrorMsg("Replica %i on line %li in '%s' is out of range (%u replicas).\n",
+               rep + 1, lineNum, fname.c_str(), nreps_);
+      return 1;
+    }
+    lines_[rep] = line;
+    ++nread_;
+  }
+  if (inExchange) {
+    if (nread_ == nreps_)
+      EndExchange();
+    else
+      Msg("Warning: Incomplete last exchange in '%s' ignored.\n", fname.c_str());
+  }
+  return 0;
+}
+
+/** \return 0 if the neighbor pair (pos, pos+1) was attempted, 1 otherwise. */
+int RemLogStats::NeighborCounts(unsigned int pos, long int& attempts, long int& accepted) const
+{
+  PairMap::const_iterator it = pairs_.find( Ipair((int)pos, (int)pos + 1) );
+  if (it == pairs_.end() || it->second.Attempts < 1) return 1;
+  attempts = it->second.Attempts;
+  accepted = it->second.Accepted;
+  return 0;
+}
+
+/** Values are read from the third (Temp0) column of the first exchange
+  * (present in both T-REMD and H-REMD logs) and returned in ascending order.
+  */
+int RemLogStats::ReadValues(std::string const& fname, std::vector<double>& values) {
+  values.clear();
+  TextFile infile;
+  if (infile.OpenRead( fname )) return 1;
+  int nexch = 0;
+  const char* buffer;
+  while ( (buffer = infile.Gets()) != 0 ) {
+    if (buffer[0] == '#') {
+      if (strncmp(buffer, "# exchange", 10) == 0 && ++nexch > 1) break;
+      continue;
+    }
+    if (nexch < 1) continue;
+    int rep, nbr;
+    double val;
+    if (sscanf(buffer, "%i %i %lf", &rep, &nbr, &val) == 3)
+      values.push_back( val );
+  }
+  infile.Close();
+  if (values.size() < 2) {
+    ErrorMsg("Could not read replica values from '%s'\n", fname.c_str());
+    return 1;
+  }
+  std::sort( values.begin(), values.end() );
+  return 0;
+}
+
+/** Print neighbor acceptance ratios and round trips of each coordinate set. */
+void RemLogStats::Print(std::vector<std::string> const& labels, double psPerExch) const {
+  Msg("  %u replicas, %li exchanges (%g ps per exchange).\n", nreps_, nexch_, psPerExch);
+  Msg("  Neighbor acceptance:\n");
+  Msg("    %-11s %-31s %10s %10s %8s\n", "#Pair", "Values", "Attempts", "Accepted", "Ratio");
+  for (PairMap::const_iterator it = pairs_.begin(); it != pairs_.end(); ++it) {
+    std::string values = labels[it->first.first] + " - " + labels[it->first.second];
+    double ratio = 0.0;
+    if (it->second.Attempts > 0)
+      ratio = (double)it->second.Accepted / (double)it->second.Attempts;
+    Msg("    %5i-%-5i %-31s %10li %10li %8.4f\n", it->first.first + 1, it->first.second + 1,
+        values.c_str(), it->second.Attempts, it->second.Accepted, ratio);
+  }
+  if (lostAt_ > -1)
+    Msg("  Warning: Coordinates cannot be followed across a missing log; round trips\n"
+        "  Warning: are only counted for the first %li exchanges.\n", lostAt_);
+  if (values_.empty())
+    Msg("  Round trips (coordinates by starting position):\n");
+  else
+    Msg("  Round trips (by replica):\n");
+  Msg("    %-8s %10s %14s %14s\n", "#Replica", "RoundTrips", "AvgTime(exch)", "AvgTime(ps)");
+  for (unsigned int idx = 0; idx != walkers_.size(); idx++) {
+    Walker const& walker = walkers_[idx];
+    double avg = 0.0;
+    if (walker.Ntrips > 0)
+      avg = (double)walker.TripTime / (double)walker.Ntrips;
+    Msg("    %8u %10li %14.2f %14.2f\n", idx + 1, walker.Ntrips, avg, avg * psPerExch);
+  }
+}
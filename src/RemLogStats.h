@@ -0,0 +1,76 @@
+#ifndef INC_REMLOGSTATS_H
+#define INC_REMLOGSTATS_H
+#include <string>
+#include <vector>
+#include <map>
+/// Accumulate replica exchange statistics from Amber (pmemd) rem.log files.
+/** Logs are streamed one line at a time so memory use only depends on the
+  * number of replicas. Statistics accumulate over all logs read, so logs
+  * from consecutive runs should be read in order. Two kinds of exchange are
+  * handled:
+  *   - Coordinates stay with the replica and the exchanged value (e.g.
+  *     temperature) moves; the position (index into the replica value
+  *     list) of each replica is determined from the Temp0 value in the log.
+  *     T-REMD logs have no success column, so the outcome of an exchange
+  *     is determined from the change in Temp0 at the next exchange.
+  *   - Coordinates move between replicas (e.g. Hamiltonian); the position
+  *     of each coordinate set is tracked from successful exchanges, read
+  *     from the T/F success column.
+  */
+class RemLogStats {
+  public:
+    RemLogStats();
+    /// Set up for # replicas. If values are given, coordinates stay with replicas.
+    int Setup(unsigned int, std::vector<double> const&);
+    /// Read statistics from given rem.log.
+    int Read(std::string const&);
+    /// Mark a gap in the logs, e.g. a missing rem.log.
+    void Break();
+    /// Print statistics; labels for each replica position, ps per exchange.
+    void Print(std::vector<std::string> const&, double) const;
+    /// \return Number of exchanges read.
+    long int Nexchanges() const { return nexch_; }
+    /// Get attempts/accepted for neighbor pair at positions (pos, pos+1). \return 1 if none.
+    int NeighborCounts(unsigned int, long int&, long int&) const;
+    /// Read sorted replica values (Temp0 column) from first exchange of a rem.log.
+    static int ReadValues(std::string const&, std::vector<double>&);
+  private:
+    /// Hold acceptance for a pair of replica positions.
+    struct PairStat {
+      long int Attempts;
+      long int Accepted;
+    };
+    typedef std::pair<int, int> Ipair;
+    typedef std::map<Ipair, PairStat> PairMap;
+    /// Hold round trip info for a coordinate set.
+    struct Walker {
+      int LastEnd;         ///< Last end visited: -1 none, 0 bottom, 1 top.
+      long int BottomTime; ///< Exchange at which bottom was last reached.
+      long int Ntrips;     ///< # completed bottom->top->bottom round trips.
+      long int TripTime;   ///< Total # exchanges for completed round trips.
+    };
+    /// Hold exchange info for a replica from a single log line.
+    struct Line {
+      int Neighbor;  ///< Neighbor replica (from 0), -1 if none.
+      int Position;  ///< Position of replica.
+      bool Success;  ///< True if exchange was accepted.
+    };
+
+    int FindPosition(double) const;
+    int ParseLine(const char*, int&, Line&) const;
+    void AddPairs(std::vector<Line> const&);
+    void EndExchange();
+    void VisitPosition(int, int);
+
+    std::vector<double> values_;  ///< Replica values if coordinates stay with replicas.
+    std::vector<Line> lines_;     ///< Exchange info for each replica in current exchange.
+    std::vector<Line> pending_;   ///< T-REMD exchange waiting for outcome from next exchange.
+    std::vector<int> walkerAt_;   ///< Coordinate set at each position.
+    std::vector<Walker> walkers_; ///< Round trip info for each coordinate set.
+    PairMap pairs_;               ///< Acceptance for each pair of positions.
+    long int nexch_;              ///< Total # exchanges read.
+    long int lostAt_;             ///< Exchange after which coordinates could not be followed, -1 if none.
+    unsigned int nreps_;          ///< # replicas.
+    unsigned int nread_;          ///< # replicas read in current exchange.
+};
+#endif
@@ -1,9 +1,16 @@
 #include <cstring> // strstr
 #include <cstdlib> // atoi, atof
+#include <set>
+#include <algorithm> // std::sort
+#include <sys/stat.h>
 #include "RemdDirs.h"
 #include "Messages.h"
 #include "TextFile.h"
 #include "StringRoutines.h"
+#include "RemLogStats.h"
+#include "InputStore.h"
+#include "RunPlan.h"
+#include "NetcdfHeader.h"
 
 RemdDirs::RemdDirs() :
   nstlim_(-1),
@@ -20,7 +27,13 @@ RemdDirs::RemdDirs() :
   umbrella_(0),
   override_irest_(false),
   override_ntx_(false),
-  uselog_(true)
+  uselog_(true),
+  dedup_(false),
+  archiveExec_(false),
+  archiveSinglePass_(false),
+  archiveParallel_(1),
+  analyzeThreads_(0),
+  analyzeMemory_(0)
 {}
 
 // DESTRUCTOR
@@ -37,13 +50,29 @@ void RemdDirs::OptHelp() {
   for (ReplicaAllocator::Token const* ptr = ReplicaAllocator::AllocArray;
                                       ptr->Key != 0; ++ptr)
     Msg(" %s", ptr->Key);
-Msg("\n  TRAJOUTARGS <args> : Additional trajectory output args for analysis (--analyze).\n"
+Msg("\n  GRID <file>        : File listing replica grid points to use (default all), one\n"
+      "                       per line with a 1-based index for each dimension.\n"
+      "  TRAJOUTARGS <args> : Additional trajectory output args for analysis (--analyze).\n"
       "  FULLARCHIVE <arg>  : Comma-separated list of members to fully archive or NONE.\n"
+      "  ARCHIVE_EXEC {yes|no}: yes: archive script writes archives with built-in\n"
+      "                       '--archive-exec'. no (default): use tar.\n"
+      "  ANALYZE_THREADS <n>: Threads of analysis job. If enough for more than one\n"
+      "                       ensemble, runs are analyzed in concurrent chunks (as many\n"
+      "                       at once as the analysis job THREADS allow; concurrent\n"
+      "                       MPI jobs need $NP in MPIRUN).\n"
+      "  ANALYZE_MEMORY <size>: Memory of analysis job (e.g. 64G). Runs are analyzed in\n"
+      "                       chunks estimated to fit.\n"
+      "  ARCHIVE_PARALLEL <n>: Archive up to <n> runs at once (default 1), limited by\n"
+      "                       archive job THREADS. Concurrent MPI jobs need $NP in MPIRUN.\n"
+      "  ARCHIVE_SINGLE_PASS {yes|no}: yes: write full and stripped archive trajectories\n"
+      "                       in one cpptraj run. no (default): separate runs.\n"
       "  TOPOLOGY <file>    : Topology for 1D TREMD run.\n"
       "  MDIN_FILE <file>   : File containing extra MDIN input.\n"
       "  RST_FILE <file>    : File containing NMR restraints (MD only).\n"
       "  CPIN_FILE <file>   : CPIN file (constant pH only).\n"
       "  USELOG {yes|no}    : yes (default): use logfile (pmemd), otherwise do not (sander).\n"
+      "  DEDUP {yes|no}     : yes: store identical input files once and hard link them into\n"
+      "                       run dirs. no (default): write each file.\n"
       "  TEMPERATURE <T>    : Temperature for 1D HREMD run.\n"
       "  NSTLIM <nstlim>    : Input file; steps per exchange. Required.\n"
       "  DT <step>          : Input file; time step. Required.\n"
@@ -79,6 +108,11 @@ int RemdDirs::ReadOptions(std::string const& input_file, int start) {
         if (CheckExists("Dimension file", VAR)) { return 1; }
         if (LoadDimension( tildeExpansion(VAR) )) { return 1; }
       }
+      else if (OPT == "GRID")
+      {
+        if (CheckExists("Grid file", VAR)) { return 1; }
+        grid_file_ = tildeExpansion( VAR );
+      }
       else if (OPT == "MDRUNS")
         n_md_runs_ = atoi( VAR.c_str() );
       else if (OPT == "NSTLIM")
@@ -91,6 +125,24 @@ int RemdDirs::ReadOptions(std::string const& input_file, int start) {
         numexchg_ = atoi( VAR.c_str() );
       else if (OPT == "UMBRELLA")
         umbrella_ = atoi( VAR.c_str() );
+      else if (OPT == "ANALYZE_THREADS")
+        analyzeThreads_ = atoi( VAR.c_str() );
+      else if (OPT == "ANALYZE_MEMORY")
+      {
+        analyzeMemory_ = ByteSize( VAR );
+        if (analyzeMemory_ <= 0.0) {
+          ErrorMsg("Invalid ANALYZE_MEMORY '%s'; expected e.g. 64G.\n", VAR.c_str());
+          return 1;
+        }
+      }
+      else if (OPT == "ARCHIVE_PARALLEL")
+      {
+        archiveParallel_ = atoi( VAR.c_str() );
+        if (archiveParallel_ < 1) {
+          ErrorMsg("ARCHIVE_PARALLEL must be at least 1.\n");
+          return 1;
+        }
+      }
       else if (OPT == "TOPOLOGY")
       {
         top_file_ = VAR;
@@ -134,6 +186,42 @@ int RemdDirs::ReadOptions(std::string const& input_file, int start) {
           return 1;
         }
       }
+      else if (OPT == "ARCHIVE_EXEC")
+      {
+        if (VAR == "yes")
+          archiveExec_ = true;
+        else if (VAR == "no")
+          archiveExec_ = false;
+        else {
+          ErrorMsg("Expected either 'yes' or 'no' for ARCHIVE_EXEC.\n");
+          OptHelp();
+          return 1;
+        }
+      }
+      else if (OPT == "ARCHIVE_SINGLE_PASS")
+      {
+        if (VAR == "yes")
+          archiveSinglePass_ = true;
+        else if (VAR == "no")
+          archiveSinglePass_ = false;
+        else {
+          ErrorMsg("Expected either 'yes' or 'no' for ARCHIVE_SINGLE_PASS.\n");
+          OptHelp();
+          return 1;
+        }
+      }
+      else if (OPT == "DEDUP")
+      {
+        if (VAR == "yes")
+          dedup_ = true;
+        else if (VAR == "no")
+          dedup_ = false;
+        else {
+          ErrorMsg("Expected either 'yes' or 'no' for DEDUP.\n");
+          OptHelp();
+          return 1;
+        }
+      }
       else
       {
         ErrorMsg("Unrecognized option '%s' in input file.\n", OPT.c_str());
@@ -197,6 +285,60 @@ int RemdDirs::LoadDimension(std::string const& dfile) {
   return 0;
 }
 
+/// Order grid points by replica number (first dimension fastest).
+struct GridOrder {
+  bool operator()(std::vector<unsigned int> const& p1, std::vector<unsigned int> const& p2) const {
+    for (unsigned int dim = p1.size(); dim-- > 0; )
+      if (p1[dim] != p2[dim]) return (p1[dim] < p2[dim]);
+    return false;
+  }
+};
+
+// RemdDirs::LoadGrid()
+/** Load replica grid points, one per line with a 1-based index for each
+  * dimension. Replicas are numbered in the order they would have in the
+  * full grid, regardless of the order in the file.
+  */
+int RemdDirs::LoadGrid(std::string const& gfile) {
+  grid_.clear();
+  TextFile infile;
+  if (infile.OpenRead(gfile)) return 1;
+  const char* SEP = " \t\n";
+  int line = 1;
+  for (int ncols = infile.GetColumns( SEP ); ncols > -1; ncols = infile.GetColumns( SEP ), ++line)
+  {
+    if (ncols == 0 || infile.Token(0)[0] == '#') continue;
+    if (ncols != (int)Dims_.size()) {
+      ErrorMsg("Grid file '%s' line %i: expected %zu indices, got %i.\n",
+               gfile.c_str(), line, Dims_.size(), ncols);
+      return 1;
+    }
+    Iarray point;
+    for (int col = 0; col != ncols; col++) {
+      int idx = atoi( infile.Token(col).c_str() );
+      if (idx < 1 || idx > (int)Dims_[col]->Size()) {
+        ErrorMsg("Grid file '%s' line %i: index %s out of range for dimension %i (1-%u).\n",
+                 gfile.c_str(), line, infile.Token(col).c_str(), col+1, Dims_[col]->Size());
+        return 1;
+      }
+      point.push_back( (unsigned int)(idx - 1) );
+    }
+    grid_.push_back( point );
+  }
+  infile.Close();
+  if (grid_.empty()) {
+    ErrorMsg("No grid points in '%s'\n", gfile.c_str());
+    return 1;
+  }
+  std::sort( grid_.begin(), grid_.end(), GridOrder() );
+  for (unsigned int rep = 1; rep < grid_.size(); rep++)
+    if (grid_[rep] == grid_[rep-1]) {
+      ErrorMsg("Grid file '%s' has duplicate grid points.\n", gfile.c_str());
+      return 1;
+    }
+  return 0;
+}
+
 // RemdDirs::Setup()
 int RemdDirs::Setup(std::string const& crdDirIn, bool needsMdin) {
   // Command line input coordinates override any in options file.
@@ -209,6 +351,10 @@ int RemdDirs::Setup(std::string const& crdDirIn, bool needsMdin) {
   runDescription_.clear();
   if (Dims_.empty()) {
     Msg("  No dimensions defined: assuming MD run.\n");
+    if (!grid_file_.empty()) {
+      ErrorMsg("GRID requires at least one DIMENSION.\n");
+      return 1;
+    }
     runType_ = MD;
     runDescription_.assign("MD");
   } else {
@@ -274,6 +420,13 @@ int RemdDirs::Setup(std::string const& crdDirIn, bool needsMdin) {
     if (debug_ > 0)
       Msg("    Topology dimension: %i\n    Temp0 dimension: %i    pH dimension: %i\n",
           top_dim_, temp0_dim_, ph_dim_);
+    // Only use replicas at listed grid points if specified.
+    if (!grid_file_.empty()) {
+      if (LoadGrid( grid_file_ )) return 1;
+      Msg("    Grid '%s': %zu of %u grid points.\n", grid_file_.c_str(), grid_.size(),
+          totalReplicas_);
+      totalReplicas_ = grid_.size();
+    }
   }
   // Perform some more error checking
   if (nstlim_ < 1 || (runType_ != MD && numexchg_ < 1)) {
@@ -310,6 +463,9 @@ void RemdDirs::Info() const {
 }
 
 // RemdDirs::CreateRuns()
+/** Input for all runs is planned in memory first, then committed. With
+  * '-O', only files whose contents changed are rewritten.
+  */
 int RemdDirs::CreateRuns(std::string const& TopDir, StrArray const& RunDirs,
                          int start, bool overwrite)
 {
@@ -317,25 +473,100 @@ int RemdDirs::CreateRuns(std::string const& TopDir, StrArray const& RunDirs,
     ErrorMsg("No starting coords directory/file specified.\n");
     return 1;
   }
+  DirHandle topDir;
+  if (topDir.Open(TopDir)) return 1;
+  RunPlan plan;
   int run = start;
   for (StrArray::const_iterator runDir = RunDirs.begin();
                                 runDir != RunDirs.end(); ++runDir, ++run)
   {
-    if (ChangeDir(TopDir)) return 1;
     // Determine run directory name, see if it is being overwritten.
     Msg("  RUNDIR: %s\n", runDir->c_str());
-    if (fileExists(*runDir) && !overwrite) {
+    if (fileExists(topDir, *runDir) && !overwrite) {
       ErrorMsg("Directory '%s' exists and '-O' not specified.\n", runDir->c_str());
       return 1;
     }
-    // Create run input
+    // Plan run input
     int err;
     if (runType_ == MD)
-      err = CreateMD(start, run, *runDir);
+      err = CreateMD(start, run, topDir, *runDir, plan);
     else
-      err = CreateRemd(start, run, *runDir);
+      err = CreateRemd(start, run, topDir, *runDir, plan);
     if (err) return 1;
   }
+  // Write run input
+  if (!dedup_) return plan.Commit(topDir, 0);
+  InputStore store;
+  if (store.Setup(topDir)) return 1;
+  int err = plan.Commit(topDir, &store);
+  store.Info();
+  return err;
+}
+
+// RemdDirs::ExchangeStats()
+/** Stream rem.log from each run directory in order and report neighbor
+  * acceptance ratios and round trips. Replica positions are labeled with
+  * values from the replica dimension.
+  */
+int RemdDirs::ExchangeStats(std::string const& TopDir, StrArray const& RunDirs) const {
+  if (runType_ == MD) {
+    ErrorMsg("Exchange statistics require a replica exchange run.\n");
+    return 1;
+  }
+  if (Dims_.size() != 1) {
+    ErrorMsg("Exchange statistics currently only supported for 1 dimension.\n");
+    return 1;
+  }
+  ReplicaDimension const& dim = *(Dims_[0]);
+  std::vector<double> values;
+  if (dim.Type() == ReplicaDimension::TEMP) {
+    // Temperatures move between replicas. Neighbors are adjacent in
+    // temperature, so positions are in ascending order.
+    for (unsigned int idx = 0; idx != dim.Size(); idx++)
+      values.push_back( dim.Temp0(idx) );
+    std::sort( values.begin(), values.end() );
+    for (unsigned int idx = 1; idx < values.size(); idx++)
+      if (values[idx] - values[idx-1] < 0.01) {
+        ErrorMsg("Temperature %g appears more than once in %s.\n", values[idx],
+                 dim.description());
+        return 1;
+      }
+  } else if (dim.Type() != ReplicaDimension::TOPOLOGY &&
+             dim.Type() != ReplicaDimension::AMD_DIHEDRAL)
+  {
+    ErrorMsg("Exchange statistics not supported for %s.\n", dim.name());
+    return 1;
+  }
+  // Label each replica position.
+  std::vector<std::string> labels;
+  for (unsigned int idx = 0; idx != dim.Size(); idx++) {
+    if (!values.empty())
+      labels.push_back( doubleToString( values[idx] ) );
+    else if (dim.ProvidesTemp0())
+      labels.push_back( doubleToString( dim.Temp0(idx) ) );
+    else if (dim.ProvidesTopFiles()) {
+      std::string const& top = dim.TopName(idx);
+      size_t found = top.find_last_of("/");
+      labels.push_back( (found == std::string::npos) ? top : top.substr(found + 1) );
+    } else
+      labels.push_back( integerToString( idx + 1 ) );
+  }
+  RemLogStats stats;
+  if (stats.Setup( dim.Size(), values )) return 1;
+  for (StrArray::const_iterator runDir = RunDirs.begin(); runDir != RunDirs.end(); ++runDir)
+  {
+    std::string logName( TopDir + "/" + *runDir + "/rem.log" );
+    if (!fileExists( logName )) {
+      Msg("Warning: '%s' not found, skipping.\n", logName.c_str());
+      stats.Break();
+      continue;
+    }
+    Msg("  Reading %s/rem.log\n", runDir->c_str());
+    if (stats.Read( logName )) return 1;
+  }
+  Msg("Exchange statistics for %s, %s to %s:\n", dim.description(),
+      RunDirs.front().c_str(), RunDirs.back().c_str());
+  stats.Print( labels, (double)nstlim_ * dt_ );
   return 0;
 }
 
@@ -344,14 +575,18 @@ int RemdDirs::CreateAnalyzeArchive(std::string const& TopDir, StrArray const& Ru
                                    int start, int stop, bool overwrite, bool check,
                                    bool analyzeEnabled, bool archiveEnabled)
 {
+  DirHandle topDir;
+  if (topDir.Open(TopDir)) return 1;
   // Find trajectory files
-  ChangeDir( TopDir + "/" + RunDirs.front() );
   StrArray TrajFiles;
   std::string traj_prefix;
-  if (runType_ == MD)
-    TrajFiles = ExpandToFilenames("md.nc.*");
-  else
-    TrajFiles = ExpandToFilenames("TRAJ/rem.crd.*");
+  DirHandle firstRun;
+  if (firstRun.Open(topDir, RunDirs.front()) == 0) {
+    if (runType_ == MD)
+      TrajFiles = ExpandToFilenames(firstRun, "md.nc.*");
+    else
+      TrajFiles = ExpandToFilenames(firstRun, "TRAJ/rem.crd.*");
+  }
   if (TrajFiles.empty()) {
     if (check) {
       ErrorMsg("No trajectory files found.\n");
@@ -366,63 +601,80 @@ int RemdDirs::CreateAnalyzeArchive(std::string const& TopDir, StrArray const& Ru
     traj_prefix.assign("/" + TrajFiles.front());
 
   // Ensure traj 1 for all runs between start and stop exist.
-  ChangeDir( TopDir );
   if (check) {
     for (StrArray::const_iterator rdir = RunDirs.begin(); rdir != RunDirs.end(); ++rdir)
     {
       std::string TRAJ1(*rdir + traj_prefix);
-      if (CheckExists("Trajectory", TRAJ1)) return 1;
+      if (CheckExists(topDir, "Trajectory", TRAJ1)) return 1;
     }
   }
 
   // Set up input for analysis -------------------
   if (analyzeEnabled) {
-    ChangeDir( TopDir );
     Msg("Creating input for analysis.\n");
     std::string CPPDIR = "Analyze." + integerToString(start) + "." +
                                       integerToString(stop);
-    if ( fileExists(CPPDIR) ) {
+    if ( fileExists(topDir, CPPDIR) ) {
       if (!overwrite) {
         ErrorMsg("Directory '%s' exists and '-O' not specified.\n", CPPDIR.c_str());
         return 1;
       }
     } else
-      Mkdir( CPPDIR );
-    // Analysis input
-    std::string inputName("batch.cpptraj.in"); // TODO check exists? Make option?
-    TextFile CPPIN;
-    if (CPPIN.OpenWrite( CPPDIR + "/" + inputName )) return 1;
+      Mkdir( topDir, CPPDIR );
+    std::string scriptName(CPPDIR + "/RunAnalysis.sh");
+    if (!overwrite && fileExists(topDir, scriptName)) {
+      ErrorMsg("Not overwriting existing analysis script: %s\n", scriptName.c_str());
+      return 1;
+    }
     // If HREMD, need nosort keyword
     std::string TRAJINARGS;
     if (runType_ == MD || runType_ == HREMD)
       TRAJINARGS.assign("nosort");
-    CPPIN.Printf("parm %s\n", Topology().c_str());
-    for (StrArray::const_iterator rdir = RunDirs.begin(); rdir != RunDirs.end(); ++rdir)
-      CPPIN.Printf("ensemble ../%s%s %s\n",
-                   rdir->c_str(), traj_prefix.c_str(), TRAJINARGS.c_str());
-    CPPIN.Printf("strip :WAT\nautoimage\n"
-                 "trajout run%i-%i.nowat.nc netcdf remdtraj %s\n",
-                 start, stop, trajoutargs_.c_str());
-    CPPIN.Close();
-    // Create run script
-    std::string scriptName(CPPDIR + "/RunAnalysis.sh");
-    if (!overwrite && fileExists(scriptName)) {
-      ErrorMsg("Not overwriting existing analysis script: %s\n", scriptName.c_str());
+    // If analysis threads allow more than one ensemble at once, split runs
+    // into that many chunks analyzed concurrently.
+    // Chunks that do not fit in analysis memory are split further.
+    int nslots = 1;
+    if (analyzeThreads_ > 0)
+      nslots = std::max(1, std::min(analyzeThreads_ / EnsembleSize(), (int)RunDirs.size()));
+    Iarray chunkStart;
+    for (int chunk = 0; chunk != nslots; chunk++)
+      chunkStart.push_back( (chunk * RunDirs.size()) / nslots );
+    if (analyzeMemory_ > 0.0 &&
+        SplitChunksByMemory(topDir, CPPDIR, RunDirs, traj_prefix, nslots, chunkStart))
       return 1;
+    if (chunkStart.size() > 1) {
+      Msg("  Analyzing %zu runs in %zu chunks, %i at once.\n",
+          RunDirs.size(), chunkStart.size(), nslots);
+      if (WriteAnalysisChunks(topDir, CPPDIR, RunDirs, traj_prefix, TRAJINARGS,
+                              start, stop, chunkStart, nslots))
+        return 1;
+    } else {
+      // Analysis input
+      std::string inputName("batch.cpptraj.in"); // TODO check exists? Make option?
+      TextFile CPPIN;
+      if (CPPIN.OpenWrite( topDir, CPPDIR + "/" + inputName )) return 1;
+      CPPIN.Printf("parm %s\n", Topology().c_str());
+      for (StrArray::const_iterator rdir = RunDirs.begin(); rdir != RunDirs.end(); ++rdir)
+        CPPIN.Printf("ensemble ../%s%s %s\n",
+                     rdir->c_str(), traj_prefix.c_str(), TRAJINARGS.c_str());
+      CPPIN.Printf("strip :WAT\nautoimage\n"
+                   "trajout run%i-%i.nowat.nc netcdf remdtraj %s\n",
+                   start, stop, trajoutargs_.c_str());
+      if (CPPIN.Close()) return 1;
+      // Create run script
+      TextFile runScript;
+      if (runScript.OpenWrite( topDir, scriptName )) return 1;
+      runScript.Printf("#!/bin/bash\n\n# Run executable\nTIME0=`date +%%s`\n"
+                       "$MPIRUN $EXEPATH -i %s\n"
+                       "if [[ $? -ne 0 ]] ; then\n  echo \"CPPTRAJ error.\"\n  exit 1\nfi\n"
+                       "TIME1=`date +%%s`\n((TOTAL = $TIME1 - $TIME0))\n"
+                       "echo \"$TOTAL seconds.\"\nexit 0\n", inputName.c_str());
+      if (runScript.Close()) return 1;
+      ChangePermissions( topDir, scriptName );
     }
-    TextFile runScript;
-    if (runScript.OpenWrite( scriptName )) return 1;
-    runScript.Printf("#!/bin/bash\n\n# Run executable\nTIME0=`date +%%s`\n"
-                     "$MPIRUN $EXEPATH -i %s\n"
-                     "if [[ $? -ne 0 ]] ; then\n  echo \"CPPTRAJ error.\"\n  exit 1\nfi\n"
-                     "TIME1=`date +%%s`\n((TOTAL = $TIME1 - $TIME0))\n"
-                     "echo \"$TOTAL seconds.\"\nexit 0\n", inputName.c_str());
-    runScript.Close();
-    ChangePermissions( scriptName ); 
   }
   // Set up input for archiving ------------------
   if (archiveEnabled) {
-    ChangeDir( TopDir );
     Msg("Creating input for archiving.\n");
     // Set up input for archiving. This will be done in 2 separate runs. 
     // The first sorts and saves fully solvated trajectories of interest
@@ -434,13 +686,13 @@ int RemdDirs::CreateAnalyzeArchive(std::string const& TopDir, StrArray const& Ru
     }
     std::string ARDIR="Archive." + integerToString(start) + "." +
                                    integerToString(stop);
-    if ( fileExists(ARDIR) ) {
+    if ( fileExists(topDir, ARDIR) ) {
       if (!overwrite) {
         ErrorMsg("Directory '%s' exists and '-O' not specified.\n", ARDIR.c_str());
         return 1;
       }
     } else
-      Mkdir( ARDIR );
+      Mkdir( topDir, ARDIR );
     // If HREMD, need nosort keyword
     std::string TRAJINARGS;
     if (runType_ == MD || runType_ == HREMD)
@@ -452,59 +704,361 @@ int RemdDirs::CreateAnalyzeArchive(std::string const& TopDir, StrArray const& Ru
     {
       // Check if traj archive already exists for this run.
       std::string TARFILE( ARDIR + "/traj." + *rdir + ".tgz" );
-      if (!overwrite && fileExists(TARFILE)) {
+      if (!overwrite && fileExists(topDir, TARFILE)) {
         ErrorMsg("Trajectory archive %s already exists.\n", TARFILE.c_str());
         return 1;
       }
       // Check if non-traj archive exists for this run
       TARFILE.assign( *rdir + ".tgz" );
-      if (!overwrite && fileExists(TARFILE)) {
+      if (!overwrite && fileExists(topDir, TARFILE)) {
         ErrorMsg("Run archive %s already exists.\n", TARFILE.c_str());
         return 1;
       }
       // Create cpptraj input
       TextFile ARIN;
+      if (archiveSinglePass_) {
+        // Read each frame once. Full coordinates of selected members are
+        // written with outtraj before the strip, stripped coords after.
+        std::string AR("ar." + integerToString(run) + ".cpptraj.in");
+        if (ARIN.OpenWrite(topDir, ARDIR + "/" + AR)) return 1;
+        ARIN.Printf("parm %s\nensemble ../%s%s %s\n",
+                    TOP.c_str(), rdir->c_str(), traj_prefix.c_str(), TRAJINARGS.c_str());
+        if ( fullarchive_ != "NONE")
+          ARIN.Printf("outtraj ../%s/TRAJ/wat.nc netcdf remdtraj onlymembers %s\n",
+                      rdir->c_str(), fullarchive_.c_str());
+        ARIN.Printf("strip :WAT\nautoimage\ntrajout ../%s/TRAJ/nowat.nc netcdf remdtraj\n",
+                    rdir->c_str());
+        if (ARIN.Close()) return 1;
+        continue;
+      }
       if ( fullarchive_ != "NONE") {
         // Create input for full archiving of selected members of this run
         std::string AR1("ar1." + integerToString(run) + ".cpptraj.in");
-        if (ARIN.OpenWrite(ARDIR + "/" + AR1)) return 1;
+        if (ARIN.OpenWrite(topDir, ARDIR + "/" + AR1)) return 1;
         ARIN.Printf("parm %s\nensemble ../%s%s %s\n"
                     "trajout ../%s/TRAJ/wat.nc netcdf remdtraj onlymembers %s\n",
                     TOP.c_str(), rdir->c_str(), traj_prefix.c_str(), TRAJINARGS.c_str(),
                     rdir->c_str(), fullarchive_.c_str());
-        ARIN.Close();
+        if (ARIN.Close()) return 1;
       }
       // Create input for archiving stripped trajectories
       std::string AR2("ar2." + integerToString(run) + ".cpptraj.in");
-      if (ARIN.OpenWrite(ARDIR + "/" + AR2)) return 1;
+      if (ARIN.OpenWrite(topDir, ARDIR + "/" + AR2)) return 1;
       ARIN.Printf("parm %s\nensemble ../%s%s %s\n"
                   "strip :WAT\nautoimage\ntrajout ../%s/TRAJ/nowat.nc netcdf remdtraj\n",
                   TOP.c_str(), rdir->c_str(), traj_prefix.c_str(), TRAJINARGS.c_str(),
                   rdir->c_str());
-      ARIN.Close();
+      if (ARIN.Close()) return 1;
     }
 
     // Create run script.
-    const char* CPPTRAJERR =
-      "  if [[ $? -ne 0 ]] ; then\n    echo \"CPPTRAJ error.\"\n    exit 1\n  fi";
     std::string scriptName("RunArchive." + integerToString(start) + "."
                            + integerToString(stop) + ".sh");
-    if (!overwrite && fileExists(scriptName)) {
+    if (!overwrite && fileExists(topDir, scriptName)) {
       ErrorMsg("Not overwriting existing archive script: %s\n", scriptName.c_str());
       return 1;
     }
-    TextFile runScript;
-    if (runScript.OpenWrite( scriptName )) return 1;
-    runScript.Printf("#!/bin/bash\n\nTOTALTIME0=`date +%%s`\nRUN=%i\nfor DIR in", start);
-    for (StrArray::const_iterator rdir = RunDirs.begin(); rdir != RunDirs.end(); ++rdir)
-      runScript.Printf(" %s", rdir->c_str());
+    if (WriteArchiveScript(topDir, RunDirs, start, stop, ARDIR, scriptName)) return 1;
+  } // END archive input
+
+  return 0;
+}
+
+// RemdDirs::WriteArchiveCpptraj()
+/** Add commands running cpptraj on archive input of run $RUN in ARDIR to
+  * the archive script. If fully-solvated trajs are archived their existence
+  * is checked afterwards; watTest is the test for their absence.
+  */
+void RemdDirs::WriteArchiveCpptraj(TextFile& runScript, std::string const& ARDIR,
+                                   const char* watTest) const
+{
+  const char* CPPTRAJERR =
+    "  if [[ $? -ne 0 ]] ; then\n    echo \"CPPTRAJ error.\"\n    exit 1\n  fi";
+  const char* WATERR =
+    "    echo \"Error: Sorted solvated trajectories not found.\" >> /dev/stderr\n"
+    "    exit 1\n  fi\n";
+  if (archiveSinglePass_) {
+    runScript.Printf(
+      "  # Save the sorted fully-solvated and all stripped trajs in one pass.\n"
+      "  cd %s\n  $MPIRUN $EXEPATH -i ar.$RUN.cpptraj.in\n%s\n"
+      "  cd ..\n", ARDIR.c_str(), CPPTRAJERR);
+    if ( fullarchive_ != "NONE")
+      runScript.Printf("%s%s", watTest, WATERR);
+    return;
+  }
+  if ( fullarchive_ != "NONE") {
+    // Add command to script for full archive of this run
+    runScript.Printf(
+      "  # Sort and save the unbiased fully-solvated trajs\n"
+      "  cd %s\n  $MPIRUN $EXEPATH -i ar1.$RUN.cpptraj.in\n%s\n"
+      "  cd ..\n%s%s", ARDIR.c_str(), CPPTRAJERR, watTest, WATERR);
+  }
+  // Add command to script for stripped archive of this run
+  runScript.Printf(
+      "  # Save all of the stripped trajs.\n"
+      "  cd %s\n  $MPIRUN $EXEPATH -i ar2.$RUN.cpptraj.in\n%s\n"
+      "  cd ..\n", ARDIR.c_str(), CPPTRAJERR);
+}
+
+/** Add commands setting NSLOTS, the number of jobs a script runs at once.
+  * NSLOTS is determined from job THREADS when the script runs, up to
+  * maxSlots. MPI jobs each need a multiple of the ensemble size threads, so
+  * each gets RUNTHREADS, its share rounded down to that multiple. MPIRUN
+  * for each job is formed from MPIRUNTEMPLATE (set by the job header when
+  * the MPIRUN queue option uses $NP) with NP=RUNTHREADS.
+  */
+static void WriteSlotThreads(TextFile& script, int maxSlots, int ensembleSize) {
+  script.Printf("ENSEMBLE=%i\nif [[ -z $MPIRUN ]] ; then\n"
+                "  # Serial jobs can use any number of threads.\n  ENSEMBLE=1\nfi\n"
+                "NSLOTS=1\nif [[ ! -z $THREADS ]] ; then\n"
+                "  ((NSLOTS = $THREADS / $ENSEMBLE))\n"
+                "  if [[ $NSLOTS -gt %i ]] ; then\n    NSLOTS=%i\n"
+                "  elif [[ $NSLOTS -lt 1 ]] ; then\n    NSLOTS=1\n  fi\nfi\n"
+                "if [[ $NSLOTS -gt 1 ]] ; then\n"
+                "  ((RUNTHREADS = ($THREADS / $NSLOTS / $ENSEMBLE) * $ENSEMBLE))\n"
+                "  if [[ ! -z $MPIRUN ]] ; then\n"
+                "    # Each job gets its share of threads as NP in the MPIRUN template.\n"
+                "    if [[ \"$MPIRUNTEMPLATE\" != *'$NP'* ]] ; then\n"
+                "      echo \"Error: MPIRUN must use \\$NP to run $NSLOTS jobs at once.\" >> /dev/stderr\n"
+                "      exit 1\n    fi\n"
+                "    NP=$RUNTHREADS\n    eval \"MPIRUN=\\\"$MPIRUNTEMPLATE\\\"\"\n  fi\nfi\n",
+                ensembleSize, maxSlots, maxSlots);
+}
+
+// RemdDirs::EnsembleSize()
+/** \return Number of members in the trajectory ensemble of each run. */
+int RemdDirs::EnsembleSize() const {
+  if (runType_ == MD)
+    return std::max(n_md_runs_, 1);
+  return (int)totalReplicas_;
+}
+
+/// Bytes per MB, for reporting memory estimates.
+static const double MB = 1048576.0;
+
+/** \return Number of atoms from Amber topology POINTERS section, -1 if not found. */
+static long int TopologyNatom(std::string const& fname) {
+  TextFile parm;
+  if (parm.OpenRead( fname )) return -1;
+  long int natom = -1;
+  const char* ptr = parm.Gets();
+  while (ptr != 0) {
+    if (strncmp(ptr, "%FLAG POINTERS", 14) == 0) {
+      // Skip %FORMAT line; NATOM is the first value.
+      if (parm.Gets() != 0 && (ptr = parm.Gets()) != 0)
+        natom = atol( ptr );
+      break;
+    }
+    ptr = parm.Gets();
+  }
+  parm.Close();
+  if (natom < 1) return -1;
+  return natom;
+}
+
+/** \return Number of frames in NetCDF trajectory from its header (or its
+  * size if the number of records is not set), -1 if unknown.
+  */
+static long int TrajectoryFrames(std::string const& fname) {
+  NetcdfHeader nc;
+  if (nc.Open( fname )) return -1;
+  if (nc.Format() != NetcdfHeader::CDF1 && nc.Format() != NetcdfHeader::CDF2) return -1;
+  long int nframes = nc.Nrecs();
+  if (nframes < 0 && nc.RecSize() > 0) {
+    struct stat file_stat;
+    if (stat(fname.c_str(), &file_stat) == 0 && file_stat.st_size >= nc.RecBegin())
+      nframes = (long int)((file_stat.st_size - nc.RecBegin()) / nc.RecSize());
+  }
+  return nframes;
+}
+
+// RemdDirs::SplitChunksByMemory()
+/** Estimate memory needed to analyze each run as the coordinates (3 doubles
+  * per atom, atoms from the topology) of every ensemble member and frame (from
+  * the header of the first trajectory of the run). Chunks are split so each
+  * fits in ANALYZE_MEMORY divided by the number of chunks run at once. Runs
+  * are not split, so a run that does not fit is a chunk by itself.
+  */
+int RemdDirs::SplitChunksByMemory(DirHandle const& topDir, std::string const& CPPDIR,
+                                  StrArray const& RunDirs, std::string const& traj_prefix,
+                                  int nslots, Iarray& chunkStart) const
+{
+  // Topology is relative to the analysis directory.
+  std::string TOP = Topology();
+  if (!TOP.empty() && TOP[0] != '/' && TOP[0] != '~')
+    TOP = topDir.FullName( CPPDIR + "/" + TOP );
+  long int natom = -1;
+  if (!TOP.empty() && fileExists( TOP ))
+    natom = TopologyNatom( tildeExpansion( TOP ) );
+  if (natom < 1) {
+    Msg("Warning: Could not get # atoms from '%s'; not splitting analysis by memory.\n",
+        TOP.c_str());
+    return 0;
+  }
+  // Frames in each run. Runs with unknown frames use the largest count.
+  std::vector<long int> frames;
+  frames.reserve( RunDirs.size() );
+  long int maxFrames = -1;
+  for (StrArray::const_iterator rdir = RunDirs.begin(); rdir != RunDirs.end(); ++rdir) {
+    frames.push_back( TrajectoryFrames( topDir.FullName( *rdir + traj_prefix ) ) );
+    maxFrames = std::max( maxFrames, frames.back() );
+  }
+  if (maxFrames < 0) {
+    Msg("Warning: Could not get # frames from trajectories; not splitting analysis by memory.\n");
+    return 0;
+  }
+  double frameBytes = (double)natom * 3.0 * sizeof(double) * (double)EnsembleSize();
+  double budget = analyzeMemory_ / (double)nslots;
+  double total = 0.0;
+  Iarray newStart;
+  for (Iarray::const_iterator chunk = chunkStart.begin(); chunk != chunkStart.end(); ++chunk)
+  {
+    unsigned int last;
+    if (chunk + 1 == chunkStart.end())
+      last = RunDirs.size() - 1;
+    else
+      last = *(chunk + 1) - 1;
+    newStart.push_back( *chunk );
+    double chunkBytes = 0.0;
+    for (unsigned int idx = *chunk; idx <= last; idx++) {
+      if (frames[idx] < 0) {
+        Msg("Warning: Could not get # frames for %s; assuming %li.\n",
+            RunDirs[idx].c_str(), maxFrames);
+        frames[idx] = maxFrames;
+      }
+      double runBytes = frameBytes * (double)frames[idx];
+      total += runBytes;
+      if (runBytes > budget)
+        Msg("Warning: %s needs an estimated %.1f MB, more than %.1f MB per chunk.\n",
+            RunDirs[idx].c_str(), runBytes / MB, budget / MB);
+      if (idx != *chunk && chunkBytes + runBytes > budget) {
+        newStart.push_back( idx );
+        chunkBytes = 0.0;
+      }
+      chunkBytes += runBytes;
+    }
+  }
+  Msg("  Estimated analysis memory: %.1f MB (%li atoms, %i members), %.1f MB per chunk.\n",
+      total / MB, natom, EnsembleSize(), budget / MB);
+  chunkStart.swap( newStart );
+  return 0;
+}
+
+// RemdDirs::WriteAnalysisChunks()
+/** Write cpptraj input analyzing runs in chunks starting at the given
+  * indices into RunDirs, input merging the chunk trajectories, and a script
+  * running up to nslots chunks at once followed by the merge.
+  */
+int RemdDirs::WriteAnalysisChunks(DirHandle const& topDir, std::string const& CPPDIR,
+                                  StrArray const& RunDirs, std::string const& traj_prefix,
+                                  std::string const& TRAJINARGS, int start, int stop,
+                                  Iarray const& chunkStart, int nslots) const
+{
+  std::string TOP = Topology();
+  std::string chunkList;
+  TextFile MERGE;
+  if (MERGE.OpenWrite( topDir, CPPDIR + "/merge.cpptraj.in" )) return 1;
+  // Chunk trajectories are already sorted and imaged; only the topology
+  // needs to be stripped to match.
+  MERGE.Printf("parm %s\nparmstrip :WAT\n", TOP.c_str());
+  for (Iarray::const_iterator chunk = chunkStart.begin(); chunk != chunkStart.end(); ++chunk)
+  {
+    unsigned int first = *chunk;
+    unsigned int last;
+    if (chunk + 1 == chunkStart.end())
+      last = RunDirs.size() - 1;
+    else
+      last = *(chunk + 1) - 1;
+    std::string chunkName("run" + integerToString(start + first) + "-" +
+                          integerToString(start + last));
+    chunkList.append(" " + chunkName);
+    TextFile CPPIN;
+    if (CPPIN.OpenWrite( topDir, CPPDIR + "/" + chunkName + ".cpptraj.in" )) return 1;
+    CPPIN.Printf("parm %s\n", TOP.c_str());
+    for (unsigned int idx = first; idx <= last; idx++)
+      CPPIN.Printf("ensemble ../%s%s %s\n",
+                   RunDirs[idx].c_str(), traj_prefix.c_str(), TRAJINARGS.c_str());
+    CPPIN.Printf("strip :WAT\nautoimage\n"
+                 "trajout %s.nowat.nc netcdf remdtraj %s\n",
+                 chunkName.c_str(), trajoutargs_.c_str());
+    if (CPPIN.Close()) return 1;
+    MERGE.Printf("ensemble %s.nowat.nc.0 nosort\n", chunkName.c_str());
+  }
+  MERGE.Printf("trajout run%i-%i.nowat.nc netcdf remdtraj\n", start, stop);
+  if (MERGE.Close()) return 1;
+  // Create run script
+  std::string scriptName(CPPDIR + "/RunAnalysis.sh");
+  TextFile runScript;
+  if (runScript.OpenWrite( topDir, scriptName )) return 1;
+  runScript.Printf("#!/bin/bash\n\n# Analyze runs in %zu chunks, up to %i at once, then merge.\n"
+                   "TIME0=`date +%%s`\nFULLMPIRUN=$MPIRUN\n", chunkStart.size(), nslots);
+  WriteSlotThreads(runScript, nslots, EnsembleSize());
+  runScript.Printf("FinishChunk() {\n  wait ${PIDS[$NEXT]}\n"
+                   "  if [[ $? -ne 0 ]] ; then\n"
+                   "    echo \"CPPTRAJ error in ${CHUNKS[$NEXT]}, see ${CHUNKS[$NEXT]}.out\" >> /dev/stderr\n"
+                   "    ERR=1\n  fi\n  ((NEXT++))\n}\n"
+                   "CHUNKS=(%s )\nPIDS=()\nERR=0\nNEXT=0\n"
+                   "for ((IDX = 0; IDX < ${#CHUNKS[@]}; IDX++)) ; do\n"
+                   "  $MPIRUN $EXEPATH -i ${CHUNKS[$IDX]}.cpptraj.in > ${CHUNKS[$IDX]}.out 2>&1 &\n"
+                   "  PIDS[$IDX]=$!\n"
+                   "  if [[ $(($IDX + 1 - $NEXT)) -ge $NSLOTS ]] ; then\n    FinishChunk\n  fi\n"
+                   "  if [[ $ERR -ne 0 ]] ; then\n    ((IDX++))\n    break\n  fi\n"
+                   "done\nwhile [[ $NEXT -lt $IDX ]] ; do\n  FinishChunk\ndone\n"
+                   "if [[ $ERR -ne 0 ]] ; then\n  exit 1\nfi\n"
+                   "# Merge chunk trajectories\n"
+                   "$FULLMPIRUN $EXEPATH -i merge.cpptraj.in\n"
+                   "if [[ $? -ne 0 ]] ; then\n  echo \"CPPTRAJ error.\"\n  exit 1\nfi\n"
+                   "for CHUNK in ${CHUNKS[@]} ; do\n  rm $CHUNK.nowat.nc.*\ndone\n"
+                   "TIME1=`date +%%s`\n((TOTAL = $TIME1 - $TIME0))\n"
+                   "echo \"$TOTAL seconds.\"\nexit 0\n", chunkList.c_str());
+  if (runScript.Close()) return 1;
+  ChangePermissions( topDir, scriptName );
+  return 0;
+}
+
+// RemdDirs::WriteArchiveScript()
+/** Write script that runs cpptraj on the archive input of each run, then
+  * puts everything but trajectories in '<run>.tgz' and the archived trajs in
+  * '<ARDIR>/traj.<run>.tgz', either with tar for each run or with a single
+  * '--archive-exec' call for all runs (ARCHIVE_EXEC). If ARCHIVE_PARALLEL > 1
+  * up to that many runs are archived at once, limited by the job THREADS;
+  * output of each run is shown and TrajArchives.txt written in run order.
+  */
+int RemdDirs::WriteArchiveScript(DirHandle const& topDir, StrArray const& RunDirs,
+                                 int start, int stop, std::string const& ARDIR,
+                                 std::string const& scriptName) const
+{
+  std::string runList;
+  for (StrArray::const_iterator rdir = RunDirs.begin(); rdir != RunDirs.end(); ++rdir)
+    runList.append(" " + *rdir);
+  bool inParallel = (archiveParallel_ > 1);
+  TextFile runScript;
+  if (runScript.OpenWrite( topDir, scriptName )) return 1;
+  runScript.Printf("#!/bin/bash\n\nTOTALTIME0=`date +%%s`\n");
+  if (archiveExec_)
+    runScript.Printf("if [[ -z $CREATEREMDDIRS ]] ; then\n  CREATEREMDDIRS=CreateRemdDirs\nfi\n");
+  if (inParallel) {
+    runScript.Printf("# Archive up to %i runs at once, limited by job threads.\n", archiveParallel_);
+    WriteSlotThreads(runScript, archiveParallel_, EnsembleSize());
+    runScript.Printf("ArchiveRun() {\n  DIR=$1\n  RUN=$2\n"
+                     "  if [[ ! -z $RUNTHREADS ]] ; then\n"
+                     "    export OMP_NUM_THREADS=$RUNTHREADS\n  fi\n"
+                     "  TIME0=`date +%%s`\n");
+  } else
+    runScript.Printf("RUN=%i\nfor DIR in%s ; do\n  TIME0=`date +%%s`\n", start, runList.c_str());
+  // Commands for each run
+  if (archiveExec_) {
+    WriteArchiveCpptraj(runScript, ARDIR,
+                        "  if [[ -z `ls $DIR/TRAJ/wat.nc.* 2> /dev/null` ]] ; then\n");
+    runScript.Printf("  TIME1=`date +%%s`\n  ((TOTAL = $TIME1 - $TIME0))\n"
+                     "  echo \"$DIR took $TOTAL seconds to process.\"\n");
+  } else {
     const char* tprefix;
     if (runType_ == MD)
       tprefix = "md.nc";
     else
       tprefix = "TRAJ";
-    runScript.Printf(" ; do\n  TIME0=`date +%%s`\n"
-                     "  # Put everything but trajectories into a separate archive.\n"
+    runScript.Printf("  # Put everything but trajectories into a separate archive.\n"
                      "  TARFILE=$DIR.tgz\n"
                      "  FILELIST=""\n  for FILE in `find $DIR -name \"*\"` ; do\n"
                      "    if [[ ! -d $FILE ]] ; then\n"
@@ -512,104 +1066,202 @@ int RemdDirs::CreateAnalyzeArchive(std::string const& TopDir, StrArray const& Ru
                      "        # Not a TRAJ directory file\n"
                      "        FILELIST=$FILELIST\" $FILE\"\n      fi\n    fi\n"
                      "  done\n  echo \"tar -czvf $TARFILE\"\n  tar -czvf $TARFILE $FILELIST\n", tprefix);
-    if ( fullarchive_ != "NONE") {
-      // Add command to script for full archive of this run
-      runScript.Printf(
-        "  # Sort and save the unbiased fully-solvated trajs\n"
-        "  cd %s\n  $MPIRUN $EXEPATH -i ar1.$RUN.cpptraj.in\n%s\n"
-        "  cd ..\n  FILELIST=`ls $DIR/TRAJ/wat.nc.*`\n"
-        "  if [[ -z $FILELIST ]] ; then\n"
-        "    echo \"Error: Sorted solvated trajectories not found.\" >> /dev/stderr\n"
-        "    exit 1\n  fi\n", ARDIR.c_str(), CPPTRAJERR); 
-    }
-    // Add command to script for stripped archive of this run
-    runScript.Printf(
-        "  # Save all of the stripped trajs.\n"
-        "  cd %s\n  $MPIRUN $EXEPATH -i ar2.$RUN.cpptraj.in\n%s\n" 
-        "  cd ..\n"
-        "  for OUTTRAJ in `ls $DIR/TRAJ/nowat.nc.*` ; do\n"
-        "    FILELIST=$FILELIST\" $OUTTRAJ\"\n"
-        "  done\n  TARFILE=%s/traj.$DIR.tgz\n"
-        "  echo \"tar -czvf $TARFILE\"\n"
-        "  tar -czvf $TARFILE $FILELIST\n"
-        "  TIME1=`date +%%s`\n  ((TOTAL = $TIME1 - $TIME0))\n"
-        "  echo \"$DIR took $TOTAL seconds to archive.\"\n"
-        "  echo \"$TARFILE\" >> TrajArchives.txt\n"
-        "  echo \"--------------------------------------------------------------\"\n"
-        "  ((RUN++))\n"
-        "done\nTOTALTIME1=`date +%%s`\n((TOTAL = $TOTALTIME1 - $TOTALTIME0))\n"
-        "echo \"$TOTAL seconds total.\"\nexit 0\n",
-        ARDIR.c_str(), CPPTRAJERR, ARDIR.c_str());
-    runScript.Close();
-    ChangePermissions( scriptName );
-  } // END archive input
-
+    // Add cpptraj commands, then archive sorted trajs of this run
+    WriteArchiveCpptraj(runScript, ARDIR, "  FILELIST=`ls $DIR/TRAJ/wat.nc.*`\n"
+                                          "  if [[ -z $FILELIST ]] ; then\n");
+    runScript.Printf("  for OUTTRAJ in `ls $DIR/TRAJ/nowat.nc.*` ; do\n"
+                     "    FILELIST=$FILELIST\" $OUTTRAJ\"\n"
+                     "  done\n  TARFILE=%s/traj.$DIR.tgz\n"
+                     "  echo \"tar -czvf $TARFILE\"\n"
+                     "  tar -czvf $TARFILE $FILELIST\n"
+                     "  TIME1=`date +%%s`\n  ((TOTAL = $TIME1 - $TIME0))\n"
+                     "  echo \"$DIR took $TOTAL seconds to archive.\"\n", ARDIR.c_str());
+    if (!inParallel)
+      runScript.Printf("  echo \"$TARFILE\" >> TrajArchives.txt\n");
+  }
+  runScript.Printf("  echo \"--------------------------------------------------------------\"\n");
+  if (inParallel) {
+    // Runs are waited on in order so output and TrajArchives.txt stay ordered.
+    runScript.Printf("}\nFinishRun() {\n  DIR=${DIRS[$NEXT]}\n  wait ${PIDS[$NEXT]}\n"
+                     "  STATUS=$?\n  cat %s/archive.$DIR.log\n"
+                     "  if [[ $STATUS -ne 0 ]] ; then\n"
+                     "    echo \"Error: Archiving $DIR failed.\" >> /dev/stderr\n"
+                     "    ERR=1\n", ARDIR.c_str());
+    if (!archiveExec_)
+      runScript.Printf("  else\n    echo \"%s/traj.$DIR.tgz\" >> TrajArchives.txt\n", ARDIR.c_str());
+    runScript.Printf("  fi\n  ((NEXT++))\n}\n"
+                     "DIRS=(%s )\nPIDS=()\nERR=0\nNEXT=0\nRUN=%i\n"
+                     "for ((IDX = 0; IDX < ${#DIRS[@]}; IDX++)) ; do\n"
+                     "  ArchiveRun ${DIRS[$IDX]} $RUN > %s/archive.${DIRS[$IDX]}.log 2>&1 &\n"
+                     "  PIDS[$IDX]=$!\n  ((RUN++))\n"
+                     "  if [[ $(($IDX + 1 - $NEXT)) -ge $NSLOTS ]] ; then\n    FinishRun\n  fi\n"
+                     "  if [[ $ERR -ne 0 ]] ; then\n    ((IDX++))\n    break\n  fi\n"
+                     "done\nwhile [[ $NEXT -lt $IDX ]] ; do\n  FinishRun\ndone\n"
+                     "if [[ $ERR -ne 0 ]] ; then\n  echo \"Archive error.\"\n  exit 1\nfi\n",
+                     runList.c_str(), start, ARDIR.c_str());
+  } else
+    runScript.Printf("  ((RUN++))\ndone\n");
+  if (archiveExec_)
+    runScript.Printf("# Write run and trajectory archives.\n"
+                     "$CREATEREMDDIRS --archive-exec %s -b %i -e %i -O\n"
+                     "if [[ $? -ne 0 ]] ; then\n  echo \"Archive error.\"\n  exit 1\nfi\n"
+                     "for DIR in%s ; do\n  echo \"%s/traj.$DIR.tgz\" >> TrajArchives.txt\ndone\n",
+                     ARDIR.c_str(), start, stop, runList.c_str(), ARDIR.c_str());
+  runScript.Printf("TOTALTIME1=`date +%%s`\n((TOTAL = $TOTALTIME1 - $TOTALTIME0))\n"
+                   "echo \"$TOTAL seconds total.\"\nexit 0\n");
+  if (runScript.Close()) return 1;
+  ChangePermissions( topDir, scriptName );
   return 0;
 }
 
 // =============================================================================
-int RemdDirs::WriteRunMD(std::string const& cmd_opts) const {
+void RemdDirs::WriteRunMD(RunPlan& plan, std::string const& run_dir,
+                          std::string const& cmd_opts) const
+{
   TextFile RunMD;
-  if (RunMD.OpenWrite("RunMD.sh")) return 1;
+  RunMD.OpenBuffer();
   RunMD.Printf("#!/bin/bash\n\n# Run executable\nTIME0=`date +%%s`\n$MPIRUN $EXEPATH -O %s\n"
                 "TIME1=`date +%%s`\n"
                 "((TOTAL = $TIME1 - $TIME0))\necho \"$TOTAL seconds.\"\n\nexit 0\n",
                 cmd_opts.c_str());
-  RunMD.Close();
-  ChangePermissions("RunMD.sh");
-  return 0;
+  plan.AddFile(run_dir + "/RunMD.sh", RunMD.Text(), true);
 }
 
 const std::string RemdDirs::groupfileName_( "groupfile" ); // TODO make these options
 const std::string RemdDirs::remddimName_("remd.dim");
 
+// RemdDirs::WriteRepInput()
+/** Format MDIN for a single replica and set its groupfile line. Only reads
+  * shared state, so it can be called for different replicas in parallel.
+  * \param rep Replica index.
+  * \param irest irest value for MDIN.
+  * \param ntx ntx value for MDIN.
+  */
+void RemdDirs::WriteRepInput(unsigned int rep, RepInput& RI, int irest, int ntx) const
+{
+  std::string mdin_name("INPUT/in." + RI.EXT);
+  TextFile MDIN;
+  MDIN.OpenBuffer();
+  MDIN.Printf("%s", runDescription_.c_str());
+  // Write indices to mdin for MREMD
+  if (Dims_.size() > 1) {
+    MDIN.Printf(" {");
+    for (Iarray::const_iterator count = RI.Indices.begin(); count != RI.Indices.end(); ++count)
+      MDIN.Printf(" %u", *count + 1);
+    MDIN.Printf(" }");
+  }
+  // for Top %u at %g K 
+  MDIN.Printf(" (rep %u), %g ps/exchg\n"
+              " &cntrl\n"
+              "    imin = 0, nstlim = %i, dt = %f,\n",
+              rep+1, dt_ * (double)nstlim_, nstlim_, dt_);
+  if (!override_irest_)
+    MDIN.Printf("    irest = %i, ntx = %i, ig = %i, numexchg = %i,\n",
+                irest, ntx, ig_, numexchg_);
+  else
+    MDIN.Printf("    ig = %i, numexchg = %i,\n", ig_, numexchg_);
+  if (ph_dim_ != -1)
+    MDIN.Printf("    solvph = %f,\n", Dims_[ph_dim_]->SolvPH( RI.Indices[ph_dim_] ));
+  MDIN.Printf("    temp0 = %f, tempi = %f,\n%s", RI.Temp0, RI.Temp0,
+              additionalInput_.c_str());
+  for (unsigned int id = 0; id != Dims_.size(); id++)
+    Dims_[id]->WriteMdin(RI.Indices[id], MDIN);
+  MDIN.Printf(" &end\n");
+  RI.Mdin = MDIN.Text();
+  // Groupfile line
+  std::string INPUT_CRD = crd_dir_ + "/" + RI.EXT + ".rst7";
+  RI.Groupline = "-O -remlog rem.log -i " + mdin_name +
+    " -p " + RI.Top + " -c " + INPUT_CRD + " -o OUTPUT/rem.out." + RI.EXT +
+    " -inf INFO/reminfo." + RI.EXT + " -r RST/" + RI.EXT + 
+    ".rst7 -x TRAJ/rem.crd." + RI.EXT;
+  if (uselog_)
+    RI.Groupline.append(" -l LOG/logfile." + RI.EXT);
+  if (ph_dim_ != -1)
+    RI.Groupline.append(" -cpin " + cpin_file_ +
+                        " -cpout CPH/cpout." + RI.EXT +
+                        " -cprestrt CPH/cprestrt." + RI.EXT);
+  for (unsigned int id = 0; id != Dims_.size(); id++)
+    RI.Groupline += Dims_[id]->Groupline(RI.EXT);
+}
+
 // RemdDirs::CreateRemd()
-int RemdDirs::CreateRemd(int start_run, int run_num, std::string const& run_dir) {
-  typedef std::vector<unsigned int> Iarray;
-  // Create and change to run directory.
-  if (Mkdir(run_dir)) return 1;
-  if (ChangeDir(run_dir)) return 1;
+/** Replica parameters (dimension indices, topology, temperature) are first
+  * determined serially, checking each distinct topology only once. MDIN
+  * contents are then formatted in parallel and added to the plan, followed
+  * by the groupfile in replica order.
+  */
+int RemdDirs::CreateRemd(int start_run, int run_num, DirHandle const& topDir,
+                         std::string const& run_dir, RunPlan& plan)
+{
+  // Plan run directory; names below are relative to it.
+  plan.AddDir(run_dir);
   // Ensure that coords directory exists.
-  if (!fileExists(crd_dir_)) {
+  if (!plan.Exists(topDir, run_dir, crd_dir_)) {
     ErrorMsg("Coords directory '%s' not found. Must specify absolute path"
              " or path relative to '%s'\n", crd_dir_.c_str(), run_dir.c_str());
     return 1;
   }
   // If constant pH, ensure CPIN file exists
-  if (ph_dim_ != -1 && !fileExists(cpin_file_)) {
+  if (ph_dim_ != -1 && !plan.Exists(topDir, run_dir, cpin_file_)) {
     ErrorMsg("CPIN file '%s' not found. Must specify absolute path"
              " or path relative to '%s'\n", cpin_file_.c_str(), run_dir.c_str());
     return 1;
   }
-  // Calculate ps per exchange
-  double ps_per_exchg = dt_ * (double)nstlim_;
   // Do we need to setup groups for MREMD?
-  bool setupGroups = (groups_.Empty() && Dims_.size() > 1);
-  if (setupGroups)
-    groups_.SetupGroups( Dims_.size() );
+  if (groups_.Empty() && Dims_.size() > 1) {
+    Groups::Iarray sizes;
+    for (DimArray::const_iterator dim = Dims_.begin(); dim != Dims_.end(); ++dim)
+      sizes.push_back( (*dim)->Size() );
+    if (grid_.empty()) {
+      if (groups_.SetupGroups( sizes )) return 1;
+    } else {
+      if (groups_.SetupGroups( sizes, grid_ )) return 1;
+    }
+  }
   // Create INPUT directory if not present.
   std::string input_dir("INPUT");
-  if (Mkdir(input_dir)) return 1;
-  // Open GROUPFILE
-  TextFile GROUPFILE;
-  if (GROUPFILE.OpenWrite(groupfileName_)) return 1; 
+  plan.AddDir(run_dir + "/" + input_dir);
   // Figure out max width of replica extension
   int width = std::max(DigitWidth( totalReplicas_ ), 3);
+  // irest/ntx
+  int irest = 1;
+  int ntx = 5;
+  if (!override_irest_) {
+    if (run_num == 0) {
+      Msg("    Run 0: irest=0, ntx=1\n");
+      irest = 0;
+      ntx = 1;
+    }
+  } else
+    Msg("    Using irest/ntx from MDIN.\n");
+  // Determine parameters for each replica.
+  std::vector<RepInput> Reps( totalReplicas_ );
+  std::set<std::string> topsFound;
   // Hold current indices in each dimension.
   Iarray Indices( Dims_.size(), 0 );
   std::string currentTop = top_file_;
   double currentTemp0 = temp0_;
   for (unsigned int rep = 0; rep != totalReplicas_; rep++)
   {
+    if (!grid_.empty()) Indices = grid_[rep];
     // Get topology/temperature for this replica if necessary.
     if (top_dim_ != -1) currentTop = Dims_[top_dim_]->TopName( Indices[top_dim_]  );
     if (temp0_dim_ != -1) currentTemp0 = Dims_[temp0_dim_]->Temp0( Indices[temp0_dim_] );
     // Ensure topology exists.
-    if (!fileExists( currentTop )) {
-      ErrorMsg("Topology '%s' not found. Must specify absolute path"
-               " or path relative to '%s'\n", currentTop.c_str(), run_dir.c_str());
-      return 1;
+    if (topsFound.find( currentTop ) == topsFound.end()) {
+      if (!plan.Exists( topDir, run_dir, currentTop )) {
+        ErrorMsg("Topology '%s' not found. Must specify absolute path"
+                 " or path relative to '%s'\n", currentTop.c_str(), run_dir.c_str());
+        return 1;
+      }
+      topsFound.insert( currentTop );
     }
+    RepInput& RI = Reps[rep];
+    RI.Indices = Indices;
+    RI.Top = currentTop;
+    RI.Temp0 = currentTemp0;
+    // Replica extension. 
+    RI.EXT = integerToString(rep+1, width);
     // Info for this replica.
     if (debug_ > 1) {
       Msg("\tReplica %u: top=%s  temp0=%f", rep+1, currentTop.c_str(), currentTemp0);
@@ -617,76 +1269,10 @@ int RemdDirs::CreateRemd(int start_run, int run_num, std::string const& run_dir)
       for (Iarray::const_iterator count = Indices.begin(); count != Indices.end(); ++count)
         Msg(" %u", *count);
       Msg(" }\n");
+      Msg("\t\tMDIN: %s/in.%s\n", input_dir.c_str(), RI.EXT.c_str());
+      Msg("\t\tINPCRD: %s/%s.rst7\n", crd_dir_.c_str(), RI.EXT.c_str());
     }
-    // Save group info
-    if (setupGroups)
-      groups_.AddReplica( Indices, rep+1 );
-    // Replica extension. 
-    std::string EXT = integerToString(rep+1, width);
-    // Create input
-    int irest = 1;
-    int ntx = 5;
-    if (!override_irest_) {
-      if (run_num == 0) {
-        if (rep ==0)
-          Msg("    Run 0: irest=0, ntx=1\n");
-        irest = 0;
-        ntx = 1;
-      }
-    } else
-      Msg("    Using irest/ntx from MDIN.\n");
-    std::string mdin_name(input_dir + "/in." + EXT);
-    if (debug_ > 1)
-      Msg("\t\tMDIN: %s\n", mdin_name.c_str());
-    TextFile MDIN;
-    if (MDIN.OpenWrite(mdin_name)) return 1;
-    MDIN.Printf("%s", runDescription_.c_str());
-    // Write indices to mdin for MREMD
-    if (Dims_.size() > 1) {
-      MDIN.Printf(" {");
-      for (Iarray::const_iterator count = Indices.begin(); count != Indices.end(); ++count)
-        MDIN.Printf(" %u", *count + 1);
-      MDIN.Printf(" }");
-    }
-    // for Top %u at %g K 
-    MDIN.Printf(" (rep %u), %g ps/exchg\n"
-                " &cntrl\n"
-                "    imin = 0, nstlim = %i, dt = %f,\n",
-                rep+1, ps_per_exchg, nstlim_, dt_);
-    if (!override_irest_)
-      MDIN.Printf("    irest = %i, ntx = %i, ig = %i, numexchg = %i,\n",
-                  irest, ntx, ig_, numexchg_);
-    else
-      MDIN.Printf("    ig = %i, numexchg = %i,\n", ig_, numexchg_);
-    if (ph_dim_ != -1)
-      MDIN.Printf("    solvph = %f,\n", Dims_[ph_dim_]->SolvPH( Indices[ph_dim_] ));
-    MDIN.Printf("    temp0 = %f, tempi = %f,\n%s", currentTemp0, currentTemp0,
-                additionalInput_.c_str());
-    for (unsigned int id = 0; id != Dims_.size(); id++)
-      Dims_[id]->WriteMdin(Indices[id], MDIN);
-    MDIN.Printf(" &end\n");
-    MDIN.Close();
-    // Write to groupfile
-    std::string INPUT_CRD = crd_dir_ + "/" + EXT + ".rst7";
-    if (run_num == start_run && !fileExists( INPUT_CRD )) {
-      ErrorMsg("Coords %s not found.\n", INPUT_CRD.c_str());
-      return 1;
-    }
-    if (debug_ > 1)
-      Msg("\t\tINPCRD: %s\n", INPUT_CRD.c_str());
-    std::string GROUPFILE_LINE = "-O -remlog rem.log -i " + mdin_name +
-      " -p " + currentTop + " -c " + INPUT_CRD + " -o OUTPUT/rem.out." + EXT +
-      " -inf INFO/reminfo." + EXT + " -r RST/" + EXT + 
-      ".rst7 -x TRAJ/rem.crd." + EXT;
-    if (uselog_)
-      GROUPFILE_LINE.append(" -l LOG/logfile." + EXT);
-    if (ph_dim_ != -1)
-      GROUPFILE_LINE.append(" -cpin " + cpin_file_ +
-                            " -cpout CPH/cpout." + EXT +
-                            " -cprestrt CPH/cprestrt." + EXT);
-    for (unsigned int id = 0; id != Dims_.size(); id++)
-      GROUPFILE_LINE += Dims_[id]->Groupline(EXT);
-    GROUPFILE.Printf("%s\n", GROUPFILE_LINE.c_str());
+    if (!grid_.empty()) continue;
     // Increment first (fastest growing) index.
     Indices[0]++;
     // Increment remaining indices if necessary.
@@ -698,16 +1284,42 @@ int RemdDirs::CreateRemd(int start_run, int run_num, std::string const& run_dir)
       }
     }
   }
-  GROUPFILE.Close();
+  // Ensure input coordinates exist for first run.
+  if (run_num == start_run) {
+    for (std::vector<RepInput>::const_iterator RI = Reps.begin(); RI != Reps.end(); ++RI) {
+      std::string INPUT_CRD = crd_dir_ + "/" + RI->EXT + ".rst7";
+      if (!plan.Exists( topDir, run_dir, INPUT_CRD )) {
+        ErrorMsg("Coords %s not found.\n", INPUT_CRD.c_str());
+        return 1;
+      }
+    }
+  }
+  // Format input for each replica.
+  int nreps = (int)totalReplicas_;
+  int rep;
+# ifdef _OPENMP
+# pragma omp parallel for schedule(dynamic)
+# endif
+  for (rep = 0; rep < nreps; rep++)
+    WriteRepInput( rep, Reps[rep], irest, ntx );
+  // Add input and groupfile in replica order.
+  TextFile GROUPFILE;
+  GROUPFILE.OpenBuffer();
+  for (std::vector<RepInput>::iterator RI = Reps.begin(); RI != Reps.end(); ++RI) {
+    plan.AddFile(run_dir + "/" + input_dir + "/in." + RI->EXT, RI->Mdin, false);
+    RI->Mdin.clear();
+    GROUPFILE.Printf("%s\n", RI->Groupline.c_str());
+  }
+  plan.AddFile(run_dir + "/" + groupfileName_, GROUPFILE.Text(), false);
   if (debug_ > 1 && !groups_.Empty())
     groups_.PrintGroups();
   // Create remd.dim if necessary.
   if (Dims_.size() > 1) {
     TextFile REMDDIM;
-    if (REMDDIM.OpenWrite(remddimName_)) return 1;
+    REMDDIM.OpenBuffer();
     for (unsigned int id = 0; id != Dims_.size(); id++)
       groups_.WriteRemdDim(REMDDIM, id, Dims_[id]->exch_type(), Dims_[id]->description());
-    REMDDIM.Close();
+    plan.AddFile(run_dir + "/" + remddimName_, REMDDIM.Text(), false);
   }
   // Create Run script
   std::string cmd_opts;
@@ -720,21 +1332,19 @@ int RemdDirs::CreateRemd(int start_run, int run_num, std::string const& run_dir)
     cmd_opts.assign("-ng " + NG + " -groupfile " + groupfileName_ + " -rem 4");
   else
     cmd_opts.assign("-ng " + NG + " -groupfile " + groupfileName_ + " -rem 1");
-  if (WriteRunMD( cmd_opts )) return 1;
+  WriteRunMD( plan, run_dir, cmd_opts );
   // Create output directories
-  if (Mkdir( "OUTPUT" )) return 1;
-  if (Mkdir( "TRAJ"   )) return 1;
-  if (Mkdir( "RST"    )) return 1;
-  if (Mkdir( "INFO"   )) return 1;
-  if (Mkdir( "LOG"    )) return 1;
-  if (ph_dim_ != -1) {
-    if (Mkdir( "CPH" )) return 1;
-  }
+  plan.AddDir( run_dir + "/OUTPUT" );
+  plan.AddDir( run_dir + "/TRAJ"   );
+  plan.AddDir( run_dir + "/RST"    );
+  plan.AddDir( run_dir + "/INFO"   );
+  plan.AddDir( run_dir + "/LOG"    );
+  if (ph_dim_ != -1)
+    plan.AddDir( run_dir + "/CPH" );
   // Create any dimension-specific directories
   for (DimArray::const_iterator dim = Dims_.begin(); dim != Dims_.end(); ++dim) {
-    if ((*dim)->OutputDir() != 0) {
-      if (Mkdir( std::string((*dim)->OutputDir()))) return 1;
-    }
+    if ((*dim)->OutputDir() != 0)
+      plan.AddDir( run_dir + "/" + std::string((*dim)->OutputDir()) );
   }
   // Input coordinates for next run will be restarts of this
   crd_dir_ = "../" + run_dir + "/RST";
@@ -742,12 +1352,15 @@ int RemdDirs::CreateRemd(int start_run, int run_num, std::string const& run_dir)
 }
 
 // =============================================================================
-/** Create input file for MD.
-  * \param fname Name of MDIN file.
+/** Plan input file for MD.
+  * \param plan Plan to add file to.
+  * \param topDir Top directory.
+  * \param fname Name of MDIN file relative to run directory.
   * \param run_num Run number, for setting irest/ntx.
   * \param EXT Extension for restraint/dumpave files when umbrella sampling.
   */
-int RemdDirs::MakeMdinForMD(std::string const& fname, int run_num, 
+int RemdDirs::MakeMdinForMD(RunPlan& plan, DirHandle const& topDir,
+                            std::string const& fname, int run_num,
                             std::string const& EXT, std::string const& run_dir) const
 {
   // Create input
@@ -763,7 +1376,7 @@ int RemdDirs::MakeMdinForMD(std::string const& fname, int run_num,
   } else
     Msg("    Using irest/ntx from MDIN.\n");
   TextFile MDIN;
-  if (MDIN.OpenWrite(fname)) return 1;
+  MDIN.OpenBuffer();
   MDIN.Printf("%s %g ps\n"
               " &cntrl\n"
               "    imin = 0, nstlim = %i, dt = %f,\n",
@@ -784,7 +1397,7 @@ int RemdDirs::MakeMdinForMD(std::string const& fname, int run_num,
     // Restraints
     std::string rf_name(rst_file_ + EXT);
     // Ensure restraint file exists if specified.
-    if (!fileExists( rf_name )) {
+    if (!plan.Exists( topDir, run_dir, rf_name )) {
       ErrorMsg("Restraint file '%s' not found. Must specify absolute path"
                " or path relative to '%s'\n", rf_name.c_str(), run_dir.c_str());
       return 1;
@@ -796,15 +1409,16 @@ int RemdDirs::MakeMdinForMD(std::string const& fname, int run_num,
       MDIN.Printf("DUMPAVE=dumpave%s\n", EXT.c_str());
     MDIN.Printf("/\n");
   }
-  MDIN.Close();
+  plan.AddFile(run_dir + "/" + fname, MDIN.Text(), false);
   return 0;
 }
 
 // RemdDirs::CreateMD()
-int RemdDirs::CreateMD(int start_run, int run_num, std::string const& run_dir) {
-  // Create and change to run directory.
-  if (Mkdir(run_dir)) return 1;
-  if (ChangeDir(run_dir)) return 1;
+int RemdDirs::CreateMD(int start_run, int run_num, DirHandle const& topDir,
+                       std::string const& run_dir, RunPlan& plan)
+{
+  // Plan run directory; names below are relative to it.
+  plan.AddDir(run_dir);
   // Do some set up for groupfile runs.
   int width = 3;
   std::vector<std::string> crd_files;
@@ -818,7 +1432,7 @@ int RemdDirs::CreateMD(int start_run, int run_num, std::string const& run_dir) {
   // Ensure that coords file exists for first run.
   if (run_num == start_run) {
     if (n_md_runs_ < 2) {
-      if (!fileExists(crd_dir_)) {
+      if (!plan.Exists(topDir, run_dir, crd_dir_)) {
         ErrorMsg("Coords file '%s' not found. Must specify absolute path"
                  " or path relative to '%s'\n", crd_dir_.c_str(), run_dir.c_str());
         return 1;
@@ -826,7 +1440,7 @@ int RemdDirs::CreateMD(int start_run, int run_num, std::string const& run_dir) {
     } else {
       for (std::vector<std::string>::const_iterator file = crd_files.begin();
                                                     file != crd_files.end(); ++file)
-        if (!fileExists(*file)) {
+        if (!plan.Exists(topDir, run_dir, *file)) {
           ErrorMsg("Coords file '%s' not found. Must specify absolute path"
                  " or path relative to '%s'\n", file->c_str(), run_dir.c_str());
           return 1;
@@ -834,7 +1448,7 @@ int RemdDirs::CreateMD(int start_run, int run_num, std::string const& run_dir) {
     }
   }
   // Ensure topology exists.
-  if (!fileExists( top_file_ )) {
+  if (!plan.Exists( topDir, run_dir, top_file_ )) {
     ErrorMsg("Topology '%s' not found. Must specify absolute path"
              " or path relative to '%s'\n", top_file_.c_str(), run_dir.c_str());
     return 1;
@@ -846,29 +1460,29 @@ int RemdDirs::CreateMD(int start_run, int run_num, std::string const& run_dir) {
                     " -x mdcrd.nc -r mdrst.rst7 -o md.out -inf md.info");
   } else {
     TextFile GROUP;
-    if (GROUP.OpenWrite(groupfileName_)) return 1;
+    GROUP.OpenBuffer();
     for (int grp = 1; grp <= n_md_runs_; grp++) {
       std::string EXT = "." + integerToString(grp, width);
       std::string mdin_name("md.in");
       if (umbrella_ > 0) {
         // Create input for umbrella runs
         mdin_name.append(EXT);
-        if (MakeMdinForMD(mdin_name, run_num, EXT, run_dir)) return 1;
+        if (MakeMdinForMD(plan, topDir, mdin_name, run_num, EXT, run_dir)) return 1;
       }
       GROUP.Printf("-i %s -p %s -c %s -x md.nc%s -r %0*i.rst7 -o md.out%s -inf md.info%s\n",
                    mdin_name.c_str(), top_file_.c_str(), crd_files[grp-1].c_str(), EXT.c_str(),
                    width, grp, EXT.c_str(), EXT.c_str());
     } 
-    GROUP.Close();
+    plan.AddFile(run_dir + "/" + groupfileName_, GROUP.Text(), false);
     cmd_opts.assign("-ng " + integerToString(n_md_runs_) + " -groupfile " + groupfileName_);
   }
-  WriteRunMD( cmd_opts );
+  WriteRunMD( plan, run_dir, cmd_opts );
   // Info for this run.
   if (debug_ >= 0) // 1 
       Msg("\tMD: top=%s  temp0=%f\n", top_file_.c_str(), temp0_);
   // Create input for non-umbrella runs.
   if (umbrella_ == 0) {
-    if (MakeMdinForMD("md.in", run_num, "",run_dir)) return 1;
+    if (MakeMdinForMD(plan, topDir, "md.in", run_num, "",run_dir)) return 1;
   }
   // Input coordinates for next run will be restarts of this
   crd_dir_ = "../" + run_dir + "/";
@@ -2,7 +2,8 @@
 #define INC_REMDDIRS_H
 #include "ReplicaDimension.h"
 #include "Groups.h"
-#include "FileRoutines.h" // StrArray
+#include "FileRoutines.h" // StrArray, DirHandle
+class RunPlan;
 class RemdDirs {
   public:
     RemdDirs();
@@ -14,6 +15,7 @@ class RemdDirs {
     void Info() const;
     int CreateRuns(std::string const&, StrArray const&, int, bool);
     int CreateAnalyzeArchive(std::string const&, StrArray const&, int, int, bool, bool, bool, bool);
+    int ExchangeStats(std::string const&, StrArray const&) const;
 
     void SetDebug(int d) { debug_ = d; }
   private:
@@ -26,11 +28,34 @@ class RemdDirs {
       return Dims_[top_dim_]->TopName( 0 );
     }
 
+    typedef std::vector<unsigned int> Iarray;
+    /// Hold input parameters and result for a single replica of a REMD run.
+    struct RepInput {
+      Iarray Indices;        ///< Index into each dimension.
+      std::string Top;       ///< Topology file.
+      double Temp0;          ///< Temperature.
+      std::string EXT;       ///< Replica extension.
+      std::string Groupline; ///< Line for groupfile.
+      std::string Mdin;      ///< MDIN contents.
+    };
+
     int LoadDimension(std::string const&);
-    int CreateRemd(int, int, std::string const&);
-    int CreateMD(int, int, std::string const&);
-    int WriteRunMD(std::string const&) const;
-    int MakeMdinForMD(std::string const&, int, std::string const&, std::string const&) const;
+    int LoadGrid(std::string const&);
+    int EnsembleSize() const;
+    int SplitChunksByMemory(DirHandle const&, std::string const&, StrArray const&,
+                            std::string const&, int, Iarray&) const;
+    int WriteAnalysisChunks(DirHandle const&, std::string const&, StrArray const&,
+                            std::string const&, std::string const&, int, int,
+                            Iarray const&, int) const;
+    void WriteArchiveCpptraj(TextFile&, std::string const&, const char*) const;
+    int WriteArchiveScript(DirHandle const&, StrArray const&, int, int,
+                           std::string const&, std::string const&) const;
+    int CreateRemd(int, int, DirHandle const&, std::string const&, RunPlan&);
+    void WriteRepInput(unsigned int, RepInput&, int, int) const;
+    int CreateMD(int, int, DirHandle const&, std::string const&, RunPlan&);
+    void WriteRunMD(RunPlan&, std::string const&, std::string const&) const;
+    int MakeMdinForMD(RunPlan&, DirHandle const&, std::string const&, int,
+                      std::string const&, std::string const&) const;
     // File and MDIN variables
     std::string top_file_;
     std::string trajoutargs_;
@@ -43,6 +68,8 @@ class RemdDirs {
     typedef std::vector<ReplicaDimension*> DimArray;
     DimArray Dims_;               ///< Hold any replica dimensions
     unsigned int totalReplicas_;  /// Total # of replicas based on dimensions
+    std::string grid_file_;       ///< File with replica grid points; all points if empty.
+    std::vector<Iarray> grid_;    ///< Indices of each replica if sparse grid, in replica order.
     int top_dim_;                 ///< Set to index of temp0 dim or -1 = global temp
     int temp0_dim_;               ///< Set to index to topo dim or -1 = global topo
     int ph_dim_;                  ///< Set to index of ph dim or -1 = no ph
@@ -52,6 +79,12 @@ class RemdDirs {
     bool override_irest_;         ///< If true do not set irest, use from MDIN
     bool override_ntx_;           ///< If true do not set ntx, use from MDIN
     bool uselog_;                 ///< If true use -l in groupfile
+    bool dedup_;                  ///< If true hard link identical input files to InputStore
+    bool archiveExec_;            ///< If true archive script uses --archive-exec instead of tar
+    bool archiveSinglePass_;      ///< If true full and stripped trajs archived in 1 cpptraj run
+    int archiveParallel_;         ///< Max # of runs archive script archives at once.
+    int analyzeThreads_;          ///< Threads of analysis job; used to split analysis.
+    double analyzeMemory_;        ///< Memory (bytes) of analysis job; used to split analysis.
     RUNTYPE runType_;             ///< Type of run from options file.
     std::string runDescription_;  ///< Run description
     std::string additionalInput_; ///< Hold any additional MDIN input.
@@ -1,21 +1,39 @@
 #include <cstdio> // sscanf
+#include <cctype> // isalpha
 #include <sstream>   // istringstream, ostringstream
 #include "ReplicaDimension.h"
 #include "FileRoutines.h"
 #include "Messages.h"
 #include "StringRoutines.h"
+#include "TempLadder.h"
 
 const std::string ReplicaDimension::emptystring_ = "";
 
 // Should correspong to ExchType
 const char* ReplicaDimension::exchString_[] = { "NONE", "TEMPERATURE", "HAMILTONIAN", "PH" };
 
+/** Either a list of temperatures, one per line, or temperature ladder
+  * generator options (see TempLadder).
+  */
 int TemperatureDim::LoadDim(std::string const& fname) {
   TextFile infile;
   if (infile.OpenRead(fname)) return 1;
   const char* buffer = infile.Gets(); // Scan past first line.
   double temp0;
   while ( (buffer = infile.Gets()) != 0 ) {
+    if (temps_.empty()) {
+      // Generator options start with a letter.
+      const char* ptr = buffer;
+      while (*ptr == ' ' || *ptr == '\t') ++ptr;
+      if (*ptr == '#') continue;
+      if (isalpha(*ptr)) {
+        infile.Close();
+        TempLadder ladder;
+        if (ladder.ReadSpec(fname)) return 1;
+        if (ladder.Generate(temps_)) return 1;
+        break;
+      }
+    }
     if (sscanf(buffer, "%lf", &temp0) != 1) {
       ErrorMsg("Reading temperature from dim file.\n");
       return 1;
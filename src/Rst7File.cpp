@@ -0,0 +1,227 @@
+#include <cstdio>
+#include <cstdlib> // strtod
+#include <cstring> // memchr, strcmp, memcpy
+#include <limits> // quiet_NaN
+#include <algorithm> // std::min
+#include <sys/mman.h> // mmap
+#include <sys/stat.h> // fstat
+#include <fcntl.h> // open
+#include <unistd.h> // close
+#include "Rst7File.h"
+#include "Messages.h"
+
+/// Width of each value.
+static const unsigned int F_WIDTH = 12;
+/// Values per line.
+static const unsigned int F_PER_LINE = 6;
+
+Rst7File::Rst7File() :
+  data_(0),
+  size_(0),
+  natom_(0),
+  time_(0.0),
+  ncrdLines_(0),
+  velLine_(-1),
+  boxLine_(-1)
+{}
+
+Rst7File::~Rst7File() { Close(); }
+
+void Rst7File::Close() {
+  if (data_ != 0) munmap((void*)data_, size_);
+  data_ = 0;
+  size_ = 0;
+  lines_.clear();
+}
+
+/** Parse a fixed-width 12 character floating point field. The common
+  * [-]ddd.ddddddd form is parsed directly; anything else is handed to
+  * strtod. A field that cannot be parsed (e.g. '*' overflow) is NaN.
+  */
+double Rst7File::ParseF12(const char* field) {
+  static const double POW10[] = { 1.0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9,
+                                  1e10, 1e11, 1e12 };
+  const char* ptr = field;
+  const char* end = field + F_WIDTH;
+  while (ptr != end && *ptr == ' ') ++ptr;
+  bool neg = false;
+  if (ptr != end && (*ptr == '-' || *ptr == '+')) {
+    neg = (*ptr == '-');
+    ++ptr;
+  }
+  unsigned long long mant = 0;
+  int nfrac = -1;
+  for (; ptr != end; ++ptr) {
+    if (*ptr >= '0' && *ptr <= '9')
+      mant = mant * 10 + (unsigned long long)(*ptr - '0');
+    else if (*ptr == '.' && nfrac < 0)
+      nfrac = (int)(end - ptr) - 1;
+    else
+      break;
+  }
+  if (ptr == end) {
+    double val = (double)mant;
+    if (nfrac > 0) val /= POW10[nfrac];
+    return (neg ? -val : val);
+  }
+  // Not a plain fixed-point number.
+  char buf[F_WIDTH + 1];
+  memcpy(buf, field, F_WIDTH);
+  buf[F_WIDTH] = '\0';
+  char* endptr = 0;
+  double val = strtod(buf, &endptr);
+  while (*endptr == ' ') ++endptr;
+  if (endptr == buf || *endptr != '\0')
+    return std::numeric_limits<double>::quiet_NaN();
+  return val;
+}
+
+/** Map file, index lines, read # atoms and time, and determine which
+  * sections are present.
+  */
+int Rst7File::Open(std::string const& fname) {
+  Close();
+  fname_ = fname;
+  natom_ = 0;
+  time_ = 0.0;
+  ncrdLines_ = 0;
+  velLine_ = -1;
+  boxLine_ = -1;
+  int fd = open(fname.c_str(), O_RDONLY);
+  if (fd < 0) {
+    ErrorMsg("Opening file '%s'\n", fname.c_str());
+    return 1;
+  }
+  struct stat fileStat;
+  if (fstat(fd, &fileStat) != 0 || fileStat.st_size < 1) {
+    ErrorMsg("Could not get size of '%s' or file is empty.\n", fname.c_str());
+    close(fd);
+    return 1;
+  }
+  size_ = (size_t)fileStat.st_size;
+  void* ptr = mmap(0, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (ptr == MAP_FAILED) {
+    ErrorMsg("Could not map file '%s'\n", fname.c_str());
+    size_ = 0;
+    return 1;
+  }
+  data_ = (const char*)ptr;
+  // Index start of each line.
+  const char* end = data_ + size_;
+  const char* pos = data_;
+  while (pos < end) {
+    lines_.push_back( pos );
+    const char* nl = (const char*)memchr(pos, '\n', end - pos);
+    pos = (nl == 0) ? end : nl + 1;
+  }
+  // Ignore trailing blank lines.
+  const char* lend = end;
+  while (!lines_.empty()) {
+    bool blank = true;
+    for (const char* c = lines_.back(); c != lend && blank; ++c)
+      blank = (*c == ' ' || *c == '\n' || *c == '\r' || *c == '\t');
+    if (!blank) break;
+    lend = lines_.back();
+    lines_.pop_back();
+  }
+  lines_.push_back( lend );
+  unsigned int nlines = (unsigned int)lines_.size() - 1;
+  if (nlines < 2) {
+    ErrorMsg("'%s' is not an Amber ASCII restart.\n", fname.c_str());
+    return 1;
+  }
+  // Title, then # atoms and time.
+  char buf[128];
+  size_t len = std::min((size_t)(lines_[2] - lines_[1]), sizeof(buf) - 1);
+  memcpy(buf, lines_[1], len);
+  buf[len] = '\0';
+  int nread = sscanf(buf, "%li %lf", &natom_, &time_);
+  if (nread < 1 || natom_ < 0) {
+    ErrorMsg("Could not read # atoms from '%s'\n", fname.c_str());
+    return 1;
+  }
+  if (nread < 2) time_ = -1.0;
+  // Determine sections from # lines.
+  ncrdLines_ = (unsigned int)((natom_ * 3 + (F_PER_LINE - 1)) / F_PER_LINE);
+  unsigned int nrem = nlines - 2;
+  // NOTE: If only 1 coordinate line, box takes precedence over velocities.
+  if (nrem == ncrdLines_)
+    ;
+  else if (nrem == ncrdLines_ + 1)
+    boxLine_ = 2 + ncrdLines_;
+  else if (nrem == 2 * ncrdLines_)
+    velLine_ = 2 + ncrdLines_;
+  else if (nrem == 2 * ncrdLines_ + 1) {
+    velLine_ = 2 + ncrdLines_;
+    boxLine_ = 2 + 2 * ncrdLines_;
+  } else {
+    ErrorMsg("'%s': %u lines does not match %li atoms.\n", fname.c_str(), nlines, natom_);
+    return 1;
+  }
+  return 0;
+}
+
+bool Rst7File::HasVar(const char* name) const {
+  if (strcmp(name, "time") == 0)        return (time_ > -1.0);
+  if (strcmp(name, "coordinates") == 0) return true;
+  if (strcmp(name, "velocities") == 0)  return (velLine_ > -1);
+  if (strcmp(name, "cell_lengths") == 0 ||
+      strcmp(name, "cell_angles") == 0)  return (boxLine_ > -1);
+  return false;
+}
+
+long int Rst7File::DimLength(const char* name) const {
+  if (strcmp(name, "atom") == 0) return natom_;
+  return -1;
+}
+
+/** Read count elements starting at element start from the given variable. */
+int Rst7File::GetVarDouble(const char* name, unsigned int start, unsigned int count,
+                           double* out)
+{
+  if (data_ == 0) return 1;
+  if (count == 0) return 0;
+  if (!HasVar(name)) {
+    ErrorMsg("Variable '%s' not present in '%s'\n", name, fname_.c_str());
+    return 1;
+  }
+  if (strcmp(name, "time") == 0) {
+    if (start != 0 || count != 1) return 1;
+    out[0] = time_;
+    return 0;
+  }
+  unsigned long int nelems = 3;
+  unsigned int sline = 2;
+  if (strcmp(name, "cell_lengths") == 0)
+    sline = (unsigned int)boxLine_;
+  else if (strcmp(name, "cell_angles") == 0) {
+    sline = (unsigned int)boxLine_;
+    start += 3;
+    nelems += 3;
+  } else {
+    nelems = (unsigned long int)natom_ * 3;
+    if (strcmp(name, "velocities") == 0) sline = (unsigned int)velLine_;
+  }
+  unsigned int idx = start;
+  unsigned int idxEnd = start + count;
+  if ((unsigned long int)idxEnd > nelems) {
+    ErrorMsg("Reading past end of variable '%s' in '%s'\n", name, fname_.c_str());
+    return 1;
+  }
+  while (idx < idxEnd) {
+    unsigned int ln = sline + idx / F_PER_LINE;
+    unsigned int col = idx % F_PER_LINE;
+    const char* ptr = lines_[ln];
+    const char* lend = lines_[ln+1];
+    while (lend > ptr && (lend[-1] == '\n' || lend[-1] == '\r')) --lend;
+    unsigned int lastCol = std::min(F_PER_LINE, col + (idxEnd - idx));
+    if ((unsigned int)(lend - ptr) < lastCol * F_WIDTH) {
+      ErrorMsg("Line %u in '%s' is too short.\n", ln + 1, fname_.c_str());
+      return 1;
+    }
+    for (; col < lastCol; col++, idx++)
+      *(out++) = ParseF12( ptr + col * F_WIDTH );
+  }
+  return 0;
+}
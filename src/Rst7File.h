@@ -0,0 +1,41 @@
+#ifndef INC_RST7FILE_H
+#define INC_RST7FILE_H
+#include <string>
+#include <vector>
+/// Fast reader for Amber ASCII restart (rst7) files.
+/** The file is memory mapped and the start of each line is indexed. The
+  * coordinate, velocity, and box sections are located from the number of
+  * atoms and the number of lines, so only the values requested are parsed.
+  * Values are read as fixed-width 12.7 fields, 6 per line. Variables are
+  * accessed by their Amber NetCDF names ("time", "coordinates", "velocities",
+  * "cell_lengths", "cell_angles") to mirror NetcdfHeader.
+  */
+class Rst7File {
+  public:
+    Rst7File();
+    ~Rst7File();
+    /// Map file and index lines.
+    int Open(std::string const&);
+    /// Unmap file.
+    void Close();
+    /// Read the given range of elements from a variable.
+    int GetVarDouble(const char*, unsigned int, unsigned int, double*);
+    /// \return true if variable with given name is present.
+    bool HasVar(const char*) const;
+    /// \return Length of "atom" dimension, -1 for anything else.
+    long int DimLength(const char*) const;
+    std::string const& Filename() const { return fname_; }
+  private:
+    static double ParseF12(const char*);
+
+    const char* data_;              ///< Mapped file data.
+    size_t size_;                   ///< Size of mapped file data.
+    std::vector<const char*> lines_; ///< Start of each line; last is end of data.
+    std::string fname_;             ///< File name.
+    long int natom_;                ///< Number of atoms.
+    double time_;                   ///< Restart time.
+    unsigned int ncrdLines_;        ///< Number of lines in coordinate/velocity sections.
+    int velLine_;                   ///< Index of first velocity line, -1 if none.
+    int boxLine_;                   ///< Index of box line, -1 if none.
+};
+#endif
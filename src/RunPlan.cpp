@@ -0,0 +1,123 @@
+#include <cstdio>   // renameat
+#include <cerrno>
+#include <cstring>  // strerror
+#include <sys/stat.h>
+#include "RunPlan.h"
+#include "InputStore.h"
+#include "Messages.h"
+#include "StringRoutines.h" // ContentHash
+
+RunPlan::RunPlan() : checkDirOpen_(false) {}
+
+void RunPlan::AddDir(std::string const& dname) {
+  dirs_.push_back( dname );
+  planned_.insert( dname );
+}
+
+void RunPlan::AddFile(std::string const& fname, std::string const& text, bool exec) {
+  PlanFile file;
+  file.Name = fname;
+  file.Exec = exec;
+  planned_.insert( fname );
+  // Store each distinct contents once; input is mostly identical between runs.
+  unsigned long long hash = ContentHash( text );
+  std::pair<HashMap::const_iterator, HashMap::const_iterator> range = textIdx_.equal_range( hash );
+  for (HashMap::const_iterator it = range.first; it != range.second; ++it) {
+    if (texts_[it->second] == text) {
+      file.Text = it->second;
+      files_.push_back( file );
+      return;
+    }
+  }
+  file.Text = texts_.size();
+  textIdx_.insert( HashMap::value_type(hash, file.Text) );
+  texts_.push_back( text );
+  files_.push_back( file );
+}
+
+/** Check if name exists relative to planned directory dname, which must be
+  * directly under the top dir. Names planned so far count as existing. If
+  * dname does not exist yet, names starting with '../' are checked relative
+  * to the top dir (as they will be once dname is created) and any other
+  * relative name does not exist.
+  */
+bool RunPlan::Exists(DirHandle const& topDir, std::string const& dname,
+                     std::string const& fname)
+{
+  if (fname.empty()) return false;
+  if (fname[0] == '/' || fname[0] == '~') return fileExists( fname );
+  std::string topName;
+  if (fname.compare(0, 3, "../") == 0)
+    topName = fname.substr(3);
+  else
+    topName = dname + "/" + fname;
+  while (topName.size() > 1 && topName[topName.size()-1] == '/')
+    topName.resize( topName.size() - 1 );
+  if (planned_.find( topName ) != planned_.end()) return true;
+  if (dname != checkDirName_) {
+    checkDirName_ = dname;
+    checkDirOpen_ = (fileExists(topDir, dname) && checkDir_.Open(topDir, dname) == 0);
+  }
+  if (checkDirOpen_) return fileExists(checkDir_, fname);
+  if (fname.compare(0, 3, "../") == 0) return fileExists(topDir, fname.substr(3));
+  return false;
+}
+
+/** Write a single file if its contents differ from what is on disk. When
+  * using the store, an existing identical file that is not yet a link is
+  * replaced by one.
+  */
+RunPlan::FileStatus RunPlan::CommitFile(DirHandle const& topDir, PlanFile const& file,
+                                        InputStore* store) const
+{
+  std::string const& text = texts_[file.Text];
+  struct stat file_stat;
+  if (fstatat(topDir.Fd(), file.Name.c_str(), &file_stat, 0) == 0 &&
+      file_stat.st_size == (off_t)text.size() &&
+      (store == 0 || file_stat.st_nlink > 1) &&
+      SameFileContents(topDir, file.Name, text))
+    return UNCHANGED;
+  std::string tmpName( file.Name + ".tmp" );
+  int err;
+  if (store != 0)
+    err = store->Write(topDir, tmpName, text);
+  else
+    err = WriteFileContents(topDir, tmpName, text);
+  if (err != 0) return FAILED;
+  if (file.Exec && ChangePermissions(topDir, tmpName) != 0) {
+    ErrorMsg("Changing permissions of '%s': %s\n", tmpName.c_str(), strerror( errno ));
+    return FAILED;
+  }
+  if (renameat(topDir.Fd(), tmpName.c_str(), topDir.Fd(), file.Name.c_str()) != 0) {
+    ErrorMsg("Renaming '%s': %s\n", tmpName.c_str(), strerror( errno ));
+    return FAILED;
+  }
+  FileCacheInvalidate( topDir, file.Name );
+  return WRITTEN;
+}
+
+/** Create any missing directories, then write files in parallel. */
+int RunPlan::Commit(DirHandle const& topDir, InputStore* store) const {
+  for (StrArray::const_iterator dname = dirs_.begin(); dname != dirs_.end(); ++dname)
+    if (Mkdir(topDir, *dname)) return 1;
+  int nfiles = (int)files_.size();
+  int nwritten = 0;
+  int nfailed = 0;
+  int idx;
+# ifdef _OPENMP
+# pragma omp parallel for schedule(dynamic) reduction(+: nwritten, nfailed)
+# endif
+  for (idx = 0; idx < nfiles; idx++) {
+    FileStatus status = CommitFile(topDir, files_[idx], store);
+    if (status == WRITTEN)
+      nwritten++;
+    else if (status == FAILED)
+      nfailed++;
+  }
+  Msg("  %i files written, %i unchanged.\n", nwritten, nfiles - nwritten - nfailed);
+  if (nfailed > 0) {
+    ErrorMsg("%i files could not be written.\n", nfailed);
+    return 1;
+  }
+  return 0;
+}
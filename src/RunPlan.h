@@ -0,0 +1,47 @@
+#ifndef INC_RUNPLAN_H
+#define INC_RUNPLAN_H
+#include <map>
+#include <set>
+#include "FileRoutines.h" // StrArray, DirHandle
+class InputStore;
+/// Directories and files to be created for a range of runs.
+/** Run input is first planned in memory (names relative to the top directory
+  * and file contents), then committed in one step. On commit, files whose
+  * contents on disk already match are left alone; everything else is written
+  * to a temporary file and renamed into place, so a file is never seen half
+  * written. Identical contents are held only once.
+  */
+class RunPlan {
+  public:
+    RunPlan();
+    /// Add directory (relative to top dir). Parents must be added first.
+    void AddDir(std::string const&);
+    /// Add file (relative to top dir) with given contents; true if executable.
+    void AddFile(std::string const&, std::string const&, bool);
+    /// \return true if name relative to planned dir (directly under top dir) exists or is planned.
+    bool Exists(DirHandle const&, std::string const&, std::string const&);
+    /// Create directories and write changed files relative to top dir, optionally via store.
+    int Commit(DirHandle const&, InputStore*) const;
+    /// \return Number of planned files.
+    unsigned int Nfiles() const { return files_.size(); }
+  private:
+    struct PlanFile {
+      std::string Name;  ///< File name relative to top dir.
+      unsigned int Text; ///< Index into texts_.
+      bool Exec;         ///< True if file should be executable.
+    };
+    enum FileStatus { WRITTEN = 0, UNCHANGED, FAILED };
+
+    FileStatus CommitFile(DirHandle const&, PlanFile const&, InputStore*) const;
+
+    typedef std::multimap<unsigned long long, unsigned int> HashMap;
+    StrArray dirs_;                 ///< Directories, in creation order.
+    std::vector<PlanFile> files_;   ///< Files.
+    std::vector<std::string> texts_; ///< Distinct file contents.
+    HashMap textIdx_;               ///< Content hash to index into texts_.
+    std::set<std::string> planned_; ///< Names of all planned dirs and files.
+    std::string checkDirName_;      ///< Name of directory currently open for Exists().
+    DirHandle checkDir_;            ///< Directory currently open for Exists().
+    bool checkDirOpen_;             ///< True if checkDir_ could be opened.
+};
+#endif
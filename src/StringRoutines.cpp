@@ -1,5 +1,7 @@
 #include "StringRoutines.h"
 #include <cmath>
+#include <cstdlib> // strtod
+#include <cctype>  // toupper
 #include <sstream>
 
 // DigitWidth()
@@ -52,3 +54,34 @@ std::string NoTrailingWhitespace(std::string const& line) {
   RemoveTrailingWhitespace(duplicate);
   return duplicate;
 }
+
+// ByteSize()
+double ByteSize(std::string const& str) {
+  const char* ptr = str.c_str();
+  char* end = 0;
+  double bytes = strtod(ptr, &end);
+  if (end == ptr || bytes < 0.0) return -1.0;
+  if (*end != '\0') {
+    switch (toupper(*end)) {
+      case 'T' : bytes *= 1024.0;
+      case 'G' : bytes *= 1024.0;
+      case 'M' : bytes *= 1024.0;
+      case 'K' : bytes *= 1024.0; break;
+      default  : return -1.0;
+    }
+    ++end;
+    // Allow e.g. 64GB
+    if (toupper(*end) == 'B') ++end;
+    if (*end != '\0') return -1.0;
+  }
+  return bytes;
+}
+
+unsigned long long ContentHash(std::string const& str) {
+  unsigned long long hash = 14695981039346656037ULL;
+  for (std::string::const_iterator c = str.begin(); c != str.end(); ++c) {
+    hash ^= (unsigned char)(*c);
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
@@ -10,4 +10,8 @@ std::string doubleToString(double);
 void RemoveTrailingWhitespace(std::string &);
 /// \return string stripped of trailing whitespace.
 std::string NoTrailingWhitespace(std::string const&);
+/// \return Bytes in size with optional K, M, G, or T suffix (e.g. 64G), -1 if invalid.
+double ByteSize(std::string const&);
+/// \return 64 bit FNV-1a hash of string.
+unsigned long long ContentHash(std::string const&);
 #endif
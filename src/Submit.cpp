@@ -22,6 +22,8 @@ void Submit::OptHelp() {
       "  NODEARGS <arg>     : Any additonal -l node arguments (PBS only)\n"
       "  MPIRUN <command>   : Command used to execute parallel run. Can use\n"
       "                       $NODES, $THREADS, $PPN (will be set by script).\n"
+      "                       Use $NP for the # of processes (set to $THREADS) to let\n"
+      "                       analysis/archive scripts run several jobs at once.\n"
       "  MODULEFILE <file>  : File containing extra commands to run (only last one loaded used)\n"
       "  COMMANDFILE <file> : File containing any additional commands to be run.\n"
       "  ACCOUNT <name>     : Account name\n"
@@ -42,6 +44,8 @@ int Submit::SubmitRuns(std::string const& TopDir, StrArray const& RunDirs, int s
   std::string submitScript( std::string(Run_->SubmitCmd()) + ".sh" );
   std::string submitCommand( std::string(Run_->SubmitCmd()) + " " +
                              submitScript + " > " + jobIdFilename);
+  DirHandle topDir;
+  if (topDir.Open(TopDir)) return 1;
   std::string runScriptName("RunMD.sh");
   // Create run script for each run directory
   std::string previous_jobid;
@@ -54,9 +58,8 @@ int Submit::SubmitRuns(std::string const& TopDir, StrArray const& RunDirs, int s
   StrArray::const_iterator finaldir = RunDirs.end() - 1;
   for (StrArray::const_iterator rdir = RunDirs.begin(); rdir != RunDirs.end(); ++rdir)
   {
-    ChangeDir( TopDir );
     // Check if run directories already contain scripts
-    if ( !overwrite && fileExists( *rdir + "/" + submitScript) ) {
+    if ( !overwrite && fileExists( topDir, *rdir + "/" + submitScript) ) {
       ErrorMsg("Not overwriting (-O) and %s already contains %s\n",
                rdir->c_str(), submitScript.c_str());
       if (Run_->DependType() != NONE) // Exit if dependencies exist
@@ -65,12 +68,13 @@ int Submit::SubmitRuns(std::string const& TopDir, StrArray const& RunDirs, int s
         continue;
     }
     Msg("  %s\n", rdir->c_str());
-    ChangeDir( *rdir );
+    DirHandle runDir;
+    if (runDir.Open(topDir, *rdir)) return 1;
     // Ensure runscript exists.
-    if (CheckExists("run script", runScriptName)) return 1;
+    if (CheckExists(runDir, "run script", runScriptName)) return 1;
     // Set options specific to queuing system, node info, and Amber env.
     TextFile qout;
-    if (qout.OpenWrite( submitScript )) return 1;
+    if (qout.OpenWrite( runDir, submitScript )) return 1;
     if (Run_->QsubHeader(qout, run_num, previous_jobid, "")) return 1;
     // Set up command to execute run script
     qout.Printf("\n# Run executable\n./%s\n\n", runScriptName.c_str());
@@ -80,8 +84,8 @@ int Submit::SubmitRuns(std::string const& TopDir, StrArray const& RunDirs, int s
       qout.Printf("cd %s && %s %s\n", next_dir.c_str(), Run_->SubmitCmd(), submitScript.c_str());
     }
     qout.Printf("exit 0\n");
-    qout.Close();
-    ChangePermissions( submitScript );
+    if (qout.Close()) return 1;
+    ChangePermissions( runDir, submitScript );
     // Peform job submission if not testing
     if (testing_)
       Msg("Just testing. Skipping script submission.\n");
@@ -89,7 +93,8 @@ int Submit::SubmitRuns(std::string const& TopDir, StrArray const& RunDirs, int s
       Msg("Job will be submitted when previous job completes.\n");
     else {
       Msg("%s\n", submitCommand.c_str()); 
-      if ( system( submitCommand.c_str() ) ) {
+      // Submit from the run directory without changing our own directory.
+      if ( system( ("cd " + runDir.Path() + " && " + submitCommand).c_str() ) ) {
         ErrorMsg("Job submission failed.\n");
         return 1;
       }
@@ -130,35 +135,41 @@ int Submit::SubmitAnalysis(std::string const& TopDir, int start, int stop, bool
     return 1;
   }
   Analyze_->Info();
-  ChangeDir( TopDir );
+  DirHandle topDir;
+  if (topDir.Open(TopDir)) return 1;
   // Check that analysis directory, input, and script exist.
   std::string suffix(integerToString(start) + "." + integerToString(stop));
   std::string CPPDIR("Analyze." + suffix);
-  if (CheckExists("analysis input directory", CPPDIR)) return 1;
+  if (CheckExists(topDir, "analysis input directory", CPPDIR)) return 1;
   std::string inputName("batch.cpptraj.in"); // TODO make option
-  if (CheckExists("analysis input file", CPPDIR + "/" + inputName)) return 1;
+  // Runs analyzed in chunks (ANALYZE_THREADS) are merged by merge.cpptraj.in
+  if (!fileExists(topDir, CPPDIR + "/" + inputName) &&
+      fileExists(topDir, CPPDIR + "/merge.cpptraj.in"))
+    inputName.assign("merge.cpptraj.in");
+  if (CheckExists(topDir, "analysis input file", CPPDIR + "/" + inputName)) return 1;
   std::string scriptName("RunAnalysis.sh"); // TODO make option
-  if (CheckExists("analysis script", CPPDIR + "/" + scriptName)) return 1;
+  if (CheckExists(topDir, "analysis script", CPPDIR + "/" + scriptName)) return 1;
 
   // Set options specific to queuing system, node info, and Amber env.
   std::string qName( std::string(Analyze_->SubmitCmd()) + ".sh" );
   std::string qNamePath( CPPDIR + "/" + qName );
-  if (!overwrite && fileExists( qNamePath )) {
+  if (!overwrite && fileExists( topDir, qNamePath )) {
     ErrorMsg("Not overwriting existing script %s\n", qNamePath.c_str());
     return 1;
   }
   TextFile qout;
-  if (qout.OpenWrite( qNamePath )) return 1;
+  if (qout.OpenWrite( topDir, qNamePath )) return 1;
   if (Analyze_->QsubHeader(qout, -1, std::string(), "proc." + suffix + ".")) return 1;
-  qout.Printf("\n# Run script\n./%s\nexit $?\n", scriptName.c_str());
-  qout.Close();
-  ChangePermissions( qNamePath );
+  // Analysis script uses THREADS to split threads between chunks.
+  qout.Printf("\n# Run script\nexport THREADS\n./%s\nexit $?\n", scriptName.c_str());
+  if (qout.Close()) return 1;
+  ChangePermissions( topDir, qNamePath );
   // Submit job
   if (testing_)
     Msg("Just testing; not submitting analysis job.\n");
   else {
-    ChangeDir( CPPDIR );
-    std::string submitCommand( std::string(Analyze_->SubmitCmd()) + " " + qName );
+    std::string submitCommand( "cd " + topDir.FullName(CPPDIR) + " && " +
+                               std::string(Analyze_->SubmitCmd()) + " " + qName );
     if ( system( submitCommand.c_str() ) ) {
       ErrorMsg("Analysis job submission failed.\n");
       return 1;
@@ -174,16 +185,22 @@ int Submit::SubmitArchive(std::string const& TopDir, int start, int stop, bool o
     return 1;
   }
   Archive_->Info();
-  ChangeDir( TopDir );
+  DirHandle topDir;
+  if (topDir.Open(TopDir)) return 1;
   // TODO: Require or have option for dependency on analysis job.
   // Check that archive dir, input, and run script exist
   std::string suffix(integerToString(start) + "." + integerToString(stop));
   std::string ARDIR("Archive." + suffix);
-  if (CheckExists("archive input directory", ARDIR)) return 1;
+  if (CheckExists(topDir, "archive input directory", ARDIR)) return 1;
   std::string scriptName("RunArchive." + suffix + ".sh");
-  if (CheckExists("archive run script", scriptName)) return 1;
-  StrArray ar1_files = ExpandToFilenames(ARDIR + "/ar1.*.in");
-  StrArray ar2_files = ExpandToFilenames(ARDIR + "/ar2.*.in");
+  if (CheckExists(topDir, "archive run script", scriptName)) return 1;
+  StrArray ar1_files = ExpandToFilenames(topDir, ARDIR + "/ar1.*.in");
+  StrArray ar2_files = ExpandToFilenames(topDir, ARDIR + "/ar2.*.in");
+  // Single pass archive input (ARCHIVE_SINGLE_PASS) has no separate full input.
+  if (ar2_files.empty()) {
+    ar2_files = ExpandToFilenames(topDir, ARDIR + "/ar.*.in");
+    ar1_files.clear();
+  }
   if (ar2_files.empty()) {
     ErrorMsg("No archive input found in %s\n", ARDIR.c_str());
     return 1;
@@ -196,21 +213,23 @@ int Submit::SubmitArchive(std::string const& TopDir, int start, int stop, bool o
 
   // Set options specific to queuing system, node info, and Amber env.
   std::string qName("archive." + std::string(Archive_->SubmitCmd()) + "." + suffix + ".sh");
-  if (!overwrite && fileExists( qName )) {
+  if (!overwrite && fileExists( topDir, qName )) {
     ErrorMsg("Not overwriting existing script %s\n", qName.c_str());
     return 1;
   }
   TextFile qout;
-  if (qout.OpenWrite( qName )) return 1;
+  if (qout.OpenWrite( topDir, qName )) return 1;
   if (Archive_->QsubHeader(qout, -1, std::string(), "ar." + suffix + ".")) return 1;
-  qout.Printf("\n# Run script\n./%s\nexit $?\n", scriptName.c_str());
-  qout.Close();
-  ChangePermissions( qName );
+  // Archive script uses THREADS to limit runs archived at once.
+  qout.Printf("\n# Run script\nexport THREADS\n./%s\nexit $?\n", scriptName.c_str());
+  if (qout.Close()) return 1;
+  ChangePermissions( topDir, qName );
   // Submit job
   if (testing_)
     Msg("Just testing; not submitting archive job.\n");
   else {
-    std::string submitCommand( std::string(Archive_->SubmitCmd()) + " " + qName );
+    std::string submitCommand( "cd " + topDir.Path() + " && " +
+                               std::string(Archive_->SubmitCmd()) + " " + qName );
     if ( system( submitCommand.c_str() ) ) {
       ErrorMsg("Archive job submission failed.\n");
       return 1;
@@ -520,6 +539,21 @@ int Submit::QueueOpts::QsubHeader(TextFile& qout, int run_num, std::string const
   // Add any additional input
   if (!additionalCommands_.empty())
     qout.Printf("\n%s\n\n", additionalCommands_.c_str());
+  if (mpirun_.find("$NP") != std::string::npos) {
+    // Scripts running several jobs at once set NP for each from the template.
+    if (threads_ < 1) {
+      ErrorMsg("MPIRUN uses $NP but # threads not set (use THREADS or NODES/PPN).\n");
+      return 1;
+    }
+    std::string mpirunTemplate;
+    for (std::string::const_iterator ch = mpirun_.begin(); ch != mpirun_.end(); ++ch) {
+      if (*ch == '\'')
+        mpirunTemplate.append("'\\''");
+      else
+        mpirunTemplate += *ch;
+    }
+    qout.Printf("NP=$THREADS\nexport MPIRUNTEMPLATE='%s'\n", mpirunTemplate.c_str());
+  }
   qout.Printf("export MPIRUN=\"%s\"\n", mpirun_.c_str()); // TODO Combine with EXEPATH
 
   return 0;
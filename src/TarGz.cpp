@@ -0,0 +1,257 @@
+#include <cstdio>    // snprintf, renameat
+#include <algorithm> // std::min
+#include <cstring>   // memset, memcpy, strerror
+#include <cerrno>
+#include <fcntl.h>   // openat
+#include <unistd.h>  // read, write, close, readlinkat, unlinkat
+#include <sys/stat.h>
+#ifdef HAS_ZLIB
+# include <zlib.h>
+#endif
+#include "TarGz.h"
+#include "Messages.h"
+
+/// Size of tar header/data record.
+static const size_t RECORD = 512;
+
+TarGz::TarGz() :
+  archiveDir_(0),
+  fileDir_(0),
+  fd_(-1),
+  nextFile_(0),
+  inFd_(-1),
+  inLeft_(0),
+  inPad_(0),
+  ended_(false)
+{}
+
+TarGz::~TarGz() {
+  if (inFd_ > -1) close( inFd_ );
+  if (fd_ > -1) {
+    // Archive was not finished.
+    close( fd_ );
+    unlinkat( archiveDir_->Fd(), tmpName_.c_str(), 0 );
+  }
+}
+
+int TarGz::Open(DirHandle const& archiveDir, std::string const& name, DirHandle const& fileDir)
+{
+# ifdef HAS_ZLIB
+  archiveDir_ = &archiveDir;
+  fileDir_ = &fileDir;
+  name_ = name;
+  tmpName_ = name + ".tmp";
+  fd_ = openat(archiveDir.Fd(), tmpName_.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+  if (fd_ < 0) {
+    ErrorMsg("Opening archive '%s': %s\n", tmpName_.c_str(), strerror( errno ));
+    return 1;
+  }
+  return 0;
+# else
+  ErrorMsg("Cannot write archive '%s': compiled without zlib.\n", name.c_str());
+  return 1;
+# endif
+}
+
+/// Write value as octal number in field of given width, NULL terminated.
+static void OctalField(char* field, size_t width, unsigned long long value) {
+  field[width - 1] = '\0';
+  for (size_t i = width - 1; i > 0; i--, value >>= 3)
+    field[i - 1] = (char)('0' + (value & 7));
+}
+
+/** Write value as octal number in field of given width, or in the base-256
+  * encoding understood by GNU tar if it is too large for the octal digits.
+  */
+static void NumericField(char* field, size_t width, unsigned long long value) {
+  if (value < (1ULL << (3 * (width - 1))))
+    OctalField(field, width, value);
+  else {
+    memset(field, 0, width);
+    field[0] = (char)0x80;
+    for (size_t i = width - 1; i > 0; i--, value >>= 8)
+      field[i] = (char)(value & 0xFF);
+  }
+}
+
+/** Add ustar header for a file. Names longer than 100 characters are split
+  * into prefix and name at a '/'. IDs and sizes too large for their octal
+  * fields use the base-256 encoding.
+  */
+int TarGz::AddHeader(std::string const& fname, struct stat const& fstat,
+                     std::string const& linkName)
+{
+  char header[RECORD];
+  memset(header, 0, RECORD);
+  std::string name = fname;
+  std::string prefix;
+  if (name.size() > 100) {
+    size_t slash = name.find('/', name.size() - 101);
+    if (slash == std::string::npos || slash > 155) {
+      ErrorMsg("File name too long for archive: %s\n", fname.c_str());
+      return 1;
+    }
+    prefix = name.substr(0, slash);
+    name = name.substr(slash + 1);
+  }
+  memcpy(header, name.c_str(), name.size());
+  OctalField(header + 100, 8, fstat.st_mode & 07777);
+  NumericField(header + 108, 8, fstat.st_uid);
+  NumericField(header + 116, 8, fstat.st_gid);
+  unsigned long long size = (unsigned long long)fstat.st_size;
+  if (!linkName.empty()) size = 0;
+  NumericField(header + 124, 12, size);
+  OctalField(header + 136, 12, (unsigned long long)fstat.st_mtime);
+  header[156] = linkName.empty() ? '0' : '2';
+  if (linkName.size() > 100) {
+    ErrorMsg("Link target too long for archive: %s\n", fname.c_str());
+    return 1;
+  }
+  memcpy(header + 157, linkName.c_str(), linkName.size());
+  memcpy(header + 257, "ustar", 6);
+  memcpy(header + 263, "00", 2);
+  memcpy(header + 345, prefix.c_str(), prefix.size());
+  // Checksum is computed with the checksum field set to spaces.
+  memset(header + 148, ' ', 8);
+  unsigned int chksum = 0;
+  for (size_t i = 0; i != RECORD; i++)
+    chksum += (unsigned char)header[i];
+  snprintf(header + 148, 8, "%06o", chksum);
+  header[155] = ' ';
+  raw_.append(header, RECORD);
+  return 0;
+}
+
+/** Add header for next file and open it for reading. */
+int TarGz::NextFile() {
+  std::string const& fname = files_[nextFile_++];
+  struct stat fstat;
+  if (fstatat(fileDir_->Fd(), fname.c_str(), &fstat, AT_SYMLINK_NOFOLLOW) != 0) {
+    ErrorMsg("Archiving '%s': %s\n", fname.c_str(), strerror( errno ));
+    return 1;
+  }
+  if (S_ISLNK(fstat.st_mode)) {
+    char target[4096];
+    ssize_t len = readlinkat(fileDir_->Fd(), fname.c_str(), target, sizeof(target));
+    if (len < 0 || len == (ssize_t)sizeof(target)) {
+      ErrorMsg("Reading link '%s'\n", fname.c_str());
+      return 1;
+    }
+    return AddHeader(fname, fstat, std::string(target, len));
+  }
+  inFd_ = openat(fileDir_->Fd(), fname.c_str(), O_RDONLY);
+  if (inFd_ < 0) {
+    ErrorMsg("Archiving '%s': %s\n", fname.c_str(), strerror( errno ));
+    return 1;
+  }
+  inLeft_ = fstat.st_size;
+  inPad_ = (RECORD - (fstat.st_size % RECORD)) % RECORD;
+  return AddHeader(fname, fstat, std::string());
+}
+
+int TarGz::Fill(unsigned int nblocks) {
+  size_t target = nblocks * BLOCK_SIZE;
+  while (!ended_ && raw_.size() < target) {
+    if (inFd_ < 0) {
+      if (nextFile_ == files_.size()) {
+        // End of archive: two empty records.
+        raw_.append(2 * RECORD, '\0');
+        ended_ = true;
+      } else if (NextFile())
+        return 1;
+      continue;
+    }
+    if (inLeft_ > 0) {
+      size_t nread = target - raw_.size();
+      if ((off_t)nread > inLeft_) nread = (size_t)inLeft_;
+      size_t offset = raw_.size();
+      raw_.resize( offset + nread );
+      ssize_t nr = read(inFd_, &raw_[offset], nread);
+      if (nr < 0 && errno == EINTR) nr = 0;
+      else if (nr <= 0) {
+        ErrorMsg("Reading '%s' for archive: file changed size or could not be read.\n",
+                 files_[nextFile_-1].c_str());
+        return 1;
+      }
+      raw_.resize( offset + nr );
+      inLeft_ -= nr;
+    } else {
+      raw_.append((size_t)inPad_, '\0');
+      close( inFd_ );
+      inFd_ = -1;
+    }
+  }
+  out_.resize( Nblocks() );
+  return 0;
+}
+
+unsigned int TarGz::Nblocks() const {
+  return (raw_.size() + BLOCK_SIZE - 1) / BLOCK_SIZE;
+}
+
+int TarGz::Compress(unsigned int blk) {
+# ifdef HAS_ZLIB
+  size_t offset = blk * BLOCK_SIZE;
+  size_t len = std::min(BLOCK_SIZE, raw_.size() - offset);
+  z_stream strm;
+  memset(&strm, 0, sizeof(strm));
+  // windowBits 15 + 16: write gzip header/trailer.
+  if (deflateInit2(&strm, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8,
+                   Z_DEFAULT_STRATEGY) != Z_OK)
+    return 1;
+  std::string& out = out_[blk];
+  out.resize( deflateBound(&strm, len) );
+  strm.next_in = (Bytef*)(raw_.data() + offset);
+  strm.avail_in = len;
+  strm.next_out = (Bytef*)&out[0];
+  strm.avail_out = out.size();
+  int err = deflate(&strm, Z_FINISH);
+  out.resize( out.size() - strm.avail_out );
+  deflateEnd(&strm);
+  if (err != Z_STREAM_END) return 1;
+  return 0;
+# else
+  return 1;
+# endif
+}
+
+int TarGz::Write() {
+  for (StrArray::const_iterator blk = out_.begin(); blk != out_.end(); ++blk) {
+    const char* ptr = blk->data();
+    size_t nleft = blk->size();
+    while (nleft > 0) {
+      ssize_t nw = write(fd_, ptr, nleft);
+      if (nw < 0) {
+        if (errno == EINTR) continue;
+        ErrorMsg("Writing archive '%s': %s\n", tmpName_.c_str(), strerror( errno ));
+        return 1;
+      }
+      ptr += nw;
+      nleft -= nw;
+    }
+  }
+  raw_.clear();
+  out_.clear();
+  return 0;
+}
+
+int TarGz::Close() {
+  if (fd_ < 0) return 0;
+  if (!ended_ || !raw_.empty()) {
+    ErrorMsg("Internal error: archive '%s' closed before all input written.\n", name_.c_str());
+    return 1;
+  }
+  int err = close( fd_ );
+  fd_ = -1;
+  if (err != 0) {
+    ErrorMsg("Closing archive '%s': %s\n", tmpName_.c_str(), strerror( errno ));
+    unlinkat( archiveDir_->Fd(), tmpName_.c_str(), 0 );
+    return 1;
+  }
+  if (renameat(archiveDir_->Fd(), tmpName_.c_str(), archiveDir_->Fd(), name_.c_str()) != 0) {
+    ErrorMsg("Renaming '%s': %s\n", tmpName_.c_str(), strerror( errno ));
+    return 1;
+  }
+  FileCacheInvalidate( *archiveDir_, name_ );
+  return 0;
+}
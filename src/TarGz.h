@@ -0,0 +1,60 @@
+#ifndef INC_TARGZ_H
+#define INC_TARGZ_H
+#include <sys/types.h> // off_t
+#include "FileRoutines.h" // DirHandle, StrArray
+/// Write a gzip-compressed tar archive, compressing blocks in parallel.
+/** The tar stream is read in blocks of BLOCK_SIZE bytes. Each block is
+  * compressed as a separate gzip member, which gzip/tar read as a single
+  * stream, so blocks can be compressed independently. Typical use:
+  *   Open(), AddFile() for each file, then repeat Fill(), Compress() for
+  *   each block (in parallel), Write() until Done(), then Close().
+  * The archive is written to a temporary name and renamed on Close().
+  */
+class TarGz {
+  public:
+    TarGz();
+    ~TarGz();
+    /// Open archive (relative to dir) for files relative to given dir.
+    int Open(DirHandle const&, std::string const&, DirHandle const&);
+    /// Add name of file to archive.
+    void AddFile(std::string const& fname) { files_.push_back( fname ); }
+    /// Read tar stream until given # of blocks are pending or input ends.
+    int Fill(unsigned int);
+    /// \return Number of pending blocks.
+    unsigned int Nblocks() const;
+    /// Compress pending block. Different blocks can be compressed in parallel.
+    int Compress(unsigned int);
+    /// Write compressed blocks to archive.
+    int Write();
+    /// \return true once the whole tar stream has been read.
+    bool Done() const { return ended_; }
+    /// Finish archive and move it into place.
+    int Close();
+    /// \return Number of files archived.
+    unsigned int Nfiles() const { return files_.size(); }
+    /// \return Archive name.
+    std::string const& Name() const { return name_; }
+
+    static const size_t BLOCK_SIZE = 1048576;
+  private:
+    TarGz(TarGz const&);
+    TarGz& operator=(TarGz const&);
+
+    int NextFile();
+    int AddHeader(std::string const&, struct stat const&, std::string const&);
+
+    DirHandle const* archiveDir_; ///< Directory containing archive.
+    DirHandle const* fileDir_;    ///< Directory that file names are relative to.
+    std::string name_;            ///< Archive name.
+    std::string tmpName_;         ///< Name archive is written to before Close().
+    int fd_;                      ///< Archive file descriptor.
+    StrArray files_;              ///< Files to archive.
+    unsigned int nextFile_;       ///< Index into files_ of next file to read.
+    int inFd_;                    ///< Descriptor of file currently being read, -1 if none.
+    off_t inLeft_;                ///< Bytes of current file left to read.
+    off_t inPad_;                 ///< Bytes of padding after current file.
+    bool ended_;                  ///< True once end of archive has been added.
+    std::string raw_;             ///< Pending tar stream.
+    StrArray out_;                ///< Compressed pending blocks.
+};
+#endif
@@ -0,0 +1,212 @@
+#include <cmath> // erfc, exp, sqrt, floor
+#include <cstdlib> // atof, atol
+#include "TempLadder.h"
+#include "Messages.h"
+#include "TextFile.h"
+#include "FileRoutines.h"
+#include "RemLogStats.h"
+
+/// Boltzmann constant in kcal/mol/K
+static const double KB = 0.0019872041;
+
+TempLadder::TempLadder() :
+  tmin_(-1.0),
+  tmax_(-1.0),
+  accept_(-1.0),
+  cvAtom_(2.0),
+  eFluct_(-1.0),
+  cv_(-1.0),
+  natom_(-1)
+{}
+
+/** Options are <OPT> <VALUE> pairs following the '#Temperature' line:
+  *   TMIN <T>, TMAX <T>, ACCEPT <ratio>, and either NATOM <n> (with optional
+  *   CVATOM <heat capacity per atom in k>), EFLUCT <std. dev. of potential
+  *   energy at TMIN in kcal/mol>, or one or more REMLOG <file>.
+  */
+int TempLadder::ReadSpec(std::string const& fname) {
+  fname_ = fname;
+  TextFile infile;
+  TextFile::OptArray Options = infile.GetOptionsArray(fname, 0);
+  if (Options.empty()) return 1;
+  for (TextFile::OptArray::const_iterator opair = Options.begin(); opair != Options.end(); ++opair)
+  {
+    std::string const& OPT = opair->first;
+    std::string const& VAR = opair->second;
+    if      (OPT == "TMIN")   tmin_ = atof( VAR.c_str() );
+    else if (OPT == "TMAX")   tmax_ = atof( VAR.c_str() );
+    else if (OPT == "ACCEPT") accept_ = atof( VAR.c_str() );
+    else if (OPT == "NATOM")  natom_ = atol( VAR.c_str() );
+    else if (OPT == "CVATOM") cvAtom_ = atof( VAR.c_str() );
+    else if (OPT == "EFLUCT") eFluct_ = atof( VAR.c_str() );
+    else if (OPT == "REMLOG") {
+      std::string logname = tildeExpansion( VAR );
+      if (CheckExists("rem.log", logname)) return 1;
+      remlogs_.push_back( logname );
+    } else {
+      ErrorMsg("Unrecognized temperature ladder option '%s' in '%s'\n", OPT.c_str(), fname.c_str());
+      return 1;
+    }
+  }
+  if (tmin_ <= 0.0 || tmax_ <= tmin_) {
+    ErrorMsg("Temperature ladder requires 0 < TMIN < TMAX.\n");
+    return 1;
+  }
+  if (accept_ <= 0.0 || accept_ >= 1.0) {
+    ErrorMsg("Temperature ladder requires 0 < ACCEPT < 1.\n");
+    return 1;
+  }
+  if (eFluct_ > 0.0) {
+    double sigma = eFluct_ / (KB * tmin_);
+    cv_ = sigma * sigma;
+  } else if (natom_ > 0) {
+    if (cvAtom_ <= 0.0) {
+      ErrorMsg("CVATOM must be > 0.\n");
+      return 1;
+    }
+    cv_ = cvAtom_ * (double)natom_;
+  } else if (remlogs_.empty()) {
+    ErrorMsg("Temperature ladder requires NATOM, EFLUCT, or REMLOG.\n");
+    return 1;
+  }
+  return 0;
+}
+
+/** Acceptance of an exchange between T1 and T2 (T1 < T2) averaged over
+  * Gaussian energy distributions. With x = U2 - U1 (mean m, std. dev. s)
+  * and b = 1/kT1 - 1/kT2:
+  *   <min(1, exp(-b*x))> = Phi(-m/s) + exp(b^2 s^2 / 2 - b*m) Phi(m/s - b*s)
+  * Energies are in units of k so only the heat capacity C is needed.
+  */
+double TempLadder::Acceptance(double t1, double t2, double cv) {
+  double dT = t2 - t1;
+  double m = cv * dT;
+  double s = sqrt(cv * (t1*t1 + t2*t2));
+  double b = dT / (t1 * t2);
+  double p = 0.5 * erfc( m / (s * M_SQRT2) );
+  // Second term is negligible (and may overflow) far into the tail.
+  double x = (b * s - m / s) / M_SQRT2;
+  if (x < 25.0)
+    p += 0.5 * exp(0.5 * b * b * s * s - b * m) * erfc( x );
+  return p;
+}
+
+/** \return Heat capacity for the interval starting at T. */
+double TempLadder::HeatCapacity(double temp) const {
+  if (refCv_.empty()) return cv_;
+  unsigned int idx = 0;
+  while (idx + 1 < refCv_.size() && temp >= refTemps_[idx + 1])
+    ++idx;
+  return refCv_[idx];
+}
+
+/** \return Temperature above T with given acceptance. */
+double TempLadder::NextTemp(double t1, double pacc) const {
+  double cv = HeatCapacity( t1 );
+  double lo = t1;
+  double hi = t1 * 1.01;
+  for (int i = 0; i < 60 && Acceptance(t1, hi, cv) > pacc; i++)
+    hi = t1 + 2.0 * (hi - t1);
+  for (int i = 0; i < 100; i++) {
+    double mid = 0.5 * (lo + hi);
+    if (Acceptance(t1, mid, cv) > pacc)
+      lo = mid;
+    else
+      hi = mid;
+  }
+  return 0.5 * (lo + hi);
+}
+
+/** \return Temperature reached from tmin_ after nsteps with given acceptance. */
+double TempLadder::EndTemp(double pacc, unsigned int nsteps) const {
+  double temp = tmin_;
+  for (unsigned int i = 0; i != nsteps; i++)
+    temp = NextTemp(temp, pacc);
+  return temp;
+}
+
+/** Determine heat capacity of each interval of the previous run from the
+  * observed neighbor acceptance by inverting Acceptance().
+  */
+int TempLadder::Refine() {
+  if (RemLogStats::ReadValues( remlogs_.front(), refTemps_ )) return 1;
+  RemLogStats stats;
+  if (stats.Setup( refTemps_.size(), refTemps_ )) return 1;
+  for (std::vector<std::string>::const_iterator it = remlogs_.begin(); it != remlogs_.end(); ++it)
+  {
+    Msg("    Refining ladder from '%s'\n", it->c_str());
+    if (stats.Read( *it )) return 1;
+  }
+  refCv_.clear();
+  for (unsigned int idx = 0; idx + 1 < refTemps_.size(); idx++) {
+    long int attempts, accepted;
+    if (stats.NeighborCounts(idx, attempts, accepted)) {
+      ErrorMsg("No exchanges between %.2f K and %.2f K in rem.log\n",
+               refTemps_[idx], refTemps_[idx+1]);
+      return 1;
+    }
+    // Keep the estimate away from 0 and 1 so it can be inverted.
+    double pacc = ((double)accepted + 0.5) / ((double)attempts + 1.0);
+    double lo = log(1e-3);
+    double hi = log(1e9);
+    for (int i = 0; i < 100; i++) {
+      double mid = 0.5 * (lo + hi);
+      if (Acceptance(refTemps_[idx], refTemps_[idx+1], exp(mid)) > pacc)
+        lo = mid;
+      else
+        hi = mid;
+    }
+    refCv_.push_back( exp(0.5 * (lo + hi)) );
+    Msg("      %8.2f - %8.2f K: acceptance %6.4f, heat capacity %12.2f k\n",
+        refTemps_[idx], refTemps_[idx+1], pacc, refCv_.back());
+  }
+  return 0;
+}
+
+/** Determine the # of replicas needed to span TMIN to TMAX with at least
+  * the target acceptance, then the acceptance at which that many replicas
+  * end exactly at TMAX. Temperatures are rounded to 0.01 K.
+  */
+int TempLadder::Generate(Darray& temps) {
+  Msg("    Generating temperatures %g K to %g K, target acceptance %g\n",
+      tmin_, tmax_, accept_);
+  if (!remlogs_.empty()) {
+    if (Refine()) return 1;
+  } else if (eFluct_ > 0.0)
+    Msg("    Heat capacity from energy fluctuation %g kcal/mol: %g k\n", eFluct_, cv_);
+  else
+    Msg("    Heat capacity from %li atoms (%g k per atom): %g k\n", natom_, cvAtom_, cv_);
+  const double tend = tmax_ * (1.0 - 1e-12);
+  unsigned int nsteps = 0;
+  double temp = tmin_;
+  while (temp < tend) {
+    if (nsteps + 1 >= MAX_REPLICAS) {
+      ErrorMsg("More than %u replicas needed for temperature ladder.\n", MAX_REPLICAS);
+      return 1;
+    }
+    temp = NextTemp(temp, accept_);
+    ++nsteps;
+  }
+  double lo = accept_;
+  double hi = 1.0 - 1e-9;
+  for (int i = 0; i < 60; i++) {
+    double mid = 0.5 * (lo + hi);
+    if (EndTemp(mid, nsteps) >= tmax_)
+      lo = mid;
+    else
+      hi = mid;
+  }
+  double pacc = lo;
+  temps.clear();
+  temps.push_back( tmin_ );
+  temp = tmin_;
+  for (unsigned int i = 1; i < nsteps; i++) {
+    temp = NextTemp(temp, pacc);
+    temps.push_back( floor(temp * 100.0 + 0.5) / 100.0 );
+  }
+  temps.push_back( tmax_ );
+  Msg("    %u replicas, estimated neighbor acceptance %.4f\n", (unsigned int)temps.size(), pacc);
+  for (unsigned int idx = 0; idx != temps.size(); idx++)
+    Msg("      %4u %10.2f\n", idx + 1, temps[idx]);
+  return 0;
+}
@@ -0,0 +1,45 @@
+#ifndef INC_TEMPLADDER_H
+#define INC_TEMPLADDER_H
+#include <string>
+#include <vector>
+/// Generate a temperature ladder with uniform neighbor acceptance.
+/** Potential energy distributions are assumed to be Gaussian with a mean
+  * and variance determined by the heat capacity C (in units of k):
+  *   <U>(T) = C*k*T, var(U)(T) = C*(k*T)^2.
+  * For constant C the acceptance only depends on the ratio of neighboring
+  * temperatures, so the ladder is geometric. C can be estimated from the
+  * number of atoms, from measured energy fluctuations, or refined from the
+  * acceptance observed in the rem.log of a previous run, in which case C
+  * varies between temperature intervals.
+  */
+class TempLadder {
+  public:
+    typedef std::vector<double> Darray;
+    TempLadder();
+    /// Read generator options from given dimension file.
+    int ReadSpec(std::string const&);
+    /// Generate temperatures.
+    int Generate(Darray&);
+    /// \return Estimated exchange acceptance between 2 temperatures for given C.
+    static double Acceptance(double, double, double);
+  private:
+    static const unsigned int MAX_REPLICAS = 1000;
+
+    int Refine();
+    double HeatCapacity(double) const;
+    double NextTemp(double, double) const;
+    double EndTemp(double, unsigned int) const;
+
+    std::string fname_;   ///< Dimension file name.
+    std::vector<std::string> remlogs_; ///< rem.log files from a previous run.
+    Darray refTemps_;     ///< Temperatures of previous run (refinement).
+    Darray refCv_;        ///< Heat capacity for each interval of previous run.
+    double tmin_;         ///< Lowest temperature.
+    double tmax_;         ///< Highest temperature.
+    double accept_;       ///< Target neighbor acceptance.
+    double cvAtom_;       ///< Heat capacity per atom (k).
+    double eFluct_;       ///< Potential energy std. dev. at tmin_ (kcal/mol).
+    double cv_;           ///< Heat capacity (k) if not refined.
+    long int natom_;      ///< # atoms in system.
+};
+#endif
@@ -1,6 +1,12 @@
 #include <cstdio>
 #include <cstdarg>
 #include <cstring>
+#include <cerrno>
+#include <vector>
+#include <algorithm> // std::min
+#include <fcntl.h>  // open, openat
+#include <unistd.h> // close
+#include <sys/uio.h> // writev
 #include "TextFile.h"
 #include "Messages.h"
 
@@ -28,16 +34,56 @@ int TextFile::OpenPipe(std::string const& cmd) {
 }
 
 int TextFile::OpenWrite(std::string const& fname) {
-  FILE* outfile = fopen(fname.c_str(), "wb");
-  if (outfile == 0) {
+  Close();
+  fd_ = open(fname.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+  if (fd_ < 0) {
+    ErrorMsg("Opening file '%s'\n", fname.c_str());
+    return 1;
+  }
+  FileCacheInvalidate( fname );
+  fname_ = fname;
+  return 0;
+}
+
+/** Open file fname relative to directory dir for writing. An existing file
+  * is replaced rather than truncated so that a hard link to a store object
+  * (see InputStore) is never written through.
+  */
+int TextFile::OpenWrite(DirHandle const& dir, std::string const& fname) {
+  Close();
+  if (unlinkat(dir.Fd(), fname.c_str(), 0) == 0 || errno == ENOENT)
+    fd_ = openat(dir.Fd(), fname.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+  if (fd_ < 0) {
     ErrorMsg("Opening file '%s'\n", fname.c_str());
     return 1;
   }
-  file_ = (void*)outfile;
+  FileCacheInvalidate( dir, fname );
+  fname_ = fname;
   return 0;
 }
 
-void TextFile::Close() {
+/** Text is kept in memory, e.g. so that it can be compared to what is
+  * already on disk before writing.
+  */
+int TextFile::OpenBuffer() {
+  Close();
+  text_.clear();
+  isBuffer_ = true;
+  return 0;
+}
+
+int TextFile::Close() {
+  int err = 0;
+  isBuffer_ = false;
+  if (fd_ > -1) {
+    err = Flush(0, 0);
+    if (close(fd_) != 0 && err == 0) {
+      ErrorMsg("Closing file '%s': %s\n", fname_.c_str(), strerror( errno ));
+      err = 1;
+    }
+    fd_ = -1;
+    out_.clear();
+  }
   if (file_ != 0) {
     if (isPipe_) {
       pclose((FILE*)file_);
@@ -46,6 +92,7 @@ void TextFile::Close() {
       fclose((FILE*)file_);
   }
   file_ = 0;
+  return err;
 }
 
 const char* TextFile::Gets() {
@@ -81,14 +128,72 @@ int TextFile::GetColumns( const char* SEP ) {
   return (int)tokens_.size();
 }
 
+/** Write buffered output followed by len bytes at ptr to the file. */
+int TextFile::Flush(const char* ptr, size_t len) {
+  struct iovec iov[2];
+  iov[0].iov_base = (void*)out_.data();
+  iov[0].iov_len = out_.size();
+  iov[1].iov_base = (void*)ptr;
+  iov[1].iov_len = len;
+  int first = 0;
+  while (first < 2) {
+    if (iov[first].iov_len == 0) {
+      first++;
+      continue;
+    }
+    ssize_t nwritten = writev(fd_, iov + first, 2 - first);
+    if (nwritten < 0) {
+      if (errno == EINTR) continue;
+      ErrorMsg("Writing file '%s': %s\n", fname_.c_str(), strerror( errno ));
+      out_.clear();
+      return 1;
+    }
+    // Skip past what was written.
+    size_t nleft = (size_t)nwritten;
+    while (nleft > 0) {
+      size_t nskip = std::min(nleft, iov[first].iov_len);
+      iov[first].iov_base = (char*)iov[first].iov_base + nskip;
+      iov[first].iov_len -= nskip;
+      nleft -= nskip;
+      if (iov[first].iov_len == 0) first++;
+    }
+  }
+  out_.clear();
+  return 0;
+}
+
+int TextFile::Write(const char* ptr, size_t len) {
+  if (isBuffer_) {
+    text_.append( ptr, len );
+    return 0;
+  }
+  if (out_.size() + len <= OUT_SIZE) {
+    out_.append( ptr, len );
+    return 0;
+  }
+  return Flush( ptr, len );
+}
+
+/** Text is formatted into the internal buffer if it fits, otherwise into
+  * temporary space of the required size.
+  */
 int TextFile::Printf(const char *format, ...) {
-  if (file_==0) return 1;
+  if (fd_ < 0 && !isBuffer_) return 1;
   va_list args;
   va_start(args, format);
-  vsprintf(buffer_,format,args);
-  fwrite(buffer_, 1, strlen(buffer_), (FILE*)file_);
+  int len = vsnprintf(buffer_, BUF_SIZE, format, args);
   va_end(args);
-  return 0;
+  if (len < 0) {
+    ErrorMsg("Formatting output failed.\n");
+    return 1;
+  }
+  if ((unsigned int)len < BUF_SIZE)
+    return Write(buffer_, len);
+  std::vector<char> text( len + 1 );
+  va_start(args, format);
+  vsnprintf(&text[0], text.size(), format, args);
+  va_end(args);
+  return Write(&text[0], len);
 }
 
 TextFile::OptArray TextFile::GetOptionsArray(std::string const& fname, int debug) {
@@ -2,17 +2,26 @@
 #define INC_TEXTFILE_H
 #include <string>
 #include <vector>
+#include "FileRoutines.h" // DirHandle
 /// Simple wrapper for text file.
+/** Files opened for writing are written through a large output buffer that
+  * is flushed with writev() when full and on Close(), so generated files
+  * normally take a single write.
+  */
 class TextFile {
   public:
     typedef std::pair<std::string, std::string> Spair;
     typedef std::vector<Spair> OptArray;
-    TextFile() : file_(0), isPipe_(false) {}
+    TextFile() : file_(0), fd_(-1), isPipe_(false), isBuffer_(false) {}
     ~TextFile();
     int OpenRead(std::string const&);
     int OpenPipe(std::string const&);
     int OpenWrite(std::string const&);
-    void Close();
+    int OpenWrite(DirHandle const&, std::string const&);
+    /// Open for write to an internal text buffer (see Text()).
+    int OpenBuffer();
+    /// Close file. \return non-zero if buffered output could not be written.
+    int Close();
     /// \return next line in internal char buffer 
     const char* Gets();
     /// \return next line as string, no newline.
@@ -23,16 +32,28 @@ class TextFile {
     std::string const& Token(int i) const { return tokens_[i]; }
     /// Print formatted text to file.
     int Printf(const char*, ...);
+    /// \return Text written since OpenBuffer().
+    std::string const& Text() const { return text_; }
     /// \return pointer to internal buffer.
     const char* Buffer() const { return buffer_; }
     /// \return Options array from <OPT> <VAR> style file.
     OptArray GetOptionsArray(std::string const&, int);
   private:
     static const unsigned int BUF_SIZE = 8192;
+    static const size_t OUT_SIZE = 1048576; ///< Output is written when it exceeds this.
+
+    int Write(const char*, size_t);
+    int Flush(const char*, size_t);
+
     char buffer_[BUF_SIZE];
     void* file_;
+    int fd_;           ///< File descriptor when open for write.
+    std::string out_;  ///< Output not yet written to fd_.
+    std::string fname_; ///< Name of file open for write.
     typedef std::vector<std::string> Sarray;
     Sarray tokens_;
     bool isPipe_;
+    bool isBuffer_;    ///< True if writing to text_ instead of file.
+    std::string text_; ///< Text written in buffer mode.
 };
 #endif
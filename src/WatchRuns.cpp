@@ -0,0 +1,373 @@
+#include <cstdio>
+#include <map>
+#include <set>
+#include <algorithm> // std::sort
+#include <dirent.h> // opendir, readdir
+#include <unistd.h> // isatty, read, close
+#ifdef __linux__
+# include <poll.h>
+# include <sys/inotify.h>
+#endif
+#include "WatchRuns.h"
+#include "Messages.h"
+#include "MdoutHeader.h"
+#include "NetcdfHeader.h"
+#include "CheckReport.h"
+
+/// Minimum time in seconds between table updates on a terminal.
+static const double REDRAW_TTY = 1.0;
+/// Minimum time in seconds between table updates otherwise (e.g. log file).
+static const double REDRAW_LOG = 60.0;
+/// Time in seconds between terminal updates when nothing changes (ETA countdown).
+static const int REFRESH_TTY = 10;
+/// Minimum time in seconds over which frame rate is measured.
+static const double RATE_INTERVAL = 5.0;
+
+/// Hold progress of a single replica.
+struct WatchRep {
+  std::string OutName;  ///< Output file (full path).
+  std::string TrajName; ///< Trajectory file (full path).
+  int Expected;         ///< # frames expected, -1 if not yet known.
+  long int Frames;      ///< # complete frames.
+  off_t RecBegin;       ///< Offset of first frame from trajectory header.
+  off_t RecSize;        ///< Size of each frame, 0 if header not yet read.
+};
+
+/// Hold progress of a single run.
+struct WatchRun {
+  std::string Dir;              ///< Run directory name.
+  std::string Path;             ///< Run directory full path.
+  std::vector<WatchRep> Reps;   ///< Replicas.
+  std::map<std::string, unsigned int> ByName; ///< Replica index by file base name.
+  unsigned int Nrst;            ///< # restart files present.
+  long int Frames;              ///< Total # frames, all replicas.
+  long int Expected;            ///< Total # frames expected, -1 if not yet known.
+  long int RateFrames;          ///< Total # frames at start of rate interval.
+  double RateTime;              ///< Time at start of rate interval.
+  double Rate;                  ///< Frames per second (all replicas), -1 if unknown.
+};
+
+/** \return Base name of file. */
+static inline std::string BaseName(std::string const& path) {
+  size_t found = path.find_last_of("/");
+  if (found == std::string::npos) return path;
+  return path.substr(found + 1);
+}
+
+/** \return true if file name could be an output or trajectory file. */
+static inline bool IsRunFile(std::string const& name) {
+  return (name.compare(0, 8, "rem.out.") == 0 || name.compare(0, 8, "rem.crd.") == 0 ||
+          name.compare(0, 7, "md.out.")  == 0 || name.compare(0, 6, "md.nc.")   == 0);
+}
+
+/** \return Sorted full paths of files in directory with given prefix and
+  *         suffix. Unlike ExpandToFilenames, no warning if nothing matches;
+  *         files often do not exist yet when watching.
+  */
+static StrArray DirFiles(std::string const& dname, std::string const& prefix,
+                         std::string const& suffix)
+{
+  StrArray files;
+  DIR* dir = opendir( dname.c_str() );
+  if (dir == 0) return files;
+  struct dirent* ent;
+  while ( (ent = readdir(dir)) != 0 ) {
+    std::string name( ent->d_name );
+    if (name.size() > prefix.size() + suffix.size() &&
+        name.compare(0, prefix.size(), prefix) == 0 &&
+        name.compare(name.size() - suffix.size(), suffix.size(), suffix) == 0)
+      files.push_back( dname + "/" + name );
+  }
+  closedir( dir );
+  std::sort( files.begin(), files.end() );
+  return files;
+}
+
+/** Find output/trajectory files for run. Replicas already set up are kept. */
+static void ScanRunFiles(WatchRun& run) {
+  StrArray OutputFiles = DirFiles(run.Path + "/OUTPUT", "rem.out.", "");
+  StrArray TrajFiles;
+  if (!OutputFiles.empty())
+    TrajFiles = DirFiles(run.Path + "/TRAJ", "rem.crd.", "");
+  else {
+    OutputFiles = DirFiles(run.Path, "md.out.", "");
+    TrajFiles = DirFiles(run.Path, "md.nc.", "");
+  }
+  // Files are written by the MD program as it starts, so wait for all.
+  if (OutputFiles.size() != TrajFiles.size() || OutputFiles.size() <= run.Reps.size())
+    return;
+  for (unsigned int idx = run.Reps.size(); idx != OutputFiles.size(); idx++) {
+    WatchRep rep;
+    rep.OutName = OutputFiles[idx];
+    rep.TrajName = TrajFiles[idx];
+    rep.Expected = -1;
+    rep.Frames = 0;
+    rep.RecBegin = 0;
+    rep.RecSize = 0;
+    run.ByName[ BaseName(rep.OutName) ] = idx;
+    run.ByName[ BaseName(rep.TrajName) ] = idx;
+    run.Reps.push_back( rep );
+  }
+}
+
+/** Update frame count of replica. The trajectory header is only read until
+  * the frame layout is known; after that only the file size is needed.
+  * Expected frames are read from the output once the trajectory header is
+  * there, since by then the output control section has been written.
+  */
+static void UpdateRep(WatchRep& rep) {
+  off_t size;
+  time_t mtime;
+  if (GetFileStat( rep.TrajName, size, mtime )) return;
+  if (rep.RecSize == 0) {
+    if (size < 4) return;
+    NetcdfHeader nc;
+    if (nc.Open( rep.TrajName )) return;
+    if ((nc.Format() != NetcdfHeader::CDF1 && nc.Format() != NetcdfHeader::CDF2) ||
+        nc.RecSize() < 1)
+      return;
+    rep.RecBegin = nc.RecBegin();
+    rep.RecSize = nc.RecSize();
+  }
+  if (rep.Expected < 0) {
+    MdoutHeader mdout;
+    if (mdout.Read( rep.OutName ) == 0 && mdout.Ntwx() > 0) {
+      int numexchg = mdout.Numexchg();
+      if (numexchg == 0) numexchg = 1;
+      rep.Expected = (mdout.Nstlim() * numexchg) / mdout.Ntwx();
+    }
+  }
+  if (size >= rep.RecBegin)
+    rep.Frames = (long int)((size - rep.RecBegin) / rep.RecSize);
+}
+
+/** Update run totals and frame rate. \return true if frame count changed. */
+static bool UpdateRun(WatchRun& run, double now) {
+  long int prevFrames = run.Frames;
+  run.Frames = 0;
+  run.Expected = 0;
+  for (std::vector<WatchRep>::const_iterator rep = run.Reps.begin(); rep != run.Reps.end(); ++rep)
+  {
+    run.Frames += rep->Frames;
+    if (rep->Expected < 0 || run.Expected < 0)
+      run.Expected = -1;
+    else
+      run.Expected += rep->Expected;
+  }
+  // Replicas write frames at slightly different times, so measure the rate
+  // over an interval and smooth it.
+  double dt = now - run.RateTime;
+  if (dt >= RATE_INTERVAL && run.Frames > run.RateFrames) {
+    double rate = (double)(run.Frames - run.RateFrames) / dt;
+    if (run.Rate < 0.0)
+      run.Rate = rate;
+    else
+      run.Rate = 0.5 * (rate + run.Rate);
+    run.RateFrames = run.Frames;
+    run.RateTime = now;
+  }
+  return (run.Frames != prevFrames);
+}
+
+static inline bool RunComplete(WatchRun const& run) {
+  return (!run.Reps.empty() && run.Expected > 0 && run.Frames >= run.Expected);
+}
+
+/** Count restart files of a run. */
+static void CountRestarts(WatchRun& run) {
+  run.Nrst = DirFiles(run.Path + "/RST", "", ".rst7").size() +
+             DirFiles(run.Path + "/RST", "", ".ncrst").size();
+}
+
+/** Print progress table. \return Number of lines printed. */
+static unsigned int PrintTable(std::vector<WatchRun> const& Runs) {
+  Msg("  %-10s %5s %20s %9s %11s %10s %5s\n", "#Run", "Reps", "Frames", "Progress",
+      "Frames/min", "ETA", "Rst");
+  for (std::vector<WatchRun>::const_iterator run = Runs.begin(); run != Runs.end(); ++run) {
+    if (run->Reps.empty()) {
+      Msg("  %-10s %5s %20s\n", run->Dir.c_str(), "-", "Not started");
+      continue;
+    }
+    char frames[64];
+    if (run->Expected > 0)
+      sprintf(frames, "%li/%li", run->Frames, run->Expected);
+    else
+      sprintf(frames, "%li/?", run->Frames);
+    Msg("  %-10s %5zu %20s", run->Dir.c_str(), run->Reps.size(), frames);
+    if (run->Expected > 0)
+      Msg(" %8.1f%%", 100.0 * (double)run->Frames / (double)run->Expected);
+    else
+      Msg(" %9s", "-");
+    if (RunComplete(*run))
+      Msg(" %11s %10s", "-", "done");
+    else if (run->Rate > 0.0) {
+      Msg(" %11.2f", run->Rate * 60.0);
+      if (run->Expected > 0) {
+        long int eta = (long int)((double)(run->Expected - run->Frames) / run->Rate);
+        Msg("   %02li:%02li:%02li", eta / 3600, (eta / 60) % 60, eta % 60);
+      } else
+        Msg(" %10s", "-");
+    } else
+      Msg(" %11s %10s", "-", "-");
+    Msg(" %5u\n", run->Nrst);
+  }
+  fflush(stdout);
+  return (unsigned int)Runs.size() + 1;
+}
+
+#ifdef __linux__
+/** Watch TRAJ, OUTPUT, and RST directories (or the run directory for MD)
+  * of each run with inotify and keep a table of progress, frame rate, and
+  * estimated time to completion. Nothing is read until a file changes, and
+  * then only that file; the process sleeps in poll() otherwise. Returns
+  * once all runs are complete.
+  */
+int WatchRuns(std::string const& TopDir, StrArray const& RunDirs) {
+  int ifd = inotify_init();
+  if (ifd < 0) {
+    ErrorMsg("Could not initialize inotify.\n");
+    return 1;
+  }
+  const uint32_t MASK = IN_MODIFY | IN_CLOSE_WRITE | IN_CREATE | IN_MOVED_TO | IN_DELETE;
+  double now = CheckReport::WallTime();
+  std::vector<WatchRun> Runs( RunDirs.size() );
+  std::map<int, unsigned int> WatchToRun; // Watch descriptor to run index.
+  std::set<int> RstWatches;               // Watch descriptors of RST directories.
+  for (unsigned int ridx = 0; ridx != RunDirs.size(); ridx++) {
+    WatchRun& run = Runs[ridx];
+    run.Dir = RunDirs[ridx];
+    run.Path = TopDir + "/" + RunDirs[ridx];
+    run.Nrst = 0;
+    run.Frames = 0;
+    run.Expected = -1;
+    run.RateFrames = 0;
+    run.RateTime = now;
+    run.Rate = -1.0;
+    if (!fileExists( run.Path )) {
+      ErrorMsg("%s: Does not exist.\n", run.Dir.c_str());
+      close( ifd );
+      return 1;
+    }
+    const char* subdirs[] = { "", "/TRAJ", "/OUTPUT", "/RST" };
+    for (unsigned int sub = 0; sub != 4; sub++) {
+      std::string dname( run.Path + subdirs[sub] );
+      if (!fileExists( dname )) continue;
+      int wd = inotify_add_watch( ifd, dname.c_str(), MASK );
+      if (wd < 0) {
+        ErrorMsg("Could not watch '%s'\n", dname.c_str());
+        close( ifd );
+        return 1;
+      }
+      WatchToRun[wd] = ridx;
+      if (sub == 3) RstWatches.insert( wd );
+    }
+    // Initial state; watches are already in place so no change is missed.
+    ScanRunFiles( run );
+    for (std::vector<WatchRep>::iterator rep = run.Reps.begin(); rep != run.Reps.end(); ++rep)
+      UpdateRep( *rep );
+    CountRestarts( run );
+    UpdateRun( run, now );
+    run.RateFrames = run.Frames;
+  }
+  bool isTty = (isatty( fileno(stdout) ) != 0);
+  double redrawInterval = isTty ? REDRAW_TTY : REDRAW_LOG;
+  Msg("Watching %zu runs.\n", Runs.size());
+  unsigned int nlines = PrintTable( Runs );
+  double lastDraw = now;
+  bool changed = false;
+  std::vector<char> evbuf( 64 * (sizeof(struct inotify_event) + 256) );
+  for (;;) {
+    bool allDone = true;
+    for (std::vector<WatchRun>::const_iterator run = Runs.begin(); run != Runs.end(); ++run)
+      if (!RunComplete(*run)) { allDone = false; break; }
+    if (allDone) break;
+    // Sleep until something changes or a pending update is due.
+    int timeout = -1;
+    if (changed)
+      timeout = (int)((lastDraw + redrawInterval - now) * 1000.0);
+    else if (isTty)
+      timeout = REFRESH_TTY * 1000;
+    if (changed && timeout < 0) timeout = 0;
+    struct pollfd pfd;
+    pfd.fd = ifd;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    int npoll = poll( &pfd, 1, timeout );
+    now = CheckReport::WallTime();
+    if (npoll > 0) {
+      // Collect changed files; each is only updated once per wakeup.
+      std::set< std::pair<unsigned int, unsigned int> > dirtyReps;
+      std::set<unsigned int> rescanRuns;
+      std::set<unsigned int> rstRuns;
+      ssize_t len = read( ifd, &evbuf[0], evbuf.size() );
+      for (ssize_t pos = 0; pos < len; ) {
+        struct inotify_event const* ev = (struct inotify_event const*)(&evbuf[0] + pos);
+        pos += sizeof(struct inotify_event) + ev->len;
+        if (ev->mask & IN_Q_OVERFLOW) {
+          for (unsigned int ridx = 0; ridx != Runs.size(); ridx++) {
+            rescanRuns.insert( ridx );
+            rstRuns.insert( ridx );
+            for (unsigned int idx = 0; idx != Runs[ridx].Reps.size(); idx++)
+              dirtyReps.insert( std::pair<unsigned int, unsigned int>(ridx, idx) );
+          }
+          continue;
+        }
+        std::map<int, unsigned int>::const_iterator wr = WatchToRun.find( ev->wd );
+        if (wr == WatchToRun.end() || ev->len == 0) continue;
+        unsigned int ridx = wr->second;
+        if (RstWatches.count( ev->wd )) {
+          if (ev->mask & (IN_CREATE | IN_MOVED_TO | IN_DELETE)) rstRuns.insert( ridx );
+          continue;
+        }
+        std::string name( ev->name );
+        std::map<std::string, unsigned int>::const_iterator it = Runs[ridx].ByName.find( name );
+        if (it != Runs[ridx].ByName.end())
+          dirtyReps.insert( std::pair<unsigned int, unsigned int>(ridx, it->second) );
+        else if (IsRunFile( name ))
+          rescanRuns.insert( ridx );
+      }
+      for (std::set<unsigned int>::const_iterator r = rescanRuns.begin(); r != rescanRuns.end(); ++r)
+      {
+        unsigned int nprev = Runs[*r].Reps.size();
+        ScanRunFiles( Runs[*r] );
+        for (unsigned int idx = nprev; idx < Runs[*r].Reps.size(); idx++)
+          dirtyReps.insert( std::pair<unsigned int, unsigned int>(*r, idx) );
+      }
+      for (std::set<unsigned int>::const_iterator r = rstRuns.begin(); r != rstRuns.end(); ++r) {
+        CountRestarts( Runs[*r] );
+        changed = true;
+      }
+      std::set<unsigned int> updated;
+      for (std::set< std::pair<unsigned int, unsigned int> >::const_iterator dr = dirtyReps.begin();
+                                                                        dr != dirtyReps.end(); ++dr)
+      {
+        UpdateRep( Runs[dr->first].Reps[dr->second] );
+        updated.insert( dr->first );
+      }
+      for (std::set<unsigned int>::const_iterator r = updated.begin(); r != updated.end(); ++r)
+        if (UpdateRun( Runs[*r], now )) changed = true;
+    } else if (npoll < 0) {
+      ErrorMsg("Waiting for file changes.\n");
+      close( ifd );
+      return 1;
+    } else if (isTty)
+      changed = true; // Refresh ETA.
+    if (changed && now - lastDraw >= redrawInterval) {
+      // Redraw in place on a terminal.
+      if (isTty) Msg("\033[%uA\033[J", nlines);
+      nlines = PrintTable( Runs );
+      lastDraw = now;
+      changed = false;
+    }
+  }
+  close( ifd );
+  Msg("All watched runs complete:\n");
+  PrintTable( Runs );
+  return 0;
+}
+#else
+int WatchRuns(std::string const& TopDir, StrArray const& RunDirs) {
+  ErrorMsg("Watch mode requires inotify (Linux).\n");
+  return 1;
+}
+#endif
@@ -0,0 +1,5 @@
+#ifndef INC_WATCHRUNS_H
+#define INC_WATCHRUNS_H
+#include "FileRoutines.h"
+int WatchRuns(std::string const&, StrArray const&);
+#endif
@@ -1,6 +1,12 @@
 #include <cstdlib> //atoi
+#ifdef _OPENMP
+# include <omp.h>
+#endif
 #include "RemdDirs.h"
 #include "CheckRuns.h"
+#include "PerfReport.h"
+#include "WatchRuns.h"
+#include "ArchiveRuns.h"
 #include "Submit.h"
 #include "Messages.h"
 #include "FileRoutines.h"
@@ -18,6 +24,7 @@ static void CmdLineHelp() {
       "  -s            : Allow job submission in addition to input creation.\n"
       "  -O            : Overwrite.\n"
       "  -t            : Test only; do not submit.\n"
+      "  -nt <#>       : Number of threads to use (OpenMP only; default all).\n"
       "  -h | --help   : Print this help.\n"
       "  --full-help   : Print extended help.\n"
       "  --create-help : Print run creation help.\n"
@@ -27,9 +34,18 @@ static void CmdLineHelp() {
       "  --archive     : Enable archiving input creation/submit.\n"
       "  --runs        : Enable run input creation/submit (default if nothing else specified).\n"
       "  --submit      : Submit jobs to queue only.\n"
-      "  --check       : Check specified jobs only (requires NetCDF compilation).\n"
+      "  --check       : Check specified jobs only (NetCDF4 files require NetCDF compilation).\n"
       "  --nocheck     : Do not check jobs before creating analyze/archive input.\n"
-      "  --checkall    : When multiple replicas present, check all (default only first).\n\n");
+      "  --exchange-stats: Report exchange acceptance/round trips from rem.log only.\n"
+      "  --perf        : Report per-replica performance and load imbalance only.\n"
+      "  --watch       : Watch progress of running jobs until complete (Linux only).\n"
+      "  --archive-exec <dir>: Write run/trajectory archives (after archive cpptraj runs) only,\n"
+      "                  trajectory archives to <dir> (zlib only).\n"
+      "  --checkall    : When multiple replicas present, check all (default only first).\n"
+      "  --nocache     : Do not use/update index of previous check results.\n"
+      "  --deepcheck   : Check all atoms in all replica restarts and in the last frame\n"
+      "                  of each checked trajectory for corruption.\n"
+      "  --report <file>: Write check results to <file> (JSON if '.json', CSV otherwise).\n\n");
 }
 
 static void Help(bool extended) {
@@ -41,21 +57,30 @@ static void Help(bool extended) {
 }
 
 // =============================================================================
-/** There are three types of modes available:
+/** There are seven types of modes available:
   * 1) Creation: Input is created for MD runs, analysis, and/or archiving.
   * 2) Submission: Jobs are submitted for MD runs, analysis, and/or archiving.
   * 3) Check: MD runs that have already run are checked. A check is also 
   *    performed when input is created for analysis or archiving unless
   *     disabled.
-  * For now make all modes mutually exclusive.
+  * 4) Exchange statistics: rem.log files from runs that have already run
+  *    are read and exchange acceptance/round trips reported.
+  * 5) Performance: Timings from output of runs that have already run are
+  *    read and per-replica throughput and load imbalance reported.
+  * 6) Watch: Runs in progress are watched for changes and a table of
+  *    progress and estimated completion time is kept until all complete.
+  * 7) Archive execution: Run and trajectory archives that the archive
+  *    script would create with tar are written directly.
+  * For now make all modes mutually exclusive; the last mode flag given is
+  * used. '-s' only adds creation and submission to any other mode.
   */
 int main(int argc, char** argv) {
   Msg("\nCreateRemdDir: Amber run input creation/job submission/job check.\n");
   Msg("Version: %s\n", VERSION);
   Msg("Daniel R. Roe, 2017\n");
-  enum ModeType { CREATE = 0, SUBMIT, CHECK };
+  enum ModeType { CREATE = 0, SUBMIT, CHECK, EXCHSTATS, PERF, WATCH, ARCHEXEC };
   enum InputType { RUNS = 0, ANALYZE, ARCHIVE };
-  std::vector<bool> ModeEnabled( 3, false );
+  std::vector<bool> ModeEnabled( 7, false );
   std::vector<bool> InputEnabled( 3, false );
   // Command line option defaults.
   std::string input_file = "remd.opts";
@@ -67,8 +92,13 @@ int main(int argc, char** argv) {
   bool overwrite = false;
   bool checkFirst = true;
   bool runCheck = true;
+  bool useCheckCache = true;
+  bool deepCheck = false;
+  std::string checkReport;
+  std::string archiveDir;
   bool testOnly = false;
   std::string qfile = "qsub.opts";
+  int nthreads = 0;
   // Get command line options
   for (int iarg = 1; iarg < argc; iarg++) {
     std::string Arg( argv[iarg] );
@@ -82,6 +112,8 @@ int main(int argc, char** argv) {
       crd_dir.assign( argv[++iarg] );
     else if (Arg == "-d" && iarg+1 != argc)       // Debug level
       debug = atoi(argv[++iarg]);
+    else if (Arg == "-nt" && iarg+1 != argc)      // Number of threads
+      nthreads = atoi(argv[++iarg]);
     else if (Arg == "-h" || Arg == "--help") {    // Print help and exit
       Help(false);
       return 0;
@@ -109,17 +141,34 @@ int main(int argc, char** argv) {
     else if (Arg == "--archive")                  // Enable ARCHIVE input
       InputEnabled[ARCHIVE] = true; 
     else if (Arg == "--check") {                  // Enable CHECK mode only
+      ModeEnabled.assign( ModeEnabled.size(), false );
       ModeEnabled[CHECK] = true;
-      ModeEnabled[CREATE] = false;
-      ModeEnabled[SUBMIT] = false;
+    } else if (Arg == "--exchange-stats") {       // Enable exchange statistics mode only
+      ModeEnabled.assign( ModeEnabled.size(), false );
+      ModeEnabled[EXCHSTATS] = true;
+    } else if (Arg == "--perf") {                 // Enable performance report mode only
+      ModeEnabled.assign( ModeEnabled.size(), false );
+      ModeEnabled[PERF] = true;
+    } else if (Arg == "--watch") {                // Enable watch mode only
+      ModeEnabled.assign( ModeEnabled.size(), false );
+      ModeEnabled[WATCH] = true;
+    } else if (Arg == "--archive-exec" && iarg+1 != argc) { // Enable archive execution mode only
+      archiveDir.assign( argv[++iarg] );
+      ModeEnabled.assign( ModeEnabled.size(), false );
+      ModeEnabled[ARCHEXEC] = true;
     } else if (Arg == "--checkall")               // Check all replicas, not just first.
       checkFirst = false;
+    else if (Arg == "--nocache")                  // Do not use check index.
+      useCheckCache = false;
+    else if (Arg == "--deepcheck")                // Scan all atoms in restarts/last frames.
+      deepCheck = true;
+    else if (Arg == "--report" && iarg+1 != argc) // Check report file.
+      checkReport.assign( argv[++iarg] );
     else if (Arg == "-q" && iarg+1 != argc)       // SUBMIT input file
       qfile.assign( argv[++iarg] );
     else if (Arg == "--submit") {                 // Enable SUBMIT mode only
+      ModeEnabled.assign( ModeEnabled.size(), false );
       ModeEnabled[SUBMIT] = true;
-      ModeEnabled[CHECK] = false;
-      ModeEnabled[CREATE] = false;
     } else if (Arg == "-s") {                     // Enable SUBMIT mode in addition to creation.
       ModeEnabled[CREATE] = true;
       ModeEnabled[SUBMIT] = true;
@@ -134,7 +183,9 @@ int main(int argc, char** argv) {
   if (stop_run == -1)
     stop_run = start_run;
   // By default enable CREATE Mode and RUNS Input
-  if (!ModeEnabled[CREATE] && !ModeEnabled[SUBMIT] && !ModeEnabled[CHECK])
+  if (!ModeEnabled[CREATE] && !ModeEnabled[SUBMIT] && !ModeEnabled[CHECK] &&
+      !ModeEnabled[EXCHSTATS] && !ModeEnabled[PERF] && !ModeEnabled[WATCH] &&
+      !ModeEnabled[ARCHEXEC])
     ModeEnabled[CREATE] = true;
   if (!InputEnabled[RUNS] && !InputEnabled[ANALYZE] && !InputEnabled[ARCHIVE])
     InputEnabled[RUNS] = true;
@@ -151,6 +202,14 @@ int main(int argc, char** argv) {
     ErrorMsg("STOP_RUN < START_RUN\n");
     return 1;
   }
+# ifdef _OPENMP
+  if (nthreads > 0)
+    omp_set_num_threads( nthreads );
+  Msg("  THREADS          : %i\n", omp_get_max_threads());
+# else
+  if (nthreads > 1)
+    Msg("Warning: Compiled without OpenMP; '-nt %i' ignored.\n", nthreads);
+# endif
   std::string TopDir = GetWorkingDir();
   if (TopDir.empty()) return 1;
   Msg("Working Dir: %s\n", TopDir.c_str());
@@ -177,7 +236,7 @@ int main(int argc, char** argv) {
     // If analysis or archive input requested, run check unless explicitly told not to.
     if (InputEnabled[ANALYZE] || InputEnabled[ARCHIVE]) {
       if (runCheck) {
-        if (CheckRuns( TopDir, RunDirs, checkFirst )) return 1;
+        if (CheckRuns( TopDir, RunDirs, checkFirst, useCheckCache, deepCheck, checkReport )) return 1;
       } else
         Msg("Warning: Not running check on run directories.\n");
       create.CreateAnalyzeArchive(TopDir, RunDirs, start_run, stop_run, overwrite, runCheck,
@@ -186,11 +245,30 @@ int main(int argc, char** argv) {
   }
   // ----- Run Check -----------------------------
   if (ModeEnabled[CHECK]) {
-    if (CheckRuns( TopDir, RunDirs, checkFirst )) return 1;
+    if (CheckRuns( TopDir, RunDirs, checkFirst, useCheckCache, deepCheck, checkReport )) return 1;
+  }
+  // ----- Exchange Statistics -------------------
+  if (ModeEnabled[EXCHSTATS]) {
+    RemdDirs create;
+    create.SetDebug(debug);
+    if (create.ReadOptions( input_file, start_run )) return 1;
+    if (create.Setup( crd_dir, false )) return 1;
+    if (create.ExchangeStats( TopDir, RunDirs )) return 1;
+  }
+  // ----- Performance Report --------------------
+  if (ModeEnabled[PERF]) {
+    if (PerfReport( TopDir, RunDirs )) return 1;
+  }
+  // ----- Watch Runs ----------------------------
+  if (ModeEnabled[WATCH]) {
+    if (WatchRuns( TopDir, RunDirs )) return 1;
+  }
+  // ----- Archive Execution --------------------
+  if (ModeEnabled[ARCHEXEC]) {
+    if (ArchiveRuns( TopDir, RunDirs, archiveDir, overwrite )) return 1;
   }
   // ----- Job submission ------------------------
   if (ModeEnabled[SUBMIT]) {
-    ChangeDir( TopDir );
     Submit submit;
     submit.SetDebug(debug);
     submit.SetTesting( testOnly );
@@ -30,6 +30,21 @@ RunTest() {
   fi
 }
 
+# Run test that is expected to fail; error messages go to output.
+RunErrorTest() {
+  if [[ -z $OPTLINE ]] ; then
+    echo "Error: OPTLINE not set" > /dev/stderr
+    exit 1
+  fi
+  echo "  Test: $1"
+  echo "  Test: $1" >> $TEST_RESULTS
+  $VALGRIND $BIN $OPTLINE >> $OUTPUT 2>&1
+  if [[ $? -eq 0 ]] ; then
+    echo "Program did not report an error." > $TEST_ERROR
+    exit 1
+  fi
+}
+
 DoTest() {
   ((NUMTEST++))
   if [[ ! -f "$1" ]] ; then
@@ -2,7 +2,7 @@
 
 . ../MasterTest.sh
 
-CleanFiles run.000 Analyze.0.0
+CleanFiles run.000 run.001 run.002 run.003 Analyze.0.0 Analyze.0.1 Analyze.0.3
 
 mkdir -p run.000/TRAJ
 touch run.000/TRAJ/rem.crd.001
@@ -12,4 +12,24 @@ RunTest "Analyze input test"
 DoTest batch.cpptraj.in.save Analyze.0.0/batch.cpptraj.in
 DoTest RunAnalysis.sh.save Analyze.0.0/RunAnalysis.sh
 
+mkdir -p run.001/TRAJ
+touch run.001/TRAJ/rem.crd.001
+OPTLINE="-i chunks.opts -b 0 -e 1 --analyze --nocheck"
+RunTest "Analyze input in chunks test"
+DoTest run0-0.cpptraj.in.save Analyze.0.1/run0-0.cpptraj.in
+DoTest run1-1.cpptraj.in.save Analyze.0.1/run1-1.cpptraj.in
+DoTest merge.cpptraj.in.save Analyze.0.1/merge.cpptraj.in
+DoTest RunAnalysis.chunks.sh.save Analyze.0.1/RunAnalysis.sh
+
+# Split by memory estimated from topology atoms and trajectory frames.
+for RUN in run.000 run.001 run.002 run.003 ; do
+  mkdir -p $RUN/TRAJ
+  cp ../Test_Check/run.000/TRAJ/rem.crd.001 $RUN/TRAJ/rem.crd.001
+done
+OPTLINE="-i memory.opts -b 0 -e 3 --analyze --nocheck"
+RunTest "Analyze input split by memory test"
+DoTest run0-1.cpptraj.in.save Analyze.0.3/run0-1.cpptraj.in
+DoTest run2-3.cpptraj.in.save Analyze.0.3/run2-3.cpptraj.in
+DoTest merge.memory.cpptraj.in.save Analyze.0.3/merge.cpptraj.in
+
 EndTest
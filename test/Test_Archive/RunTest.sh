@@ -13,4 +13,13 @@ DoTest ar1.0.cpptraj.in.save Archive.0.0/ar1.0.cpptraj.in
 DoTest ar2.0.cpptraj.in.save Archive.0.0/ar2.0.cpptraj.in
 DoTest RunArchive.0.0.sh.save RunArchive.0.0.sh
 
+OPTLINE="-i single.opts -b 0 -e 0 --archive --nocheck -O"
+RunTest "Single pass archive input test."
+DoTest ar.0.cpptraj.in.save Archive.0.0/ar.0.cpptraj.in
+DoTest RunArchive.single.sh.save RunArchive.0.0.sh
+
+OPTLINE="-i parallel.opts -b 0 -e 0 --archive --nocheck -O"
+RunTest "Parallel archive input test."
+DoTest RunArchive.parallel.sh.save RunArchive.0.0.sh
+
 EndTest
@@ -0,0 +1,25 @@
+#!/bin/bash
+
+. ../MasterTest.sh
+
+CleanFiles run.000 Archive.0.0 RunArchive.0.0.sh run.000.tgz contents.out
+
+mkdir -p run.000/TRAJ run.000/INPUT
+echo "mdin" > run.000/INPUT/in.001
+echo "mdout" > run.000/mdout.001
+touch run.000/TRAJ/rem.crd.001 run.000/TRAJ/wat.nc.0 run.000/TRAJ/nowat.nc.0 run.000/TRAJ/nowat.nc.1
+seq 1 300000 > run.000/TRAJ/nowat.nc.2
+
+OPTLINE="-i archive.opts -b 0 -e 0 --archive --nocheck"
+RunTest "Archive exec script test."
+DoTest RunArchive.0.0.sh.save RunArchive.0.0.sh
+
+OPTLINE="--archive-exec Archive.0.0 -b 0 -e 0"
+RunTest "Archive exec test."
+tar -tzf run.000.tgz | sort > contents.out
+echo "-----" >> contents.out
+tar -tzf Archive.0.0/traj.run.000.tgz | sort >> contents.out
+tar -xzOf Archive.0.0/traj.run.000.tgz run.000/TRAJ/nowat.nc.2 | cmp - run.000/TRAJ/nowat.nc.2 >> contents.out
+DoTest contents.out.save contents.out
+
+EndTest
@@ -0,0 +1,49 @@
+#!/bin/bash
+
+. ../MasterTest.sh
+
+CleanFiles check.out index.out deep.out report.csv report.out zero.out vel.out broken.csv broken.out .checkruns.index
+
+# run.000 is complete, replica 2 of run.001 is short (truncated last frame).
+OPTLINE="--check -b 0 -e 1 --checkall"
+RunTest "Run check test."
+sed -n '/^Checking/,$p' $OUTPUT > check.out
+DoTest check.out.save check.out
+
+# Second check should use results from the check index.
+RunTest "Run check using index test."
+awk '/^Checking/{n++} n==2' $OUTPUT > index.out
+DoTest index.out.save index.out
+
+# Scan all atoms in all restarts.
+OPTLINE="--check -b 0 -e 1 --checkall --nocache --deepcheck"
+RunTest "Run deep restart check test."
+awk '/^Checking/{n++} n==3' $OUTPUT > deep.out
+DoTest deep.out.save deep.out
+
+# Machine-readable report; run.002 does not exist. Timings are not compared.
+OPTLINE="--check -b 0 -e 2 --checkall --report report.csv"
+RunTest "Run check report test."
+cut -d, -f1-9 report.csv > report.out
+DoTest report.out.save report.out
+
+# Last frame of replica 2 of run.003 was never written (zero-filled).
+OPTLINE="--check -b 3 -e 3 --checkall --nocache --deepcheck"
+RunTest "Run deep trajectory check test."
+awk '/^Checking/{n++} n==5' $OUTPUT > zero.out
+DoTest zero.out.save zero.out
+
+# Velocities of replica 2 of run.006 are all zero; only a warning.
+OPTLINE="--check -b 6 -e 6 --checkall --nocache --deepcheck"
+RunTest "Run deep check with zero velocities test."
+awk '/^Checking/{n++} n==6' $OUTPUT > vel.out
+DoTest vel.out.save vel.out
+
+# run.004 is missing a trajectory; run.005 after it must still be checked
+# and reported.
+OPTLINE="--check -b 4 -e 5 --checkall --nocache --report broken.csv"
+RunErrorTest "Run check report with broken run test."
+cut -d, -f1-9 broken.csv > broken.out
+DoTest broken.out.save broken.out
+
+EndTest
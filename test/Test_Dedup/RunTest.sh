@@ -0,0 +1,16 @@
+#!/bin/bash
+
+. ../MasterTest.sh
+
+CleanFiles run.000 run.001 run.002 .inputstore links.out
+
+OPTLINE="-i dedup.opts -b 0 -e 2 -c ../../CRD"
+RunTest "Input deduplication test."
+# Run 0 input differs (irest=0); runs 1 and 2 share inputs.
+stat -c '%h %n' run.00?/INPUT/in.00? run.00?/RunMD.sh run.00?/groupfile > links.out
+ls .inputstore | wc -l >> links.out
+DoTest links.out.save links.out
+DoTest in.001.save run.002/INPUT/in.001
+DoTest groupfile.save run.002/groupfile
+
+EndTest
@@ -0,0 +1,20 @@
+#!/bin/bash
+
+. ../MasterTest.sh
+
+CleanFiles stats.out gap.out
+
+# 4 temperature replicas, 2 runs of 40 exchanges each.
+OPTLINE="-i stats.opts -b 0 -e 1 --exchange-stats"
+RunTest "Exchange statistics test."
+sed -n '/^  Reading/,$p' $OUTPUT > stats.out
+DoTest stats.out.save stats.out
+
+# run.002 has no rem.log; run.003 is a copy of run.001. Exchanges must not
+# be paired across the gap. Temperatures are not in ascending order.
+OPTLINE="-i gap.opts -b 0 -e 3 --exchange-stats"
+RunTest "Exchange statistics with missing log test."
+awk '/^  Reading run.000/{n++} n==2' $OUTPUT | sed 's#/.*/Test_ExchangeStats/##' > gap.out
+DoTest gap.out.save gap.out
+
+EndTest
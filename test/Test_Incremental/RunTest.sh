@@ -0,0 +1,22 @@
+#!/bin/bash
+
+. ../MasterTest.sh
+
+CleanFiles run.000 run.001 run.002 run.003 counts.out
+
+OPTLINE="-i incr.opts -b 0 -e 2 -c ../../CRD"
+RunTest "Incremental regeneration, initial creation."
+# Same options; nothing should be rewritten.
+OPTLINE="-i incr.opts -b 0 -e 2 -c ../../CRD -O"
+RunTest "Incremental regeneration, no changes."
+# Additional run; only the new run should be written.
+OPTLINE="-i incr.opts -b 0 -e 3 -c ../../CRD -O"
+RunTest "Incremental regeneration, new run."
+# Changed NSTLIM; only MDIN files should be rewritten.
+OPTLINE="-i incr.nstlim.opts -b 0 -e 3 -c ../../CRD -O"
+RunTest "Incremental regeneration, changed MDIN."
+grep "files written" test.out > counts.out
+DoTest counts.out.save counts.out
+DoTest in.001.save run.003/INPUT/in.001
+
+EndTest
@@ -0,0 +1,12 @@
+#!/bin/bash
+
+. ../MasterTest.sh
+
+CleanFiles run.000
+
+# MDIN_FILE is longer than the TextFile formatting buffer.
+OPTLINE="-i md.opts -b 0 -e 0"
+RunTest "Long MDIN input test"
+DoTest md.in.save run.000/md.in
+
+EndTest
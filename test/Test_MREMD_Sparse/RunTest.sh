@@ -0,0 +1,14 @@
+#!/bin/bash
+
+. ../MasterTest.sh
+
+CleanFiles run.000
+
+# Second Hamiltonian only at the lowest temperature.
+OPTLINE="-i sparse.opts -b 0 -e 0 -c ../../CRD"
+RunTest "M-REMD sparse grid test."
+DoTest remd.dim.save run.000/remd.dim
+DoTest groupfile.save run.000/groupfile
+DoTest in.005.save run.000/INPUT/in.005
+
+EndTest
@@ -0,0 +1,20 @@
+#!/bin/bash
+
+. ../MasterTest.sh
+
+CleanFiles perf.out unread.out
+
+# 4 replicas, 2 runs. Timing for run.001 replica 4 is only in its logfile.
+OPTLINE="-b 0 -e 1 --perf"
+RunTest "Performance report test."
+sed -n '/^Performance report/,$p' $OUTPUT > perf.out
+DoTest perf.out.save perf.out
+
+# run.002 is run.001 with empty outputs for replicas 2 and 4; replica 4
+# still has its logfile, replica 2 does not.
+OPTLINE="-b 0 -e 2 --perf"
+RunTest "Performance report with unreadable output test."
+awk '/^Performance report/{n++} n==2' $OUTPUT > unread.out
+DoTest unread.out.save unread.out
+
+EndTest
@@ -0,0 +1,24 @@
+#!/bin/bash
+
+. ../MasterTest.sh
+
+CleanFiles run.000 ladder.out refine.out tremd.out
+
+OPTLINE="-i ladder.opts -b 0 -e 0 -c ../../CRD"
+RunTest "Temperature ladder generation test."
+sed -n '/^    Generating/,/^    Dim/p' $OUTPUT > ladder.out
+DoTest ladder.out.save ladder.out
+DoTest in.012.save run.000/INPUT/in.012
+
+OPTLINE="-i refine.opts -b 0 -e 0 --exchange-stats"
+RunTest "Temperature ladder refinement test."
+sed -n '/^    Refining/,/^    Dim/p' $OUTPUT > refine.out
+DoTest refine.out.save refine.out
+
+# 6 replicas, T-REMD log with no success column.
+OPTLINE="-i tremd.opts -b 0 -e 0 --exchange-stats"
+RunTest "Temperature ladder refinement from T-REMD log test."
+sed -n "/^    Refining ladder from 'rem.tremd.log'/,/^    Dim/p" $OUTPUT > tremd.out
+DoTest tremd.out.save tremd.out
+
+EndTest
@@ -0,0 +1,18 @@
+#!/bin/bash
+
+. ../MasterTest.sh
+
+CleanFiles run.001 watch.out
+
+# run.000 is complete. run.001 starts with a partial trajectory for
+# replica 2, which is completed while the runs are watched.
+cp -r run.000 run.001
+head -c 400 run.000/TRAJ/rem.crd.002 > run.001/TRAJ/rem.crd.002
+( sleep 1 ; cp run.000/TRAJ/rem.crd.002 run.001/TRAJ/rem.crd.002 ) &
+OPTLINE="-b 0 -e 1 --watch"
+RunTest "Watch mode test."
+wait
+sed -n '/^All watched runs complete/,$p' $OUTPUT > watch.out
+DoTest watch.out.save watch.out
+
+EndTest